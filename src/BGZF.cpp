@@ -0,0 +1,1108 @@
+// ===========================================================
+//
+// BGZF.cpp: Reading uncompressed, gzip and BGZF files
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "BGZF.h"
+#include <climits>
+#include <algorithm>
+
+
+namespace SeqArray
+{
+
+/// the size of BGZF block header
+static const size_t BGZF_HEADER_SIZE = 18;
+/// the size of BGZF block footer (CRC32 and ISIZE)
+static const size_t BGZF_FOOTER_SIZE = 8;
+/// the number of BGZF blocks in a slot (up to 4MB inflated data)
+static const int BGZF_SLOT_NUM_BLOCK = 64;
+/// the buffer size of gzip files
+static const unsigned GZIP_BUFFER_SIZE = 4*1024*1024;
+
+/// get a 16-bit or 32-bit little-endian integer
+inline static C_UInt32 LE16(const C_UInt8 *p)
+	{ return (C_UInt32)p[0] | ((C_UInt32)p[1] << 8); }
+inline static C_UInt32 LE32(const C_UInt8 *p)
+	{ return LE16(p) | (LE16(p + 2) << 16); }
+
+/// set a 16-bit or 32-bit little-endian integer
+inline static void SET_LE16(C_UInt8 *p, C_UInt32 v)
+	{ p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; }
+inline static void SET_LE32(C_UInt8 *p, C_UInt32 v)
+	{ SET_LE16(p, v); SET_LE16(p + 2, v >> 16); }
+
+/// the maximum size of uncompressed data in a BGZF block written
+static const size_t BGZF_BLOCK_SIZE = 0xFF00;
+/// the maximum size of a BGZF block
+static const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+/// the empty BGZF block as the EOF marker
+static const C_UInt8 BGZF_EOF[28] = {
+	0x1F, 0x8B, 0x08, 0x04, 0, 0, 0, 0, 0, 0xFF, 0x06, 0, 0x42, 0x43, 0x02, 0,
+	0x1B, 0, 0x03, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+
+// ===========================================================
+
+CBGZF_Reader::TInflater::TInflater()
+{
+#ifdef HAVE_LIBDEFLATE
+	Decomp = libdeflate_alloc_decompressor();
+	if (!Decomp)
+		throw ErrSeqArray("Fail to allocate the decompressor.");
+#else
+	memset(&Z, 0, sizeof(Z));
+	if (inflateInit2(&Z, -15) != Z_OK)
+		throw ErrSeqArray("Fail to initialize zlib.");
+#endif
+}
+
+CBGZF_Reader::TInflater::~TInflater()
+{
+#ifdef HAVE_LIBDEFLATE
+	libdeflate_free_decompressor(Decomp);
+#else
+	inflateEnd(&Z);
+#endif
+}
+
+void CBGZF_Reader::TInflater::Inflate(const C_UInt8 *in, size_t in_len,
+	C_UInt8 *out, size_t out_len, C_UInt32 crc)
+{
+#ifdef HAVE_LIBDEFLATE
+	size_t n = 0;
+	if (libdeflate_deflate_decompress(Decomp, in, in_len, out, out_len, &n)
+			!= LIBDEFLATE_SUCCESS || n != out_len)
+		throw ErrSeqArray("Invalid deflate data in a BGZF block.");
+	if (libdeflate_crc32(0, out, out_len) != crc)
+		throw ErrSeqArray("CRC32 mismatch in a BGZF block.");
+#else
+	inflateReset(&Z);
+	Z.next_in = (Bytef*)in;
+	Z.avail_in = in_len;
+	Z.next_out = out;
+	Z.avail_out = out_len;
+	if (inflate(&Z, Z_FINISH) != Z_STREAM_END || Z.avail_out != 0)
+		throw ErrSeqArray("Invalid deflate data in a BGZF block.");
+	if (crc32(crc32(0, Z_NULL, 0), out, out_len) != crc)
+		throw ErrSeqArray("CRC32 mismatch in a BGZF block.");
+#endif
+}
+
+
+// ===========================================================
+
+CBGZF_Reader::CBGZF_Reader(const char *fn, int num_thread)
+{
+	fFileName = fn;
+	fFileType = ftPlain;
+	fFile = NULL; fGZFile = NULL;
+	fEOF = fStarted = fStop = false;
+	fNumFill = fNumRead = fNumSubmit = fNumTaken = 0;
+	fNumRun = 0;
+	fNumBlock = BGZF_SLOT_NUM_BLOCK;
+
+	// detect the file type
+	fFile = fopen(fn, "rb");
+	if (!fFile)
+		throw ErrSeqArray("Fail to open '%s'.", fn);
+	C_UInt8 hdr[BGZF_HEADER_SIZE];
+	size_t n = fread(hdr, 1, sizeof(hdr), fFile);
+	if ((n >= 2) && (hdr[0] == 0x1F) && (hdr[1] == 0x8B))
+	{
+		if ((n == sizeof(hdr)) && IsBGZFHeader(hdr))
+			fFileType = ftBGZF;
+		else
+			fFileType = ftGZip;
+	}
+
+	if (fFileType == ftGZip)
+	{
+		fclose(fFile); fFile = NULL;
+		fGZFile = gzopen(fn, "rb");
+		if (!fGZFile)
+			throw ErrSeqArray("Fail to open '%s'.", fn);
+		gzbuffer(fGZFile, GZIP_BUFFER_SIZE);
+		return;
+	}
+	if (fseek(fFile, 0, SEEK_SET) != 0)
+	{
+		fclose(fFile); fFile = NULL;
+		throw ErrSeqArray("Fail to seek '%s'.", fn);
+	}
+	if (fFileType == ftPlain) return;
+
+	// BGZF, inflating in the current thread if num_thread = 1
+	if (num_thread < 1) num_thread = 1;
+	fSlots.resize(num_thread > 1 ? 4*num_thread : 1);
+	for (int i=0; i < num_thread; i++)
+		fInflaters.push_back(new TInflater);
+	pthread_mutex_init(&fMutex, NULL);
+	pthread_cond_init(&fCondSubmit, NULL);
+	pthread_cond_init(&fCondParsed, NULL);
+	for (int i=0; (num_thread > 1) && (i < num_thread); i++)
+	{
+		pthread_t th;
+		if (pthread_create(&th, NULL, thread_proc, this) != 0) break;
+		fThreads.push_back(th);
+	}
+}
+
+CBGZF_Reader::~CBGZF_Reader()
+{
+	Close();
+}
+
+void CBGZF_Reader::Close()
+{
+	if ((fFileType == ftBGZF) && !fInflaters.empty())
+	{
+		pthread_mutex_lock(&fMutex);
+		fStop = true;
+		pthread_cond_broadcast(&fCondSubmit);
+		pthread_mutex_unlock(&fMutex);
+		for (size_t i=0; i < fThreads.size(); i++)
+			pthread_join(fThreads[i], NULL);
+		pthread_cond_destroy(&fCondParsed);
+		pthread_cond_destroy(&fCondSubmit);
+		pthread_mutex_destroy(&fMutex);
+		for (size_t i=0; i < fInflaters.size(); i++)
+			delete fInflaters[i];
+		fInflaters.clear();
+		fThreads.clear();
+	}
+	if (fFile) { fclose(fFile); fFile = NULL; }
+	if (fGZFile) { gzclose(fGZFile); fGZFile = NULL; }
+}
+
+bool CBGZF_Reader::IsBGZFHeader(const C_UInt8 *hdr)
+{
+	// gzip magic, deflate, FEXTRA, XLEN=6, and the subfield 'BC' of 2 bytes
+	return (hdr[0] == 0x1F) && (hdr[1] == 0x8B) && (hdr[2] == 8) &&
+		(hdr[3] & 0x04) && (LE16(hdr + 10) == 6) &&
+		(hdr[12] == 'B') && (hdr[13] == 'C') && (LE16(hdr + 14) == 2);
+}
+
+size_t CBGZF_Reader::Read(void *buf, size_t size)
+{
+	switch (fFileType)
+	{
+	case ftPlain:
+		{
+			size_t n = fread(buf, 1, size, fFile);
+			if ((n < size) && ferror(fFile))
+				throw ErrSeqArray("Fail to read '%s'.", fFileName.c_str());
+			return n;
+		}
+	case ftGZip:
+		{
+			if (size > INT_MAX) size = INT_MAX;
+			int n = gzread(fGZFile, buf, size);
+			if (n < 0)
+			{
+				int errnum = 0;
+				throw ErrSeqArray("Fail to read '%s' (%s).", fFileName.c_str(),
+					gzerror(fGZFile, &errnum));
+			}
+			return n;
+		}
+	default:
+		break;
+	}
+
+	// BGZF, load the compressed blocks for all slots
+	if (!fStarted)
+	{
+		fStarted = true;
+		while (!fEOF && (fNumFill - fNumRead < (C_Int64)fSlots.size()))
+		{
+			Fill(Slot(fNumFill));
+			if (!Slot(fNumFill).InStart.empty())
+				Submit(fNumFill++);
+		}
+	}
+
+	C_UInt8 *p = (C_UInt8*)buf;
+	size_t n = 0;
+	while ((n < size) && (fNumRead < fNumFill))
+	{
+		TSlot &S = Wait(fNumRead);
+		if (!S.ErrMsg.empty())
+			throw ErrSeqArray("%s (%s)", S.ErrMsg.c_str(), fFileName.c_str());
+		size_t m = S.OutLen - S.OutPos;
+		if (m > size - n) m = size - n;
+		if (m > 0)
+		{
+			memcpy(p + n, &S.Out[S.OutPos], m);
+			S.OutPos += m; n += m;
+		}
+		if (S.OutPos >= S.OutLen)
+		{
+			// reuse the slot for the next blocks
+			fNumRead ++;
+			if (!fEOF)
+			{
+				TSlot &T = Slot(fNumFill);
+				Fill(T);
+				if (!T.InStart.empty()) Submit(fNumFill++);
+			}
+			// return the inflated data without waiting for the next slot
+			if (n > 0) break;
+		}
+	}
+	return n;
+}
+
+void CBGZF_Reader::Seek(C_UInt64 voffset)
+{
+	if (fFileType != ftBGZF)
+	{
+		throw ErrSeqArray("'%s' should be BGZF-compressed for random access.",
+			fFileName.c_str());
+	}
+	// discard the loaded slots after the worker threads finish them
+	for (C_Int64 i=fNumRead; (i < fNumFill) && !fThreads.empty(); i++)
+		Wait(i);
+	fNumRead = fNumFill;
+	fEOF = fStarted = false;
+	// only a few blocks are needed for a small region, more after reading
+	fNumBlock = 1;
+
+#ifdef _WIN32
+	int rv = fseeko64(fFile, voffset >> 16, SEEK_SET);
+#else
+	int rv = fseeko(fFile, voffset >> 16, SEEK_SET);
+#endif
+	if (rv != 0)
+		throw ErrSeqArray("Fail to seek '%s'.", fFileName.c_str());
+
+	// skip the bytes in the first block
+	C_UInt8 buf[4096];
+	size_t skip = voffset & 0xFFFF;
+	while (skip > 0)
+	{
+		size_t n = Read(buf, (skip < sizeof(buf)) ? skip : sizeof(buf));
+		if (n == 0) break;
+		skip -= n;
+	}
+}
+
+void CBGZF_Reader::Fill(TSlot &S)
+{
+	S.In.clear(); S.InStart.clear();
+	S.OutLen = S.OutPos = 0;
+	S.ErrMsg.clear();
+	for (int k=0; k < fNumBlock; k++)
+	{
+		C_UInt8 hdr[BGZF_HEADER_SIZE];
+		size_t n = fread(hdr, 1, sizeof(hdr), fFile);
+		if (n == 0)
+		{
+			if (ferror(fFile))
+				throw ErrSeqArray("Fail to read '%s'.", fFileName.c_str());
+			fEOF = true;
+			break;
+		}
+		if ((n < sizeof(hdr)) || !IsBGZFHeader(hdr))
+			throw ErrSeqArray("Invalid BGZF block header in '%s'.", fFileName.c_str());
+		// the total block size
+		size_t bsize = LE16(hdr + 16) + 1;
+		if (bsize < BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE)
+			throw ErrSeqArray("Invalid BGZF block size in '%s'.", fFileName.c_str());
+		size_t st = S.In.size();
+		S.In.resize(st + bsize);
+		memcpy(&S.In[st], hdr, sizeof(hdr));
+		n = bsize - sizeof(hdr);
+		if (fread(&S.In[st + sizeof(hdr)], 1, n, fFile) != n)
+			throw ErrSeqArray("Truncated BGZF block in '%s'.", fFileName.c_str());
+		S.InStart.push_back(st);
+		S.OutLen += LE32(&S.In[st + bsize - 4]);
+	}
+	if (!S.InStart.empty())
+		S.InStart.push_back(S.In.size());
+	if (fNumBlock < BGZF_SLOT_NUM_BLOCK)
+		fNumBlock = std::min(2*fNumBlock, BGZF_SLOT_NUM_BLOCK);
+	if (S.Out.size() < S.OutLen)
+		S.Out.resize(S.OutLen);
+}
+
+void CBGZF_Reader::Inflate(TInflater &I, TSlot &S)
+{
+	try {
+		size_t pos = 0;
+		for (size_t i=0; i+1 < S.InStart.size(); i++)
+		{
+			const C_UInt8 *s = &S.In[S.InStart[i]];
+			const C_UInt8 *e = &S.In[0] + S.InStart[i+1];
+			size_t n = LE32(e - 4);
+			if (n > 0)
+			{
+				I.Inflate(s + BGZF_HEADER_SIZE,
+					(e - s) - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE,
+					&S.Out[pos], n, LE32(e - 8));
+				pos += n;
+			}
+		}
+	}
+	catch (std::exception &E) {
+		S.ErrMsg = E.what();
+	}
+}
+
+void CBGZF_Reader::Submit(C_Int64 i)
+{
+	pthread_mutex_lock(&fMutex);
+	Slot(i).Parsed = false;
+	fNumSubmit = i + 1;
+	pthread_cond_signal(&fCondSubmit);
+	pthread_mutex_unlock(&fMutex);
+}
+
+CBGZF_Reader::TSlot &CBGZF_Reader::Wait(C_Int64 i)
+{
+	TSlot &S = Slot(i);
+	if (fThreads.empty())
+	{
+		// no worker thread, inflate it in the current thread
+		if (!S.Parsed)
+			{ Inflate(*fInflaters[0], S); S.Parsed = true; }
+		return S;
+	}
+	pthread_mutex_lock(&fMutex);
+	while (!S.Parsed)
+		pthread_cond_wait(&fCondParsed, &fMutex);
+	pthread_mutex_unlock(&fMutex);
+	return S;
+}
+
+void CBGZF_Reader::Run()
+{
+	pthread_mutex_lock(&fMutex);
+	TInflater *I = fInflaters[fNumRun++];
+	while (true)
+	{
+		while (!fStop && (fNumTaken >= fNumSubmit))
+			pthread_cond_wait(&fCondSubmit, &fMutex);
+		if (fStop) break;
+		TSlot &S = Slot(fNumTaken++);
+		pthread_mutex_unlock(&fMutex);
+
+		Inflate(*I, S);
+
+		pthread_mutex_lock(&fMutex);
+		S.Parsed = true;
+		pthread_cond_broadcast(&fCondParsed);
+	}
+	pthread_mutex_unlock(&fMutex);
+}
+
+void *CBGZF_Reader::thread_proc(void *ptr)
+{
+	((CBGZF_Reader*)ptr)->Run();
+	return NULL;
+}
+
+
+// ===========================================================
+
+CBGZF_Writer::TDeflater::TDeflater()
+{
+#ifdef HAVE_LIBDEFLATE
+	Comp = libdeflate_alloc_compressor(6);
+	if (!Comp)
+		throw ErrSeqArray("Fail to allocate the compressor.");
+#else
+	memset(&Z, 0, sizeof(Z));
+	if (deflateInit2(&Z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+			Z_DEFAULT_STRATEGY) != Z_OK)
+		throw ErrSeqArray("Fail to initialize zlib.");
+#endif
+}
+
+CBGZF_Writer::TDeflater::~TDeflater()
+{
+#ifdef HAVE_LIBDEFLATE
+	libdeflate_free_compressor(Comp);
+#else
+	deflateEnd(&Z);
+#endif
+}
+
+size_t CBGZF_Writer::TDeflater::Deflate(const C_UInt8 *in, size_t in_len,
+	C_UInt8 *out)
+{
+	C_UInt8 *p = out + BGZF_HEADER_SIZE;
+	const size_t max_len = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE -
+		BGZF_FOOTER_SIZE;
+	size_t n = 0;
+	C_UInt32 crc;
+#ifdef HAVE_LIBDEFLATE
+	n = libdeflate_deflate_compress(Comp, in, in_len, p, max_len);
+	crc = libdeflate_crc32(0, in, in_len);
+#else
+	deflateReset(&Z);
+	Z.next_in = (Bytef*)in;
+	Z.avail_in = in_len;
+	Z.next_out = p;
+	Z.avail_out = max_len;
+	if (deflate(&Z, Z_FINISH) == Z_STREAM_END)
+		n = max_len - Z.avail_out;
+	crc = crc32(crc32(0, Z_NULL, 0), in, in_len);
+#endif
+	if (n == 0)
+	{
+		// incompressible data, a stored deflate block
+		p[0] = 1;
+		SET_LE16(p + 1, in_len);
+		SET_LE16(p + 3, ~in_len);
+		memcpy(p + 5, in, in_len);
+		n = in_len + 5;
+	}
+
+	// header
+	static const C_UInt8 hdr[16] = {
+		0x1F, 0x8B, 0x08, 0x04, 0, 0, 0, 0, 0, 0xFF, 0x06, 0, 0x42, 0x43, 0x02, 0
+	};
+	memcpy(out, hdr, sizeof(hdr));
+	const size_t size = n + BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE;
+	SET_LE16(out + 16, size - 1);
+	// footer
+	SET_LE32(p + n, crc);
+	SET_LE32(p + n + 4, in_len);
+	return size;
+}
+
+
+// ===========================================================
+
+CBGZF_Writer::CBGZF_Writer(const char *fn, int num_thread)
+{
+	fFileName = fn;
+	fFileSize = 0;
+	fFillLen = 0;
+	fClosed = fStop = false;
+	fNumFill = fNumWrite = fNumSubmit = fNumTaken = 0;
+	fNumRun = 0;
+
+	fFile = fopen(fn, "wb");
+	if (!fFile)
+		throw ErrSeqArray("Fail to create '%s'.", fn);
+
+	// deflating in the current thread if num_thread = 1
+	if (num_thread < 1) num_thread = 1;
+	fSlots.resize(num_thread > 1 ? 4*num_thread : 1);
+	for (size_t i=0; i < fSlots.size(); i++)
+	{
+		fSlots[i].In.resize(BGZF_BLOCK_SIZE);
+		fSlots[i].Out.resize(BGZF_MAX_BLOCK_SIZE);
+	}
+	for (int i=0; i < num_thread; i++)
+		fDeflaters.push_back(new TDeflater);
+	pthread_mutex_init(&fMutex, NULL);
+	pthread_cond_init(&fCondSubmit, NULL);
+	pthread_cond_init(&fCondParsed, NULL);
+	for (int i=0; (num_thread > 1) && (i < num_thread); i++)
+	{
+		pthread_t th;
+		if (pthread_create(&th, NULL, thread_proc, this) != 0) break;
+		fThreads.push_back(th);
+	}
+}
+
+CBGZF_Writer::~CBGZF_Writer()
+{
+	Stop();
+	pthread_cond_destroy(&fCondParsed);
+	pthread_cond_destroy(&fCondSubmit);
+	pthread_mutex_destroy(&fMutex);
+	for (size_t i=0; i < fDeflaters.size(); i++)
+		delete fDeflaters[i];
+	if (fFile) fclose(fFile);
+}
+
+void CBGZF_Writer::Write(const void *buf, size_t size)
+{
+	if (fClosed)
+		throw ErrSeqArray("'%s' has been closed.", fFileName.c_str());
+	const C_UInt8 *p = (const C_UInt8*)buf;
+	while (size > 0)
+	{
+		// wait for a free slot when starting a new block
+		if (fFillLen == 0)
+		{
+			while (fNumFill - fNumWrite >= (C_Int64)fSlots.size())
+				WriteBlock();
+		}
+		TSlot &S = Slot(fNumFill);
+		size_t n = BGZF_BLOCK_SIZE - fFillLen;
+		if (n > size) n = size;
+		memcpy(&S.In[fFillLen], p, n);
+		fFillLen += n; p += n; size -= n;
+		if (fFillLen >= BGZF_BLOCK_SIZE)
+		{
+			S.InLen = fFillLen;
+			Submit(fNumFill++);
+			fFillLen = 0;
+		}
+	}
+}
+
+void CBGZF_Writer::Close()
+{
+	if (fClosed) return;
+	if (fFillLen > 0)
+	{
+		Slot(fNumFill).InLen = fFillLen;
+		Submit(fNumFill++);
+		fFillLen = 0;
+	}
+	while (fNumWrite < fNumFill) WriteBlock();
+	fBlockOffset.push_back(fFileSize);
+	Stop();
+	fClosed = true;
+	bool ok = (fwrite(BGZF_EOF, 1, sizeof(BGZF_EOF), fFile) == sizeof(BGZF_EOF));
+	if (fclose(fFile) != 0) ok = false;
+	fFile = NULL;
+	if (!ok)
+		throw ErrSeqArray("Fail to write '%s'.", fFileName.c_str());
+}
+
+C_UInt64 CBGZF_Writer::VirtualOffset(C_UInt64 pos) const
+{
+	const C_UInt64 blk = pos >> 16;
+	if (blk >= fBlockOffset.size())
+		throw ErrSeqArray("Invalid position in '%s'.", fFileName.c_str());
+	return (fBlockOffset[blk] << 16) | (pos & 0xFFFF);
+}
+
+void CBGZF_Writer::Submit(C_Int64 i)
+{
+	TSlot &S = Slot(i);
+	if (fThreads.empty())
+	{
+		// no worker thread, deflate it in the current thread
+		Deflate(*fDeflaters[0], S);
+		S.Parsed = true;
+		return;
+	}
+	pthread_mutex_lock(&fMutex);
+	S.Parsed = false;
+	fNumSubmit = i + 1;
+	pthread_cond_signal(&fCondSubmit);
+	pthread_mutex_unlock(&fMutex);
+}
+
+void CBGZF_Writer::WriteBlock()
+{
+	TSlot &S = Slot(fNumWrite);
+	if (!fThreads.empty())
+	{
+		pthread_mutex_lock(&fMutex);
+		while (!S.Parsed)
+			pthread_cond_wait(&fCondParsed, &fMutex);
+		pthread_mutex_unlock(&fMutex);
+	}
+	if (!S.ErrMsg.empty())
+		throw ErrSeqArray("%s", S.ErrMsg.c_str());
+	if (fwrite(&S.Out[0], 1, S.OutLen, fFile) != S.OutLen)
+		throw ErrSeqArray("Fail to write '%s'.", fFileName.c_str());
+	fBlockOffset.push_back(fFileSize);
+	fFileSize += S.OutLen;
+	fNumWrite ++;
+}
+
+void CBGZF_Writer::Deflate(TDeflater &D, TSlot &S)
+{
+	try {
+		S.OutLen = D.Deflate(&S.In[0], S.InLen, &S.Out[0]);
+	}
+	catch (std::exception &E) {
+		S.ErrMsg = E.what();
+	}
+}
+
+void CBGZF_Writer::Stop()
+{
+	if (fThreads.empty()) return;
+	pthread_mutex_lock(&fMutex);
+	fStop = true;
+	pthread_cond_broadcast(&fCondSubmit);
+	pthread_mutex_unlock(&fMutex);
+	for (size_t i=0; i < fThreads.size(); i++)
+		pthread_join(fThreads[i], NULL);
+	fThreads.clear();
+}
+
+void CBGZF_Writer::Run()
+{
+	pthread_mutex_lock(&fMutex);
+	TDeflater *D = fDeflaters[fNumRun++];
+	while (true)
+	{
+		while (!fStop && (fNumTaken >= fNumSubmit))
+			pthread_cond_wait(&fCondSubmit, &fMutex);
+		if (fStop) break;
+		TSlot &S = Slot(fNumTaken++);
+		pthread_mutex_unlock(&fMutex);
+
+		Deflate(*D, S);
+
+		pthread_mutex_lock(&fMutex);
+		S.Parsed = true;
+		pthread_cond_broadcast(&fCondParsed);
+	}
+	pthread_mutex_unlock(&fMutex);
+}
+
+void *CBGZF_Writer::thread_proc(void *ptr)
+{
+	((CBGZF_Writer*)ptr)->Run();
+	return NULL;
+}
+
+
+// ===========================================================
+
+/// the bytes of an index file to be written
+struct COREARRAY_DLL_LOCAL TIndexOutput
+{
+	vector<C_UInt8> buf;
+
+	inline void I32(C_Int32 v)
+	{
+		C_UInt8 s[4];
+		SET_LE32(s, v);
+		buf.insert(buf.end(), s, s + 4);
+	}
+	inline void U64(C_UInt64 v)
+		{ I32((C_UInt32)v); I32((C_UInt32)(v >> 32)); }
+	inline void Bytes(const void *p, size_t n)
+		{ buf.insert(buf.end(), (const C_UInt8*)p, (const C_UInt8*)p + n); }
+	/// the tabix configuration and sequence names of VCF
+	void Conf(const vector<string> &names)
+	{
+		I32(2);  // format: VCF
+		I32(1); I32(2); I32(0);  // col_seq, col_beg and col_end
+		I32('#'); I32(0);  // meta and skip
+		size_t n = 0;
+		for (size_t i=0; i < names.size(); i++) n += names[i].size() + 1;
+		I32(n);
+		for (size_t i=0; i < names.size(); i++)
+			Bytes(names[i].c_str(), names[i].size() + 1);
+	}
+};
+
+/// the linear index is not set
+static const C_UInt64 LINEAR_NA = ~(C_UInt64)0;
+
+CBGZF_IndexBuilder::CBGZF_IndexBuilder(bool csi)
+{
+	fIsCSI = csi;
+	fMinShift = 14;
+	// 2^29 in tabix, and 2^32 in CSI which is the same as htslib
+	fDepth = csi ? 6 : 5;
+}
+
+C_UInt32 CBGZF_IndexBuilder::Reg2Bin(C_Int64 beg, C_Int64 end) const
+{
+	// the same as hts_reg2bin() in htslib
+	int l, s = fMinShift;
+	C_UInt32 t = ((1U << (3*fDepth)) - 1) / 7;
+	for (--end, l = fDepth; l > 0; --l, s += 3, t -= 1U << (3*l))
+		if ((beg >> s) == (end >> s)) return t + (beg >> s);
+	return 0;
+}
+
+void CBGZF_IndexBuilder::Push(const string &name, C_Int64 beg, C_Int64 end,
+	C_UInt64 vbeg, C_UInt64 vend)
+{
+	if (!fErrMsg.empty()) return;
+	// the reference sequence
+	map<string, int>::iterator it = fNameIdx.find(name);
+	if (it == fNameIdx.end())
+	{
+		fNameIdx[name] = fRefs.size();
+		fNames.push_back(name);
+		fRefs.push_back(TRef());
+		TRef &R = fRefs.back();
+		R.OffBeg = vbeg;
+		R.NumRec = 0; R.LastBeg = 0; R.LastBin = 0;
+	} else if (it->second + 1 != (int)fRefs.size())
+	{
+		fErrMsg = "the chromosomes are not contiguous";
+		return;
+	}
+	TRef &R = fRefs.back();
+	if (beg < R.LastBeg)
+	{
+		fErrMsg = "the variants are not sorted by position";
+		return;
+	}
+	if (beg < 0) beg = 0;
+	if (end <= beg) end = beg + 1;
+	if (end > ((C_Int64)1 << (fMinShift + 3*fDepth)))
+	{
+		fErrMsg = fIsCSI ? "the position is too large" :
+			"the position is larger than 2^29, please use a CSI index";
+		return;
+	}
+
+	// the bin and its chunks
+	const C_UInt32 bin = Reg2Bin(beg, end);
+	vector<TChunk> &c = R.Bins[bin];
+	if (!c.empty() && (R.LastBin == bin) && (c.back().End == vbeg))
+		c.back().End = vend;
+	else {
+		TChunk v = { vbeg, vend };
+		c.push_back(v);
+	}
+	// the linear index
+	const size_t w1 = beg >> fMinShift, w2 = (end - 1) >> fMinShift;
+	if (R.Linear.size() <= w2)
+		R.Linear.resize(w2 + 1, LINEAR_NA);
+	for (size_t w=w1; w <= w2; w++)
+		if (R.Linear[w] == LINEAR_NA) R.Linear[w] = vbeg;
+
+	R.OffEnd = vend;
+	R.NumRec ++;
+	R.LastBeg = beg; R.LastBin = bin;
+}
+
+void CBGZF_IndexBuilder::Save(const char *fn, const CBGZF_Writer &W)
+{
+	if (!fErrMsg.empty())
+		throw ErrSeqArray("Fail to create '%s': %s.", fn, fErrMsg.c_str());
+
+	TIndexOutput O;
+	if (!fIsCSI)
+	{
+		O.Bytes("TBI\1", 4);
+		O.I32(fRefs.size());
+		O.Conf(fNames);
+	} else {
+		O.Bytes("CSI\1", 4);
+		O.I32(fMinShift); O.I32(fDepth);
+		TIndexOutput A;
+		A.Conf(fNames);
+		O.I32(A.buf.size());
+		O.Bytes(&A.buf[0], A.buf.size());
+		O.I32(fRefs.size());
+	}
+
+	const C_UInt32 pseudo_bin = ((1U << (3*fDepth + 3)) - 1) / 7 + 1;
+	for (size_t i=0; i < fRefs.size(); i++)
+	{
+		TRef &R = fRefs[i];
+		// fill the empty windows of the linear index, which is not
+		// decreasing since the records are sorted
+		vector<C_UInt64> lin(R.Linear.size());
+		C_UInt64 last = W.VirtualOffset(R.OffBeg);
+		for (size_t j=0; j < lin.size(); j++)
+		{
+			if (R.Linear[j] != LINEAR_NA)
+				last = W.VirtualOffset(R.Linear[j]);
+			lin[j] = last;
+		}
+
+		O.I32(R.Bins.size() + 1);
+		map<C_UInt32, vector<TChunk> >::iterator it;
+		for (it=R.Bins.begin(); it != R.Bins.end(); it++)
+		{
+			vector<TChunk> &c = it->second;
+			O.I32(it->first);
+			if (fIsCSI)
+			{
+				// the offset of the first record overlapping the bin
+				int l = 0;
+				C_UInt32 t = 0;
+				while ((l < fDepth) && (it->first >= t + (1U << (3*l))))
+					{ t += 1U << (3*l); l ++; }
+				size_t w = (size_t)(it->first - t) << (3*(fDepth - l));
+				C_UInt64 v = W.VirtualOffset(c[0].Beg);
+				if ((w < lin.size()) && (lin[w] < v)) v = lin[w];
+				O.U64(v);
+			}
+			O.I32(c.size());
+			for (size_t k=0; k < c.size(); k++)
+			{
+				O.U64(W.VirtualOffset(c[k].Beg));
+				O.U64(W.VirtualOffset(c[k].End));
+			}
+		}
+		// the pseudo-bin for the statistics
+		O.I32(pseudo_bin);
+		if (fIsCSI) O.U64(0);
+		O.I32(2);
+		O.U64(W.VirtualOffset(R.OffBeg)); O.U64(W.VirtualOffset(R.OffEnd));
+		O.U64(R.NumRec); O.U64(0);
+
+		if (!fIsCSI)
+		{
+			O.I32(lin.size());
+			for (size_t j=0; j < lin.size(); j++) O.U64(lin[j]);
+		}
+	}
+	O.U64(0);  // no record without coordinate
+
+	CBGZF_Writer F(fn, 1);
+	F.Write(&O.buf[0], O.buf.size());
+	F.Close();
+}
+
+
+// ===========================================================
+
+/// the bytes of an index file
+struct COREARRAY_DLL_LOCAL TIndexBuffer
+{
+	const C_UInt8 *p, *end;
+	const char *fn;
+
+	inline void Check(size_t n)
+	{
+		if ((size_t)(end - p) < n)
+			throw ErrSeqArray("Invalid index file '%s'.", fn);
+	}
+	inline C_Int32 I32()
+		{ Check(4); C_Int32 v = LE32(p); p += 4; return v; }
+	inline C_UInt64 U64()
+	{
+		Check(8);
+		C_UInt64 v = LE32(p) | ((C_UInt64)LE32(p + 4) << 32);
+		p += 8; return v;
+	}
+	/// get a count, which needs at least 'size' bytes for each item
+	inline size_t Num(size_t size)
+	{
+		C_Int32 n = I32();
+		if ((n < 0) || ((size_t)(end - p) / size < (size_t)n))
+			throw ErrSeqArray("Invalid index file '%s'.", fn);
+		return n;
+	}
+	/// the sequence names (NUL-terminated) in the tabix header
+	void Names(vector<string> &names)
+	{
+		size_t n = Num(1);
+		const char *s = (const char*)p, *e = s + n;
+		p += n;
+		while (s < e)
+		{
+			const char *t = s;
+			while ((t < e) && *t) t ++;
+			names.push_back(string(s, t));
+			s = t + 1;
+		}
+	}
+};
+
+
+CBGZF_Index::CBGZF_Index(const char *fn)
+{
+	// load the whole index
+	vector<C_UInt8> buf;
+	{
+		CBGZF_Reader R(fn, 1);
+		C_UInt8 s[65536];
+		size_t n;
+		while ((n = R.Read(s, sizeof(s))) > 0)
+			buf.insert(buf.end(), s, s + n);
+	}
+	TIndexBuffer B;
+	B.p = buf.empty() ? NULL : &buf[0];
+	B.end = B.p + buf.size();
+	B.fn = fn;
+
+	// header
+	size_t n_ref = 0;
+	B.Check(4);
+	if (memcmp(B.p, "TBI\1", 4) == 0)
+	{
+		B.p += 4;
+		fIsCSI = false;
+		fMinShift = 14; fDepth = 5;
+		n_ref = B.Num(4);
+		B.Check(4*6);
+		B.p += 4*6;  // format, col_seq, col_beg, col_end, meta and skip
+		B.Names(fNames);
+		if (fNames.size() != n_ref)
+			throw ErrSeqArray("Invalid index file '%s'.", fn);
+	} else if (memcmp(B.p, "CSI\1", 4) == 0)
+	{
+		B.p += 4;
+		fIsCSI = true;
+		fMinShift = B.I32(); fDepth = B.I32();
+		if ((fMinShift < 0) || (fDepth < 0) || (fDepth > 9) ||
+			(fMinShift + 3*fDepth > 62))
+			throw ErrSeqArray("Invalid index file '%s'.", fn);
+		size_t l_aux = B.Num(1);
+		// the tabix header in the auxiliary data, no name for BCF
+		if (l_aux >= 28)
+		{
+			TIndexBuffer A = B;
+			A.end = B.p + l_aux;
+			A.p += 4*6;
+			A.Names(fNames);
+		}
+		B.p += l_aux;
+		n_ref = B.Num(4);
+	} else
+		throw ErrSeqArray("'%s' should be a tabix or CSI index.", fn);
+
+	// bins and chunks
+	const C_UInt32 pseudo_bin = ((1U << (3*fDepth + 3)) - 1) / 7 + 1;
+	fRefs.resize(n_ref);
+	if (!fNames.empty() && (fNames.size() != n_ref))
+		throw ErrSeqArray("Invalid index file '%s'.", fn);
+	for (size_t i=0; i < fRefs.size(); i++)
+	{
+		TRef &R = fRefs[i];
+		R.Bins.resize(B.Num(8));
+		for (size_t j=0; j < R.Bins.size(); j++)
+		{
+			TBin &b = R.Bins[j];
+			b.Bin = B.I32();
+			b.LOffset = fIsCSI ? B.U64() : 0;
+			b.Chunks.resize(B.Num(16));
+			for (size_t k=0; k < b.Chunks.size(); k++)
+			{
+				b.Chunks[k].Beg = B.U64();
+				b.Chunks[k].End = B.U64();
+			}
+		}
+		// the pseudo-bin has the statistics instead of chunks
+		for (size_t j=0; j < R.Bins.size(); j++)
+		{
+			if (R.Bins[j].Bin == pseudo_bin)
+				{ R.Bins.erase(R.Bins.begin() + j); break; }
+		}
+		std::sort(R.Bins.begin(), R.Bins.end(), BinLess);
+		if (!fIsCSI)
+		{
+			R.Linear.resize(B.Num(8));
+			for (size_t j=0; j < R.Linear.size(); j++)
+				R.Linear[j] = B.U64();
+		}
+	}
+}
+
+bool CBGZF_Index::BinLess(const TBin &a, const TBin &b)
+{
+	return a.Bin < b.Bin;
+}
+
+const CBGZF_Index::TBin *CBGZF_Index::FindBin(const TRef &R, C_UInt32 bin) const
+{
+	TBin val;
+	val.Bin = bin;
+	vector<TBin>::const_iterator it =
+		std::lower_bound(R.Bins.begin(), R.Bins.end(), val, BinLess);
+	return ((it != R.Bins.end()) && (it->Bin == bin)) ? &(*it) : NULL;
+}
+
+bool CBGZF_Index::Query(int ref, C_Int64 beg, C_Int64 end,
+	C_UInt64 &voffset) const
+{
+	if ((ref < 0) || (ref >= NumRef())) return false;
+	const TRef &R = fRefs[ref];
+	const C_Int64 max_pos = (C_Int64)1 << (fMinShift + 3*fDepth);
+	if (beg < 0) beg = 0;
+	if (end > max_pos) end = max_pos;
+	if (beg >= end) return false;
+
+	// the lower bound of offsets from the linear index or the bins
+	C_UInt64 min_off = 0;
+	if (!fIsCSI)
+	{
+		if (!R.Linear.empty())
+		{
+			size_t w = beg >> fMinShift;
+			if (w >= R.Linear.size()) w = R.Linear.size() - 1;
+			min_off = R.Linear[w];
+		}
+	} else {
+		C_UInt32 bin = FirstLeaf() + (beg >> fMinShift);
+		while (true)
+		{
+			const TBin *b = FindBin(R, bin);
+			if (b) { min_off = b->LOffset; break; }
+			if (bin == 0) break;
+			bin = (bin - 1) >> 3;  // the parent bin
+		}
+	}
+
+	// all bins overlapping [beg, end) from the top level to the leaves
+	bool found = false;
+	end --;
+	C_UInt32 t = 0;
+	for (int l=0, s=fMinShift + 3*fDepth; l <= fDepth; l++, s-=3)
+	{
+		const C_UInt32 b_st = t + (beg >> s), b_ed = t + (end >> s);
+		t += 1U << (3*l);
+		TBin val;
+		val.Bin = b_st;
+		vector<TBin>::const_iterator it =
+			std::lower_bound(R.Bins.begin(), R.Bins.end(), val, BinLess);
+		for (; (it != R.Bins.end()) && (it->Bin <= b_ed); it++)
+		{
+			for (size_t k=0; k < it->Chunks.size(); k++)
+			{
+				const TChunk &c = it->Chunks[k];
+				if (c.End <= min_off) continue;
+				C_UInt64 v = (c.Beg < min_off) ? min_off : c.Beg;
+				if (!found || (v < voffset)) voffset = v;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+void CBGZF_Index::Windows(int ref, vector<C_Int64> &pos,
+	vector<C_UInt64> &voff) const
+{
+	pos.clear(); voff.clear();
+	if ((ref < 0) || (ref >= NumRef())) return;
+	const TRef &R = fRefs[ref];
+	if (!fIsCSI)
+	{
+		for (size_t i=0; i < R.Linear.size(); i++)
+		{
+			C_UInt64 v = R.Linear[i];
+			if ((v > 0) && (voff.empty() || (v > voff.back())))
+				{ pos.push_back((C_Int64)i << fMinShift); voff.push_back(v); }
+		}
+	} else {
+		// the leaf bins
+		const C_UInt32 first = FirstLeaf();
+		for (size_t i=0; i < R.Bins.size(); i++)
+		{
+			const TBin &b = R.Bins[i];
+			if ((b.Bin < first) || b.Chunks.empty()) continue;
+			C_UInt64 v = (b.LOffset > 0) ? b.LOffset : b.Chunks[0].Beg;
+			if (voff.empty() || (v > voff.back()))
+			{
+				pos.push_back((C_Int64)(b.Bin - first) << fMinShift);
+				voff.push_back(v);
+			}
+		}
+	}
+}
+
+}
@@ -0,0 +1,312 @@
+// ===========================================================
+//
+// BGZF.h: Reading and writing uncompressed, gzip and BGZF files
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     BGZF.h
+ *	\author   Xiuwen Zheng [zhengx@u.washington.edu]
+ *	\version  1.0
+ *	\date     2020
+ *	\brief    Reading and writing uncompressed, gzip and BGZF files
+ *	\details  A BGZF file consists of independent gzip blocks (at most 64KB
+ *	          uncompressed data per block), so that the blocks can be
+ *	          inflated in multiple threads ahead of reading, or deflated in
+ *	          multiple threads when writing. HAVE_LIBDEFLATE can be defined
+ *	          in Makevars to use libdeflate instead of zlib. Tabix (.tbi) and
+ *	          CSI (.csi) indexes are used for random access, and they can be
+ *	          built when writing.
+**/
+
+
+#ifndef _HEADER_SEQ_BGZF_
+#define _HEADER_SEQ_BGZF_
+
+#include "Index.h"
+#include <cstdio>
+#include <pthread.h>
+#include <zlib.h>
+
+#ifdef HAVE_LIBDEFLATE
+#   include <libdeflate.h>
+#endif
+
+
+namespace SeqArray
+{
+
+using namespace std;
+
+
+/// Sequential reader of a local file, which can be uncompressed, gzip or
+/// BGZF, and BGZF blocks are inflated in worker threads ahead of reading
+class COREARRAY_DLL_LOCAL CBGZF_Reader
+{
+public:
+	/// the file type
+	enum TFileType { ftPlain=0, ftGZip=1, ftBGZF=2 };
+
+	/// constructor, inflating BGZF blocks in 'num_thread' threads
+	CBGZF_Reader(const char *fn, int num_thread);
+	/// destructor
+	~CBGZF_Reader();
+
+	/// stop and join the worker threads, and close the file (it can be
+	/// called more than once, e.g., in a cleanup when R jumps out)
+	void Close();
+
+	/// read at most 'size' bytes, and return 0 at the end of file
+	size_t Read(void *buf, size_t size);
+	/// move to a virtual file offset of a BGZF file, i.e., the offset of
+	/// the compressed block (<< 16) plus the offset within the block
+	void Seek(C_UInt64 voffset);
+
+	/// the file type
+	inline TFileType FileType() const { return fFileType; }
+
+	/// return true if 'hdr' (at least 18 bytes) is a BGZF block header
+	static bool IsBGZFHeader(const C_UInt8 *hdr);
+
+private:
+	/// inflate BGZF blocks
+	struct TInflater
+	{
+	#ifdef HAVE_LIBDEFLATE
+		libdeflate_decompressor *Decomp;
+	#else
+		z_stream Z;
+	#endif
+		TInflater();
+		~TInflater();
+		/// inflate a raw deflate stream, and verify the length and CRC32
+		void Inflate(const C_UInt8 *in, size_t in_len, C_UInt8 *out,
+			size_t out_len, C_UInt32 crc);
+	};
+
+	/// consecutive BGZF blocks inflated together
+	struct TSlot
+	{
+		vector<C_UInt8> In;      //< the compressed blocks
+		vector<size_t> InStart;  //< the starting positions of blocks in 'In'
+		vector<C_UInt8> Out;     //< the inflated data
+		size_t OutLen;  //< the total length of inflated data
+		size_t OutPos;  //< the reading position in 'Out'
+		bool Parsed;    //< true if the blocks have been inflated
+		string ErrMsg;  //< the error message if fails
+		TSlot() { OutLen = OutPos = 0; Parsed = false; }
+	};
+
+	string fFileName;
+	TFileType fFileType;
+	FILE *fFile;     //< for uncompressed and BGZF files
+	gzFile fGZFile;  //< for gzip files
+	bool fEOF;       //< true if all BGZF blocks have been loaded
+	bool fStarted;   //< true if the slots have been filled
+
+	vector<TSlot> fSlots;
+	vector<TInflater*> fInflaters;
+	vector<pthread_t> fThreads;
+	pthread_mutex_t fMutex;
+	pthread_cond_t fCondSubmit, fCondParsed;
+	C_Int64 fNumFill;    //< the number of filled slots
+	C_Int64 fNumRead;    //< the number of slots which have been read
+	C_Int64 fNumSubmit;  //< the number of submitted slots
+	C_Int64 fNumTaken;   //< the number of slots taken by the threads
+	size_t fNumRun;      //< the number of running threads
+	int fNumBlock;       //< the number of blocks in the next filled slot
+	bool fStop;
+
+	inline TSlot &Slot(C_Int64 i) { return fSlots[i % fSlots.size()]; }
+	void Fill(TSlot &S);
+	void Submit(C_Int64 i);
+	TSlot &Wait(C_Int64 i);
+	static void Inflate(TInflater &I, TSlot &S);
+	void Run();
+	static void *thread_proc(void *ptr);
+};
+
+
+/// Writer of a BGZF file, the blocks are deflated in worker threads and
+/// written in order
+class COREARRAY_DLL_LOCAL CBGZF_Writer
+{
+public:
+	/// constructor, deflating BGZF blocks in 'num_thread' threads
+	CBGZF_Writer(const char *fn, int num_thread);
+	/// destructor, the file is incomplete if Close() is not called
+	~CBGZF_Writer();
+
+	/// write 'size' bytes
+	void Write(const void *buf, size_t size);
+	/// write all blocks and the EOF marker, and close the file
+	void Close();
+
+	/// the current position, i.e., the index of the block (<< 16) plus the
+	/// offset within the block, since the compressed offset of a block is
+	/// unknown until the previous blocks are deflated
+	inline C_UInt64 Tell() const
+		{ return ((C_UInt64)fNumFill << 16) | fFillLen; }
+	/// convert a position from Tell() to a virtual file offset after Close()
+	C_UInt64 VirtualOffset(C_UInt64 pos) const;
+
+private:
+	/// deflate BGZF blocks
+	struct TDeflater
+	{
+	#ifdef HAVE_LIBDEFLATE
+		libdeflate_compressor *Comp;
+	#else
+		z_stream Z;
+	#endif
+		TDeflater();
+		~TDeflater();
+		/// deflate 'in' to a BGZF block in 'out', return the block size
+		size_t Deflate(const C_UInt8 *in, size_t in_len, C_UInt8 *out);
+	};
+
+	/// a BGZF block
+	struct TSlot
+	{
+		vector<C_UInt8> In;   //< the uncompressed data
+		vector<C_UInt8> Out;  //< the BGZF block
+		size_t InLen;   //< the length of uncompressed data
+		size_t OutLen;  //< the size of the BGZF block
+		bool Parsed;    //< true if the block has been deflated
+		string ErrMsg;  //< the error message if fails
+		TSlot() { InLen = OutLen = 0; Parsed = false; }
+	};
+
+	string fFileName;
+	FILE *fFile;
+	C_UInt64 fFileSize;  //< the number of bytes written to the file
+	vector<C_UInt64> fBlockOffset;  //< the compressed offsets of blocks
+	size_t fFillLen;     //< the length of data in the filling block
+	bool fClosed;
+
+	vector<TSlot> fSlots;
+	vector<TDeflater*> fDeflaters;
+	vector<pthread_t> fThreads;
+	pthread_mutex_t fMutex;
+	pthread_cond_t fCondSubmit, fCondParsed;
+	C_Int64 fNumFill;    //< the number of filled blocks
+	C_Int64 fNumWrite;   //< the number of blocks written to the file
+	C_Int64 fNumSubmit;  //< the number of submitted blocks
+	C_Int64 fNumTaken;   //< the number of blocks taken by the threads
+	size_t fNumRun;      //< the number of running threads
+	bool fStop;
+
+	inline TSlot &Slot(C_Int64 i) { return fSlots[i % fSlots.size()]; }
+	void Submit(C_Int64 i);
+	void WriteBlock();
+	static void Deflate(TDeflater &D, TSlot &S);
+	void Stop();
+	void Run();
+	static void *thread_proc(void *ptr);
+};
+
+
+/// Building a tabix (.tbi) or CSI (.csi) index of a BGZF-compressed VCF
+/// file when writing the records sorted by chromosome and position
+class COREARRAY_DLL_LOCAL CBGZF_IndexBuilder
+{
+public:
+	/// constructor
+	CBGZF_IndexBuilder(bool csi);
+
+	/// add a record of the chromosome 'name' covering the 0-based half-open
+	/// interval [beg, end), and [vbeg, vend) are its positions in the file
+	/// given by CBGZF_Writer::Tell()
+	void Push(const string &name, C_Int64 beg, C_Int64 end, C_UInt64 vbeg,
+		C_UInt64 vend);
+
+	/// return an empty string if the index can be saved, otherwise the reason
+	inline const string &ErrMsg() const { return fErrMsg; }
+	/// save the index file after the writer is closed
+	void Save(const char *fn, const CBGZF_Writer &W);
+
+private:
+	struct TChunk { C_UInt64 Beg, End; };
+	struct TRef
+	{
+		map<C_UInt32, vector<TChunk> > Bins;  //< sorted by bin numbers
+		vector<C_UInt64> Linear;  //< the minimum offsets of 16kb windows
+		C_UInt64 OffBeg, OffEnd;  //< the offsets of the first and last records
+		C_UInt64 NumRec;          //< the number of records
+		C_Int64 LastBeg;          //< the starting position of the last record
+		C_UInt32 LastBin;         //< the bin of the last record
+	};
+	int fMinShift, fDepth;
+	bool fIsCSI;
+	vector<string> fNames;
+	vector<TRef> fRefs;
+	map<string, int> fNameIdx;
+	string fErrMsg;
+
+	C_UInt32 Reg2Bin(C_Int64 beg, C_Int64 end) const;
+};
+
+
+/// Tabix (.tbi) or CSI (.csi) index of a BGZF file
+class COREARRAY_DLL_LOCAL CBGZF_Index
+{
+public:
+	/// load an index file
+	CBGZF_Index(const char *fn);
+
+	/// the names of reference sequences, empty if not stored (e.g., the CSI
+	/// index of a BCF file, using the contig dictionary in the BCF header)
+	inline const vector<string> &Names() const { return fNames; }
+	/// the number of reference sequences
+	inline int NumRef() const { return fRefs.size(); }
+
+	/// the minimum virtual offset of the records overlapping the 0-based
+	/// half-open interval [beg, end) on the reference 'ref', return false
+	/// if there is no record
+	bool Query(int ref, C_Int64 beg, C_Int64 end, C_UInt64 &voffset) const;
+	/// the 0-based starting positions and virtual offsets of the windows
+	/// on the reference 'ref', which can be used to split the file
+	void Windows(int ref, vector<C_Int64> &pos, vector<C_UInt64> &voff) const;
+
+private:
+	struct TChunk { C_UInt64 Beg, End; };
+	struct TBin
+	{
+		C_UInt32 Bin;
+		C_UInt64 LOffset;  //< the minimum offset of the records in the bin
+		vector<TChunk> Chunks;
+	};
+	struct TRef
+	{
+		vector<TBin> Bins;        //< sorted by bin numbers
+		vector<C_UInt64> Linear;  //< the linear index of tabix
+	};
+	int fMinShift, fDepth;
+	bool fIsCSI;
+	vector<string> fNames;
+	vector<TRef> fRefs;
+
+	static bool BinLess(const TBin &a, const TBin &b);
+	const TBin *FindBin(const TRef &R, C_UInt32 bin) const;
+	inline C_UInt32 FirstLeaf() const
+		{ return ((1U << (3*fDepth)) - 1) / 7; }
+};
+
+}
+
+#endif /* _HEADER_SEQ_BGZF_ */
@@ -19,8 +19,10 @@
 // along with SeqArray.
 // If not, see <http://www.gnu.org/licenses/>.
 
-#include "Index.h"
+#include "ReadByVariant.h"
+#include "BGZF.h"
 #include "vectorization.h"
+#include "FloatConv.h"
 #include <cstdio>
 #include <cstring>
 #include <vector>
@@ -66,49 +68,240 @@ static string QuoteText(const char *p)
 
 // ========================================================================
 
-/// used in SEQ_OutVCF4
-static vector<int> VCF_INFO_Number;    ///<
-static vector<int> VCF_FORMAT_Number;  ///<
-static vector<SEXP> VCF_FORMAT_List;
+/// the data type of an INFO or FORMAT variable in the export
+enum TVCF_VarType
+{
+	vtInteger = 0,  ///< integer
+	vtFlag,         ///< logical, a FLAG in INFO
+	vtFloat,        ///< real number
+	vtString        ///< character
+};
+
+/// get the data type of an INFO or FORMAT variable
+static TVCF_VarType GetVarType(PdAbstractArray Node, C_SVType SVType,
+	bool flag, const char *var_name)
+{
+	if (COREARRAY_SV_INTEGER(SVType))
+	{
+		if (flag)
+		{
+			char classname[128];
+			GDS_Node_GetClassName(Node, classname, sizeof(classname));
+			if ((strcmp(classname, "dBit1") == 0) || GDS_R_Is_Logical(Node))
+				return vtFlag;
+		}
+		return vtInteger;
+	} else if (COREARRAY_SV_FLOAT(SVType))
+		return vtFloat;
+	else if (COREARRAY_SV_STRING(SVType))
+		return vtString;
+	else
+		throw ErrSeqArray("Invalid data type of '%s'.", var_name);
+}
 
-static size_t VCF_NumAllele;  ///< the number of alleles
-static size_t VCF_NumSample;  ///< the number of samples
-static Rconnection VCF_File = NULL;  ///< R connection object
+
+/// an INFO variable in the export
+struct COREARRAY_DLL_LOCAL TVCF_InfoVar
+{
+	CApply_Variant_Info *Reader;  ///< the reader
+	string Name;          ///< the INFO ID
+	int Number;           ///< the number of values, or < 0 for a variable length
+	TVCF_VarType Type;    ///< data type
+	vector<C_Int32> I32;  ///< the buffer of integers
+	vector<double> F64;   ///< the buffer of real numbers
+	vector<string> Str;   ///< the buffer of strings
+};
+
+/// a FORMAT variable in the export
+struct COREARRAY_DLL_LOCAL TVCF_FormatVar
+{
+	CApply_Variant_Format *Reader;  ///< the reader
+	string Name;          ///< the FORMAT ID
+	TVCF_VarType Type;    ///< data type
+	size_t NumIndex;      ///< the number of entries at the current variant
+	vector<C_Int32> I32;  ///< the buffer of integers
+	vector<double> F64;   ///< the buffer of real numbers
+	vector<string> Str;   ///< the buffer of strings
+};
 
 
 static const size_t LINE_BUFFER_SIZE = 4096;
-static vector<char> LineBuffer;
-static char *LineBegin = NULL;
-static char *LineEnd   = NULL;
-static char *pLine     = NULL;
 
+/// the class name of BGZF output connections
+static const char *BGZF_CONN_CLASS = "bgzip_file";
 
-inline static void LineBuf_Init(int num_variant)
+/// the private data of a BGZF output connection
+struct COREARRAY_DLL_LOCAL TBGZF_Output
+{
+	CBGZF_Writer *Writer;        ///< the BGZF file
+	CBGZF_IndexBuilder *Index;   ///< the index, or NULL if no index
+	string IndexFn;              ///< the file name of the index
+
+	TBGZF_Output() { Writer = NULL; Index = NULL; }
+	~TBGZF_Output() { delete Index; delete Writer; }
+};
+
+/// Export the selected variants to VCF text lines, the data are read from
+/// the GDS file via CApply_Variant_* without creating any R object per
+/// variant, and all states are kept in the object
+class COREARRAY_DLL_LOCAL CVCF_Exporter
 {
+public:
+	/// constructor
+	CVCF_Exporter(CFileInfo &File, SEXP InfoVar, SEXP InfoNum,
+		SEXP FormatVar, Rconnection Conn);
+
+	/// output all selected variants
+	void Run(bool verbose);
+
+protected:
+	CFileInfo &File;        ///< the GDS file with selection
+	Rconnection VCF_File;   ///< R connection object
+	TBGZF_Output *BGZF_Out; ///< the BGZF output if it is a bgzip connection
+	CVarApplyList NodeList; ///< all readers, moving to the next together
+
+	CApply_Variant_Basic *VarID;      ///< annotation/id
+	CApply_Variant_Basic *VarAllele;  ///< allele
+	CApply_Variant_Basic *VarQual;    ///< annotation/qual
+	CApply_Variant_Basic *VarFilter;  ///< annotation/filter
+	CApply_Variant_Geno *VarGeno;     ///< genotype, or NULL if no genotype
+	CApply_Variant_Phase *VarPhase;   ///< phase, or NULL if no phase
+	C_Int32 *PtrPos;      ///< pointer to positions
+	vector<string> FilterLevels;  ///< factor levels of filter
+	bool FilterIsFactor;  ///< whether filter is a factor
+
+	vector<TVCF_InfoVar> InfoList;       ///< INFO variables
+	vector<TVCF_FormatVar> FormatList;   ///< FORMAT variables
+	vector<TVCF_FormatVar*> FormatUse;   ///< FORMAT at the current variant
+
+	size_t NumSample;  ///< the number of selected samples
+	int Ploidy;        ///< ploidy
+	vector<C_UInt8> GenoRaw;  ///< genotypes in bytes
+	vector<int> GenoInt;      ///< genotypes in integers
+	vector<C_UInt8> PhaseBuf; ///< phasing information
+	string StrBuf;     ///< string buffer
+	C_Int64 RecBeg;    ///< 0-based starting position of the current variant
+	C_Int64 RecEnd;    ///< 0-based ending position (exclusive) from REF
+
+	vector<char> LineBuffer;  ///< the buffer of a line
+	char *LineBegin;   ///< the beginning of the line buffer
+	char *LineEnd;     ///< the end of the line buffer
+	char *pLine;       ///< the current pointer in the line buffer
+
+	inline void LineBuf_NeedSize(size_t st);
+	inline void _Line_Append(int val);
+	inline void _Line_Append(double val);
+	inline void _Line_Append_Geno(int val);
+	inline void _Line_Append_Geno(C_UInt8 val);
+	inline void LineBuf_Append(int val);
+	inline void LineBuf_Append(double val);
+	inline void LineBuf_Append(const char *txt, size_t n);
+	inline void LineBuf_Append(const string &txt)
+		{ LineBuf_Append(txt.c_str(), txt.size()); }
+
+	/// the first seven columns: chr, pos, id, allele (REF/ALT), qual, filter
+	void ExportHead();
+	/// the INFO and FORMAT columns
+	void ExportInfoFormat();
+	/// the values of INFO
+	void INFO_Write(TVCF_InfoVar &V, size_t n);
+	/// the values of FORMAT for the i-th sample
+	void FORMAT_Write(TVCF_FormatVar &V, size_t i);
+	/// genotypes and FORMAT of all samples
+	template<typename TGENO>
+		void ExportSample(const TGENO *pSamp, const C_UInt8 *pAllele);
+	/// diploid genotypes without FORMAT, return the offset of the line
+	size_t ExportDiploid();
+	/// write the line to the connection
+	void WriteLine(size_t offset);
+	/// add the line to the index
+	void PushIndex(const char *line, size_t size, C_UInt64 vbeg);
+};
+
+
+CVCF_Exporter::CVCF_Exporter(CFileInfo &File, SEXP InfoVar, SEXP InfoNum,
+	SEXP FormatVar, Rconnection Conn): File(File)
+{
+	VCF_File = Conn;
+	BGZF_Out = NULL;
+	if (Conn->xclass && (strcmp(Conn->xclass, BGZF_CONN_CLASS) == 0))
+		BGZF_Out = (TBGZF_Output*)Conn->xprivate;
+	NumSample = File.SampleSelNum();
+	Ploidy = File.Ploidy();
+	PtrPos = &File.Position()[0];
+
+	// basic variables
+	NodeList.push_back(VarAllele = new CApply_Variant_Basic(File, "allele"));
+	NodeList.push_back(VarID = new CApply_Variant_Basic(File, "annotation/id"));
+	NodeList.push_back(VarQual = new CApply_Variant_Basic(File, "annotation/qual"));
+	NodeList.push_back(VarFilter = new CApply_Variant_Basic(File, "annotation/filter"));
+
+	// the levels of filter
+	FilterIsFactor = false;
+	if (COREARRAY_SV_INTEGER(VarFilter->GetSVType()))
+	{
+		SEXP tmp = PROTECT(NEW_INTEGER(1));
+		int nProtected = 1 + GDS_R_Set_IfFactor(VarFilter->Node, tmp);
+		if (Rf_isFactor(tmp))
+		{
+			FilterIsFactor = true;
+			SEXP lv = getAttrib(tmp, R_LevelsSymbol);
+			for (int i=0; i < Rf_length(lv); i++)
+				FilterLevels.push_back(CHAR(STRING_ELT(lv, i)));
+		}
+		UNPROTECT(nProtected);
+	}
+
+	// genotypes and phasing information
+	VarGeno = NULL; VarPhase = NULL;
+	if (File.GetObj("genotype/data", FALSE))
+	{
+		NodeList.push_back(VarGeno = new CApply_Variant_Geno(File, NA_INTEGER));
+		GenoRaw.resize(NumSample*Ploidy + 1);
+		GenoInt.resize(NumSample*Ploidy + 1);
+		if (File.GetObj("phase/data", FALSE))
+		{
+			NodeList.push_back(VarPhase = new CApply_Variant_Phase(File, true));
+			PhaseBuf.resize(NumSample*(Ploidy > 1 ? Ploidy-1 : 1) + 1);
+		}
+	}
+
+	// INFO variables
+	InfoList.resize(Rf_length(InfoVar));
+	for (size_t i=0; i < InfoList.size(); i++)
+	{
+		TVCF_InfoVar &V = InfoList[i];
+		const char *nm = CHAR(STRING_ELT(InfoVar, i));
+		NodeList.push_back(V.Reader = new CApply_Variant_Info(File, nm));
+		const char *s = strrchr(nm, '/');
+		V.Name = s ? (s + 1) : nm;
+		V.Number = INTEGER(InfoNum)[i];
+		if (V.Number == NA_INTEGER) V.Number = -1;
+		V.Type = GetVarType(V.Reader->Node, V.Reader->GetSVType(), true, nm);
+	}
+
+	// FORMAT variables
+	FormatList.resize(Rf_length(FormatVar));
+	for (size_t i=0; i < FormatList.size(); i++)
+	{
+		TVCF_FormatVar &V = FormatList[i];
+		const char *nm = CHAR(STRING_ELT(FormatVar, i));
+		NodeList.push_back(V.Reader = new CApply_Variant_Format(File, nm));
+		const char *s = strrchr(nm, '/');
+		V.Name = s ? (s + 1) : nm;
+		V.Type = GetVarType(V.Reader->Node, V.Reader->GetSVType(), false, nm);
+		V.NumIndex = 0;
+	}
+	FormatUse.reserve(FormatList.size());
+
+	// line buffer
 	LineBuffer.resize(LINE_BUFFER_SIZE);
 	pLine = LineBegin = &LineBuffer[0];
 	LineEnd = pLine + LINE_BUFFER_SIZE;
 }
 
-inline static void LineBuf_Done()
-{
-	LineBuffer.clear();
-	vector<char>().swap(LineBuffer);
-	LineBegin = pLine = LineEnd = NULL;
-	VCF_INFO_Number.clear();
-	vector<int>().swap(VCF_INFO_Number);
-	VCF_FORMAT_Number.clear();
-	vector<int>().swap(VCF_FORMAT_Number);
-	VCF_FORMAT_List.clear();
-	vector<SEXP>().swap(VCF_FORMAT_List);
-}
-
-inline static void LineBuf_InitPtr()
-{
-	pLine = LineBegin = &LineBuffer[0];
-}
 
-inline static void LineBuf_NeedSize(size_t st)
+inline void CVCF_Exporter::LineBuf_NeedSize(size_t st)
 {
 	if (pLine + st > LineEnd)
 	{
@@ -145,7 +338,7 @@ inline static char *fast_itoa(char *p, int32_t val)
 	return p;
 }
 
-inline static void _Line_Append(int val)
+inline void CVCF_Exporter::_Line_Append(int val)
 {
 	if (val != NA_INTEGER)
 		pLine = fast_itoa(pLine, val);
@@ -153,7 +346,15 @@ inline static void _Line_Append(int val)
 		*pLine++ = '.';
 }
 
-inline static void _Line_Append_Geno(int val)
+inline void CVCF_Exporter::_Line_Append(double val)
+{
+	if (R_FINITE(val))
+		pLine = fast_gtoa(pLine, val);
+	else
+		*pLine++ = '.';
+}
+
+inline void CVCF_Exporter::_Line_Append_Geno(int val)
 {
 	if (val >= 0)
 	{
@@ -165,7 +366,7 @@ inline static void _Line_Append_Geno(int val)
 		*pLine++ = '.';
 }
 
-inline static void _Line_Append_Geno_Raw(C_UInt8 val)
+inline void CVCF_Exporter::_Line_Append_Geno(C_UInt8 val)
 {
 	if (val < 10)
 		*pLine++ = val + '0';
@@ -175,256 +376,280 @@ inline static void _Line_Append_Geno_Raw(C_UInt8 val)
 		pLine = fast_itoa(pLine, val);
 }
 
-inline static void _Line_Append(double val)
-{
-	if (R_FINITE(val))
-		pLine += sprintf(pLine, "%g", val);
-	else
-		*pLine++ = '.';
-}
-
-
-inline static void LineBuf_Append(int val)
+inline void CVCF_Exporter::LineBuf_Append(int val)
 {
 	LineBuf_NeedSize(32);
 	_Line_Append(val);
 }
 
-inline static void LineBuf_Append(double val)
+inline void CVCF_Exporter::LineBuf_Append(double val)
 {
 	LineBuf_NeedSize(32);
 	_Line_Append(val);
 }
 
-inline static void LineBuf_Append(const char *txt)
+inline void CVCF_Exporter::LineBuf_Append(const char *txt, size_t n)
 {
-	const size_t n = strlen(txt);
 	LineBuf_NeedSize(n + 16);
 	memcpy(pLine, txt, n);
 	pLine += n;
 }
 
 
-inline static void put_text(const char *fmt, ...)
-{
-	va_list args;
-	va_start(args, fmt);
-	(*VCF_File->vfprintf)(VCF_File, fmt, args);
-	va_end(args);
-}
+// --------------------------------------------------------------
 
+void CVCF_Exporter::ExportHead()
+{
+	const C_Int32 Position = VarAllele->Position;
 
+	// CHROM
+	LineBuf_Append(File.Chromosome()[Position]);
+	*pLine++ = '\t';
 
-// ========================================================================
+	// POS
+	LineBuf_Append(PtrPos[Position]);
+	*pLine++ = '\t';
 
-/// return the number in the INFO field
-inline static int INFO_GetNum(SEXP X, int n)
-{
-	if (n < 0)
-		n = !Rf_isNull(X) ? Rf_length(X) : 0;
+	// ID
+	VarID->ReadData(&StrBuf, svStrUTF8);
+	if (!StrBuf.empty())
+		LineBuf_Append(StrBuf);
+	else
+		*pLine++ = '.';
+	*pLine++ = '\t';
 
-	if (IS_INTEGER(X))
+	// allele -- REF/ALT
+	VarAllele->ReadData(&StrBuf, svStrUTF8);
+	size_t n = pLine - LineBegin;
+	LineBuf_Append(StrBuf);
+	char *s;
+	for (s = LineBegin+n; s < pLine; s++)
 	{
-		int *p = INTEGER(X) + n;
-		for (; n > 0; n--)
-			if (*(--p) != NA_INTEGER) break;
-	} else if (IS_NUMERIC(X))
+		if (*s == ',')
+			{ *s = '\t'; break; }
+	}
+	RecBeg = (C_Int64)PtrPos[Position] - 1;
+	RecEnd = RecBeg + (s - (LineBegin+n));
+	if (s == pLine)
 	{
-		double *p = REAL(X) + n;
-		for (; n > 0; n--)
-			if (R_finite(*(--p))) break;
-	} else if (IS_CHARACTER(X))
+		*pLine++ = '\t';
+		*pLine++ = '.';
+	}
+	*pLine++ = '\t';
+
+	// QUAL
+	double qual;
+	if (COREARRAY_SV_INTEGER(VarQual->GetSVType()))
 	{
-		for (; n > 0; n--)
+		int v;
+		VarQual->ReadData(&v, svInt32);
+		qual = (v != NA_INTEGER) ? v : R_NaN;
+	} else
+		VarQual->ReadData(&qual, svFloat64);
+	LineBuf_Append(qual);
+	*pLine++ = '\t';
+
+	// FILTER, "NA" for a missing value
+	C_SVType sv = VarFilter->GetSVType();
+	if (COREARRAY_SV_INTEGER(sv))
+	{
+		int v;
+		VarFilter->ReadData(&v, svInt32);
+		if (FilterIsFactor)
 		{
-			SEXP s = STRING_ELT(X, n-1);
-			if ((s != NA_STRING) && (CHAR(s)[0] != 0)) break;
-		}
+			if ((v >= 1) && (v <= (int)FilterLevels.size()))
+				LineBuf_Append(FilterLevels[v-1]);
+			else
+				LineBuf_Append("NA", 2);
+		} else if (v != NA_INTEGER)
+			LineBuf_Append(v);
+		else
+			LineBuf_Append("NA", 2);
+	} else if (COREARRAY_SV_FLOAT(sv))
+	{
+		double v;
+		VarFilter->ReadData(&v, svFloat64);
+		LineBuf_NeedSize(32);
+		// 15 significant digits like as.character() in R, not fast_gtoa()
+		// which gives 6 digits, and a numeric FILTER is rare
+		if (R_FINITE(v))
+			pLine += sprintf(pLine, "%.15g", v);
+		else
+			LineBuf_Append("NA", 2);
+	} else {
+		VarFilter->ReadData(&StrBuf, svStrUTF8);
+		LineBuf_Append(StrBuf);
 	}
-
-	return n;
+	*pLine++ = '\t';
 }
 
 
-/// write info values
-inline static void INFO_Write(SEXP X, size_t n)
+void CVCF_Exporter::INFO_Write(TVCF_InfoVar &V, size_t n)
 {
-	size_t i = 0;
-	if (IS_INTEGER(X))
+	switch (V.Type)
 	{
-		LineBuf_NeedSize(12*n + 32);
-		for (int *p = INTEGER(X); i < n; i++)
+	case vtInteger:
 		{
-			if (i > 0) *pLine++ = ',';
-			_Line_Append(*p++);
+			LineBuf_NeedSize(12*n + 32);
+			const C_Int32 *p = &V.I32[0];
+			for (size_t i=0; i < n; i++)
+			{
+				if (i > 0) *pLine++ = ',';
+				_Line_Append(*p++);
+			}
+			break;
 		}
-	} else if (IS_NUMERIC(X))
-	{
-		LineBuf_NeedSize(12*n + 32);
-		for (double *p = REAL(X); i < n; i++)
+	case vtFloat:
 		{
-			if (i > 0) *pLine++ = ',';
-			_Line_Append(*p++);
+			LineBuf_NeedSize(16*n + 32);
+			const double *p = &V.F64[0];
+			for (size_t i=0; i < n; i++)
+			{
+				if (i > 0) *pLine++ = ',';
+				_Line_Append(*p++);
+			}
+			break;
 		}
-	} else if (IS_CHARACTER(X))
-	{
-		for (; i < n; i++)
+	case vtString:
+		for (size_t i=0; i < n; i++)
 		{
 			if (i > 0) *pLine++ = ',';
-			SEXP s = STRING_ELT(X, i);
-			LineBuf_Append(
-				((s != NA_STRING) && (CHAR(s)[0] != 0)) ? CHAR(s) : ".");
+			const string &s = V.Str[i];
+			if (!s.empty())
+				LineBuf_Append(s);
+			else
+				LineBuf_Append(".", 1);
 		}
-	} else
+		break;
+	default:
 		throw ErrSeqArray("INFO_Write: invalid data type.");
+	}
 }
 
 
-/// write format values
-inline static void FORMAT_Write(SEXP X, size_t n, size_t Start, size_t Step)
+void CVCF_Exporter::FORMAT_Write(TVCF_FormatVar &V, size_t i)
 {
-	if (IS_INTEGER(X) || IS_LOGICAL(X))
+	const size_t Step = NumSample;
+	size_t n = V.NumIndex;
+	switch (V.Type)
 	{
-		int *base = (IS_INTEGER(X) ? INTEGER(X) : LOGICAL(X)) + Start;
-		int *p = base + (n - 1)*Step;
-		for (; n > 0; n--, p-=Step)
-			if (*p != NA_INTEGER) break;
-		LineBuf_NeedSize(12*n + 32);
-		p = base;
-		for (size_t i=0; i < n; i++)
+	case vtInteger: case vtFlag:
 		{
-			if (i > 0) *pLine++ = ',';
-			_Line_Append(*p);
-			p += Step;
+			const C_Int32 *base = &V.I32[i];
+			for (; n > 0; n--)
+				if (base[(n-1)*Step] != NA_INTEGER) break;
+			LineBuf_NeedSize(12*n + 32);
+			for (size_t j=0; j < n; j++)
+			{
+				if (j > 0) *pLine++ = ',';
+				_Line_Append(base[j*Step]);
+			}
+			break;
 		}
-	} else if (IS_NUMERIC(X))
-	{
-		double *base = REAL(X) + Start;
-		double *p = base + (n - 1)*Step;
-		for (; n > 0; n--, p-=Step)
-			if (R_finite(*p)) break;
-		LineBuf_NeedSize(12*n + 32);
-		p = base;
-		for (size_t i=0; i < n; i++)
+	case vtFloat:
 		{
-			if (i > 0) *pLine++ = ',';
-			_Line_Append(*p);
-			p += Step;
-		}
-	} else if (IS_CHARACTER(X) || Rf_isFactor(X))
-	{
-		if (Rf_isFactor(X))
-			X = Rf_asCharacterFactor(X);
-		for (; n > 0; n--)
-		{
-			SEXP s = STRING_ELT(X, Start + (n - 1)*Step);
-			if ((s != NA_STRING) && (CHAR(s)[0] != 0)) break;
+			const double *base = &V.F64[i];
+			for (; n > 0; n--)
+				if (R_FINITE(base[(n-1)*Step])) break;
+			LineBuf_NeedSize(16*n + 32);
+			for (size_t j=0; j < n; j++)
+			{
+				if (j > 0) *pLine++ = ',';
+				_Line_Append(base[j*Step]);
+			}
+			break;
 		}
-		for (size_t i=0; i < n; i++, Start += Step)
+	case vtString:
 		{
-			if (i > 0) *pLine++ = ',';
-			SEXP s = STRING_ELT(X, Start);
-			if ((s != NA_STRING) && (CHAR(s)[0] != 0))
-				LineBuf_Append(CHAR(s));
-			else
-				*pLine++ = '.';
+			const string *base = &V.Str[i];
+			for (; n > 0; n--)
+				if (!base[(n-1)*Step].empty()) break;
+			for (size_t j=0; j < n; j++)
+			{
+				if (j > 0) *pLine++ = ',';
+				const string &s = base[j*Step];
+				if (!s.empty())
+					LineBuf_Append(s);
+				else
+					LineBuf_Append(".", 1);
+			}
+			break;
 		}
-	} else
-		throw ErrSeqArray("FORMAT_Write: invalid data type.");
+	}
 
 	if (n <= 0) *pLine++ = '.';
 }
 
 
-
-
-
-// ========================================================================
-
-/// export the first seven columns: chr, pos, id, allele (REF/ALT), qual, filter
-inline static void ExportHead(SEXP X)
+/// read the values at the current variant, return the number of values
+template<typename TVAR>
+	static size_t ReadVarData(TVAR &V, size_t num)
 {
-	// CHROM
-	LineBuf_Append(CHAR(STRING_ELT(VECTOR_ELT(X, 0), 0)));
-	*pLine++ = '\t';
-
-	// POS
-	LineBuf_Append(Rf_asInteger(VECTOR_ELT(X, 1)));
-	*pLine++ = '\t';
-
-	// ID
-	char *s = (char*)CHAR(STRING_ELT(VECTOR_ELT(X, 2), 0));
-	if (*s != 0)
-		LineBuf_Append(s);
-	else
-		*pLine++ = '.';
-	*pLine++ = '\t';
-
-	// allele -- REF/ALT
-	size_t n = pLine - LineBegin;
-	LineBuf_Append(CHAR(STRING_ELT(VECTOR_ELT(X, 3), 0)));
-
-	for (s = LineBegin+n; s < pLine; s++)
-	{
-		if (*s == ',')
-			{ *s = '\t'; break; }
-	}
-	if (s == pLine)
+	switch (V.Type)
 	{
-		*pLine++ = '\t';
-		*pLine++ = '.';
+	case vtInteger: case vtFlag:
+		if (V.I32.size() < num) V.I32.resize(num);
+		V.Reader->ReadData(&V.I32[0], svInt32);
+		break;
+	case vtFloat:
+		if (V.F64.size() < num) V.F64.resize(num);
+		V.Reader->ReadData(&V.F64[0], svFloat64);
+		break;
+	case vtString:
+		if (V.Str.size() < num) V.Str.resize(num);
+		V.Reader->ReadData(&V.Str[0], svStrUTF8);
+		break;
 	}
-	*pLine++ = '\t';
-
-	// QUAL
-	LineBuf_Append(Rf_asReal(VECTOR_ELT(X, 4)));
-	*pLine++ = '\t';
-
-	// FILTER
-	SEXP tmp = VECTOR_ELT(X, 5);
-	if (Rf_isFactor(tmp))
-		tmp = Rf_asCharacterFactor(tmp);
-	else
-		tmp = AS_CHARACTER(tmp);
-	LineBuf_Append(CHAR(STRING_ELT(tmp, 0)));
-	*pLine++ = '\t';
+	return num;
 }
 
 
-/// export the INFO and FORMAT fields
-inline static void ExportInfoFormat(SEXP X, size_t info_st)
+void CVCF_Exporter::ExportInfoFormat()
 {
-	// variable list
-	SEXP VarNames = getAttrib(X, R_NamesSymbol);
-
 	//====  INFO  ====//
 
 	LineBuf_NeedSize(32);
-	size_t cnt_info = VCF_INFO_Number.size();
 	size_t n = 0;
-	for (size_t i=0; i < cnt_info; i++)
+	vector<TVCF_InfoVar>::iterator V;
+	for (V=InfoList.begin(); V != InfoList.end(); V++)
 	{
-		// name, "info.*"
-		const char *nm = CHAR(STRING_ELT(VarNames, i + info_st)) + 5;
-		// SEXP
-		SEXP D = VECTOR_ELT(X, i + info_st);
+		const int num = V->Reader->GetNumIndex();
+		if (num <= 0) continue;
+		size_t len = ReadVarData(*V, (size_t)num * V->Reader->GetBaseNum());
 
-		if (IS_LOGICAL(D))  // FLAG type
+		if (V->Type == vtFlag)
 		{
-			if (Rf_asLogical(D) == TRUE)
+			if (V->I32[0] == TRUE)
 			{
 				if (n > 0) *pLine++ = ';';
-				LineBuf_Append(nm);
+				LineBuf_Append(V->Name);
 				n ++;
 			}
 		} else {
-			int m = INFO_GetNum(D, VCF_INFO_Number[i]);
+			// the number of values without trailing missing values
+			size_t m = len;
+			if ((V->Number >= 0) && ((size_t)V->Number < m))
+				m = V->Number;
+			switch (V->Type)
+			{
+			case vtInteger:
+				for (; m > 0; m--)
+					if (V->I32[m-1] != NA_INTEGER) break;
+				break;
+			case vtFloat:
+				for (; m > 0; m--)
+					if (R_FINITE(V->F64[m-1])) break;
+				break;
+			default:
+				for (; m > 0; m--)
+					if (!V->Str[m-1].empty()) break;
+			}
 			if (m > 0)
 			{
 				if (n > 0) *pLine++ = ';';
-				LineBuf_Append(nm);
+				LineBuf_Append(V->Name);
 				*pLine++ = '=';
-				INFO_Write(D, m);
+				INFO_Write(*V, m);
 				n ++;
 			}
 		}
@@ -435,232 +660,77 @@ inline static void ExportInfoFormat(SEXP X, size_t info_st)
 
 	//====  FORMAT  ====//
 
-	VCF_FORMAT_List.clear();
-	size_t cnt_fmt = VCF_FORMAT_Number.size();
-
+	FormatUse.clear();
 	LineBuf_NeedSize(32);
-	if (info_st > 6)
+	if (VarGeno)
 	{
 		pLine[0] = 'G'; pLine[1] = 'T';
 		pLine += 2;
-	} else if (cnt_fmt <= 0)
+	} else if (FormatList.empty())
 	{
-		pLine[0] = '.';
-		pLine ++;
+		*pLine++ = '.';
 	}
 
-	for (size_t i=0; i < cnt_fmt; i++)
+	vector<TVCF_FormatVar>::iterator F;
+	for (F=FormatList.begin(); F != FormatList.end(); F++)
 	{
-		// name, "fmt.*"
-		SEXP D = VECTOR_ELT(X, i + cnt_info + info_st);
-		if (!isNull(D))
+		const int num = F->Reader->GetNumIndex();
+		if (num > 0)
 		{
-			if (i > 0 || info_st > 6)
+			F->NumIndex = num;
+			ReadVarData(*F, (size_t)num * NumSample);
+			if (VarGeno || !FormatUse.empty())
 				*pLine++ = ':';
-			const char *nm = CHAR(STRING_ELT(VarNames, i + cnt_info + info_st));
-			LineBuf_Append(nm + 4);
-			VCF_FORMAT_List.push_back(D);
+			LineBuf_Append(F->Name);
+			FormatUse.push_back(&(*F));
 		}
 	}
 	*pLine++ = '\t';
 }
 
-}
-
 
-extern "C"
+template<typename TGENO>
+	void CVCF_Exporter::ExportSample(const TGENO *pSamp, const C_UInt8 *pAllele)
 {
-using namespace SeqArray;
-
-// ========================================================================
-// Convert to VCF4: GDS -> VCF4
-// ========================================================================
-
-/// double quote text if needed
-COREARRAY_DLL_EXPORT SEXP SEQ_Quote(SEXP text, SEXP dQuote)
-{
-	SEXP NewText, ans;
-	PROTECT(NewText = AS_CHARACTER(text));
-	PROTECT(ans = NEW_CHARACTER(Rf_length(NewText)));
-
-	for (int i=0; i < Rf_length(NewText); i++)
+	const size_t nFmt = FormatUse.size();
+	for (size_t i=0; i < NumSample; i++)
 	{
-		string tmp = QuoteText(CHAR(STRING_ELT(NewText, i)));
-		if (LOGICAL(dQuote)[0] == TRUE)
-		{
-			if ((tmp[0] != '\"') || (tmp[tmp.size()-1] != '\"'))
-			{
-				tmp.insert(0, "\"");
-				tmp.push_back('\"');
-			}
-		}
-		SET_STRING_ELT(ans, i, mkChar(tmp.c_str()));
-	}
-
-	UNPROTECT(2);
-	return ans;
-}
-
-
-
-
-// ========================================================================
-
-
-/// initialize
-COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_Init(SEXP Sel, SEXP Info, SEXP Format,
-	SEXP File, SEXP Verbose)
-{
-	VCF_NumAllele = INTEGER(Sel)[0];
-	VCF_NumSample = INTEGER(Sel)[1];
-	VCF_File = R_GetConnection(File);
-
-	int *pInfo = INTEGER(Info);
-	VCF_INFO_Number.assign(pInfo, pInfo + Rf_length(Info));
-
-	int *pFmt = INTEGER(Format);
-	VCF_FORMAT_Number.assign(pFmt, pFmt + Rf_length(Format));
-
-	VCF_FORMAT_List.reserve(256);
-	LineBuf_Init(INTEGER(Sel)[2]);
-
-	return R_NilValue;
-}
-
-/// finalize
-COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_Done()
-{
-	LineBuf_Done();
-	return R_NilValue;
-}
-
-
-
-/// convert to VCF4 in general
-COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF(SEXP X)
-{
-	// initialize line pointer
-	LineBuf_InitPtr();
-	// CHROM, POS, ID, REF, ALT, QUAL, FILTER
-	ExportHead(X);
-	// INFO, FORMAT
-	ExportInfoFormat(X, 8);
-	// phase information
-	SEXP phase = VECTOR_ELT(X, 7);
-	C_UInt8 *pAllele = (C_UInt8*)RAW(phase);
-
-	// genotype
-	SEXP geno = VECTOR_ELT(X, 6);
-
-	if (TYPEOF(geno) == RAWSXP)
-	{
-		C_UInt8 *pSamp = (C_UInt8*)RAW(geno);
-		// for-loop of samples
-		for (size_t i=0; i < VCF_NumSample; i++)
+		// add '\t'
+		if (i > 0) *pLine++ = '\t';
+		// genotypes
+		if (pSamp)
 		{
-			// add '\t'
-			if (i > 0) *pLine++ = '\t';
-			// genotypes
-			LineBuf_NeedSize(VCF_NumAllele << 4); // NumAllele*16
-			if (VCF_NumAllele == 2)
-			{
-				_Line_Append_Geno_Raw(*pSamp++);
-				*pLine++ = (*pAllele++) ? '|' : '/';
-				_Line_Append_Geno_Raw(*pSamp++);
-			} else {
-				for (size_t j=0; j < VCF_NumAllele; j++)
-				{
-					if (j > 0)
-						*pLine++ = (*pAllele++) ? '|' : '/';
-					_Line_Append_Geno_Raw(*pSamp++);
-				}
-			}
-			// annotation
-			vector<SEXP>::iterator p;
-			for (p=VCF_FORMAT_List.begin(); p != VCF_FORMAT_List.end(); p++)
+			LineBuf_NeedSize(Ploidy << 4); // Ploidy*16
+			_Line_Append_Geno(*pSamp++);
+			for (int j=1; j < Ploidy; j++)
 			{
-				*pLine++ = ':';
-				size_t n = Rf_length(*p) / VCF_NumSample;
-				FORMAT_Write(*p, n, i, VCF_NumSample);
+				*pLine++ = (pAllele && *pAllele++) ? '|' : '/';
+				_Line_Append_Geno(*pSamp++);
 			}
 		}
-	} else {
-		int *pSamp = INTEGER(geno);
-		// for-loop of samples
-		for (size_t i=0; i < VCF_NumSample; i++)
+		// annotation
+		for (size_t k=0; k < nFmt; k++)
 		{
-			// add '\t'
-			if (i > 0) *pLine++ = '\t';
-			// genotypes
-			LineBuf_NeedSize(VCF_NumAllele << 4); // NumAllele*16
-			if (VCF_NumAllele == 2)
-			{
-				_Line_Append_Geno(*pSamp++);
-				*pLine++ = (*pAllele++) ? '|' : '/';
-				_Line_Append_Geno(*pSamp++);
-			} else {
-				for (size_t j=0; j < VCF_NumAllele; j++)
-				{
-					if (j > 0)
-						*pLine++ = (*pAllele++) ? '|' : '/';
-					_Line_Append_Geno(*pSamp++);
-				}
-			}
-			// annotation
-			vector<SEXP>::iterator p;
-			for (p=VCF_FORMAT_List.begin(); p != VCF_FORMAT_List.end(); p++)
-			{
-				*pLine++ = ':';
-				size_t n = Rf_length(*p) / VCF_NumSample;
-				FORMAT_Write(*p, n, i, VCF_NumSample);
-			}
+			LineBuf_NeedSize(16);
+			if (pSamp || (k > 0)) *pLine++ = ':';
+			FORMAT_Write(*FormatUse[k], i);
 		}
 	}
-
+	LineBuf_NeedSize(16);
 	*pLine++ = '\n';
-
-	// output
-	if (VCF_File->text)
-	{
-		*pLine = 0;
-		put_text("%s", LineBegin);
-	} else {
-		size_t size = pLine - LineBegin;
-		size_t n = R_WriteConnection(VCF_File, LineBegin, size);
-		if (size != n)
-			throw ErrSeqArray("writing error.");
-	}
-
-	return R_NilValue;
 }
 
 
-
-// --------------------------------------------------------------
-
-/// convert to VCF4, diploid without FORMAT variables
-COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_Di_WrtFmt(SEXP X)
-{
-	// initialize line pointer
-	LineBuf_InitPtr();
-	// CHROM, POS, ID, REF, ALT, QUAL, FILTER
-	ExportHead(X);
-	// INFO, FORMAT
-	ExportInfoFormat(X, 8);
-	// phase information
-	SEXP phase = VECTOR_ELT(X, 7);
-	C_UInt8 *pAllele = (C_UInt8*)RAW(phase);
-
-	// for-loop, genotypes
-	size_t n = VCF_NumSample;
+size_t CVCF_Exporter::ExportDiploid()
+{
+	const C_UInt8 *pAllele = &PhaseBuf[0];
+	size_t n = NumSample;
 	size_t offset = 0;
 
-	// genotype
-	SEXP geno = VECTOR_ELT(X, 6);
-
-	if (TYPEOF(geno) == RAWSXP)
+	if (!VarGeno->NeedIntGeno())
 	{
-		C_UInt8 *pSamp = (C_UInt8*)RAW(geno);
+		VarGeno->ReadGenoData(&GenoRaw[0]);
+		const C_UInt8 *pSamp = &GenoRaw[0];
 
 	#ifdef COREARRAY_SIMD_SSE2
 
@@ -757,14 +827,15 @@ COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_Di_WrtFmt(SEXP X)
 		for (; n > 0; n--)
 		{
 			LineBuf_NeedSize(32);
-			_Line_Append_Geno_Raw(*pSamp++);
+			_Line_Append_Geno(*pSamp++);
 			*pLine++ = (*pAllele++) ? '|' : '/';
-			_Line_Append_Geno_Raw(*pSamp++);
+			_Line_Append_Geno(*pSamp++);
 			*pLine++ = '\t';
 		}
 	} else {
 		// integer vector for genotypes
-		int *pSamp = INTEGER(geno);
+		VarGeno->ReadGenoData(&GenoInt[0]);
+		const int *pSamp = &GenoInt[0];
 		for (; n > 0; n--)
 		{
 			LineBuf_NeedSize(32);
@@ -776,141 +847,276 @@ COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_Di_WrtFmt(SEXP X)
 	}
 
 	pLine--; *pLine++ = '\n';
+	return offset;
+}
 
-	// output
-	if (VCF_File->text)
+
+void CVCF_Exporter::WriteLine(size_t offset)
+{
+	if (BGZF_Out && BGZF_Out->Writer)
+	{
+		// write the BGZF file directly
+		const char *p = LineBegin + offset;
+		size_t size = pLine - p;
+		C_UInt64 vbeg = BGZF_Out->Writer->Tell();
+		BGZF_Out->Writer->Write(p, size);
+		if (BGZF_Out->Index) PushIndex(p, size, vbeg);
+	} else if (VCF_File->text)
 	{
+		LineBuf_NeedSize(1);
 		*pLine = 0;
-		put_text("%s", LineBegin+offset);
+		ConnPutText(VCF_File, "%s", LineBegin + offset);
 	} else {
 		size_t size = pLine - LineBegin - offset;
 		size_t n = R_WriteConnection(VCF_File, LineBegin + offset, size);
 		if (size != n)
 			throw ErrSeqArray("writing error.");
 	}
+}
+
+
+void CVCF_Exporter::PushIndex(const char *line, size_t size, C_UInt64 vbeg)
+{
+	// the INFO column
+	const char *p = line, *e = line + size;
+	for (int n=0; (p < e) && (n < 7); p++)
+		if (*p == '\t') n ++;
+	const char *pe = p;
+	while ((pe < e) && (*pe != '\t') && (*pe != '\n')) pe ++;
+
+	// END in INFO, the same rule as tabix
+	C_Int64 end = RecEnd;
+	string info(p, pe);
+	size_t i = info.find("END=");
+	if (i != 0)
+	{
+		i = info.find(";END=");
+		if (i != string::npos) i ++;
+	}
+	if (i != string::npos)
+	{
+		char *ep;
+		long v = strtol(info.c_str() + i + 4, &ep, 10);
+		if ((ep != info.c_str() + i + 4) && (v > RecBeg)) end = v;
+	}
 
-	return R_NilValue;
+	const C_Int32 Position = VarAllele->Position;
+	BGZF_Out->Index->Push(File.Chromosome()[Position], RecBeg, end, vbeg,
+		BGZF_Out->Writer->Tell());
 }
 
 
+void CVCF_Exporter::Run(bool verbose)
+{
+	// diploid genotypes without FORMAT
+	const bool diploid = VarGeno && VarPhase && (Ploidy == 2) &&
+		FormatList.empty();
+
+	CProgressStdOut progress(File.VariantSelNum(), 1, verbose);
+	do {
+		// initialize line pointer
+		pLine = LineBegin;
+		size_t offset = 0;
+		// CHROM, POS, ID, REF, ALT, QUAL, FILTER
+		ExportHead();
+		// INFO, FORMAT
+		ExportInfoFormat();
+		// phase information
+		if (VarPhase)
+			VarPhase->ReadData(&PhaseBuf[0], svInt8);
+
+		// genotypes and FORMAT of samples
+		if (diploid)
+		{
+			offset = ExportDiploid();
+		} else if (VarGeno)
+		{
+			const C_UInt8 *pAllele = VarPhase ? &PhaseBuf[0] : NULL;
+			if (VarGeno->NeedIntGeno())
+			{
+				VarGeno->ReadGenoData(&GenoInt[0]);
+				ExportSample(&GenoInt[0], pAllele);
+			} else {
+				VarGeno->ReadGenoData(&GenoRaw[0]);
+				ExportSample(&GenoRaw[0], pAllele);
+			}
+		} else
+			ExportSample((const C_UInt8*)NULL, NULL);
+
+		// output
+		WriteLine(offset);
+		progress.Forward();
+
+	} while (NodeList.CallNext());
+}
+
+}
 
-// --------------------------------------------------------------
 
-/// convert to haploid VCF4
-COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_Haploid(SEXP X)
+extern "C"
 {
-	// initialize line pointer
-	LineBuf_InitPtr();
-	// CHROM, POS, ID, REF, ALT, QUAL, FILTER
-	ExportHead(X);
-	// INFO, FORMAT
-	ExportInfoFormat(X, 7);
+using namespace SeqArray;
 
-	// genotype
-	SEXP geno = VECTOR_ELT(X, 6);
+// ========================================================================
+// Convert to VCF4: GDS -> VCF4
+// ========================================================================
 
-	if (TYPEOF(geno) == RAWSXP)
+/// double quote text if needed
+COREARRAY_DLL_EXPORT SEXP SEQ_Quote(SEXP text, SEXP dQuote)
+{
+	SEXP NewText, ans;
+	PROTECT(NewText = AS_CHARACTER(text));
+	PROTECT(ans = NEW_CHARACTER(Rf_length(NewText)));
+
+	for (int i=0; i < Rf_length(NewText); i++)
 	{
-		C_UInt8 *pSamp = (C_UInt8*)RAW(geno);
-		// for-loop of samples
-		for (size_t i=0; i < VCF_NumSample; i++)
+		string tmp = QuoteText(CHAR(STRING_ELT(NewText, i)));
+		if (LOGICAL(dQuote)[0] == TRUE)
 		{
-			// add '\t'
-			if (i > 0) *pLine++ = '\t';
-			// genotypes
-			LineBuf_NeedSize(VCF_NumAllele << 3); // NumAllele*8
-			_Line_Append_Geno_Raw(*pSamp++);
-			// annotation
-			vector<SEXP>::iterator p;
-			for (p=VCF_FORMAT_List.begin(); p != VCF_FORMAT_List.end(); p++)
+			if ((tmp[0] != '\"') || (tmp[tmp.size()-1] != '\"'))
 			{
-				*pLine++ = ':';
-				size_t n = Rf_length(*p) / VCF_NumSample;
-				FORMAT_Write(*p, n, i, VCF_NumSample);
+				tmp.insert(0, "\"");
+				tmp.push_back('\"');
 			}
 		}
-	} else {
-		int *pSamp = INTEGER(geno);
-		// for-loop of samples
-		for (size_t i=0; i < VCF_NumSample; i++)
+		SET_STRING_ELT(ans, i, mkChar(tmp.c_str()));
+	}
+
+	UNPROTECT(2);
+	return ans;
+}
+
+
+
+// ========================================================================
+// BGZF output connection
+// ========================================================================
+
+static void bgzf_conn_close(Rconnection con)
+{
+	TBGZF_Output *p = (TBGZF_Output*)con->xprivate;
+	con->xprivate = NULL;
+	con->isopen = FALSE;
+	if (!p) return;
+
+	// no C++ object alive when calling error() or warning()
+	char msg[256] = { 0 };
+	bool has_error = false;
+	try {
+		p->Writer->Close();
+		if (p->Index)
 		{
-			// add '\t'
-			if (i > 0) *pLine++ = '\t';
-			// genotypes
-			LineBuf_NeedSize(VCF_NumAllele << 3); // NumAllele*8
-			_Line_Append_Geno(*pSamp++);
-			// annotation
-			vector<SEXP>::iterator p;
-			for (p=VCF_FORMAT_List.begin(); p != VCF_FORMAT_List.end(); p++)
-			{
-				*pLine++ = ':';
-				size_t n = Rf_length(*p) / VCF_NumSample;
-				FORMAT_Write(*p, n, i, VCF_NumSample);
+			const string &s = p->Index->ErrMsg();
+			if (s.empty())
+				p->Index->Save(p->IndexFn.c_str(), *p->Writer);
+			else {
+				snprintf(msg, sizeof(msg), "%s", s.c_str());
+				remove(p->IndexFn.c_str());  // not a stale index
 			}
 		}
 	}
+	catch (std::exception &E) {
+		GDS_SetError(E.what());
+		has_error = true;
+	}
+	delete p;
+	if (has_error) error("%s", GDS_GetError());
+	if (msg[0])
+	{
+		warning("No index is created for '%s', since %s.",
+			con->description, msg);
+	}
+}
 
-	*pLine++ = '\n';
+static void bgzf_conn_destroy(Rconnection con)
+{
+	// not closed, the file is incomplete
+	TBGZF_Output *p = (TBGZF_Output*)con->xprivate;
+	con->xprivate = NULL;
+	delete p;
+}
 
-	// output
-	if (VCF_File->text)
-	{
-		*pLine = 0;
-		put_text("%s", LineBegin);
-	} else {
-		size_t size = pLine - LineBegin;
-		size_t n = R_WriteConnection(VCF_File, LineBegin, size);
-		if (size != n)
-			throw ErrSeqArray("writing error.");
+static size_t bgzf_conn_write(const void *ptr, size_t size, size_t nitems,
+	Rconnection con)
+{
+	TBGZF_Output *p = (TBGZF_Output*)con->xprivate;
+	if (!p) error("The connection has been closed.");
+	bool has_error = false;
+	try {
+		p->Writer->Write(ptr, size*nitems);
+	}
+	catch (std::exception &E) {
+		GDS_SetError(E.what());
+		has_error = true;
 	}
+	if (has_error) error("%s", GDS_GetError());
+	return nitems;
+}
 
-	return R_NilValue;
+/// create a BGZF output connection, the blocks are deflated in 'nthread'
+/// threads, and a tabix or CSI index is built if 'index' is "tbi" or "csi"
+COREARRAY_DLL_EXPORT SEXP SEQ_bgzip_create(SEXP filename, SEXP index,
+	SEXP nthread)
+{
+	const char *fn = CHAR(STRING_ELT(filename, 0));
+	const char *idx = CHAR(STRING_ELT(index, 0));
+	int nt = Rf_asInteger(nthread);
+	if ((nt == NA_INTEGER) || (nt < 1)) nt = 1;
+
+	COREARRAY_TRY
+
+		const string full_fn = R_ExpandFileName(fn);
+		TBGZF_Output *out = new TBGZF_Output;
+		try {
+			out->Writer = new CBGZF_Writer(full_fn.c_str(), nt);
+			if ((strcmp(idx, "tbi") == 0) || (strcmp(idx, "csi") == 0))
+			{
+				out->Index = new CBGZF_IndexBuilder(idx[0] == 'c');
+				out->IndexFn = full_fn + "." + idx;
+			}
+		}
+		catch (...) {
+			delete out;
+			throw;
+		}
+
+		Rconnection con;
+		rv_ans = R_new_custom_connection(fn, "wb", BGZF_CONN_CLASS, &con);
+		con->xprivate = out;
+		con->isopen = TRUE;
+		con->canwrite = TRUE;
+		con->canread = FALSE;
+		con->text = FALSE;
+		con->close = &bgzf_conn_close;
+		con->destroy = &bgzf_conn_destroy;
+		con->write = &bgzf_conn_write;
+
+	COREARRAY_CATCH
 }
 
 
 
-// --------------------------------------------------------------
+// ========================================================================
 
-/// convert to VCF4 without genotypes
-COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF_NoGeno(SEXP X)
+/// output the data lines of the selected variants to a VCF file
+COREARRAY_DLL_EXPORT SEXP SEQ_ToVCF(SEXP gdsfile, SEXP info_var, SEXP info_num,
+	SEXP fmt_var, SEXP File, SEXP Verbose)
 {
-	// initialize line pointer
-	LineBuf_InitPtr();
-	// CHROM, POS, ID, REF, ALT, QUAL, FILTER
-	ExportHead(X);
-	// INFO, FORMAT
-	ExportInfoFormat(X, 6);
+	int verbose = Rf_asLogical(Verbose);
+	if (verbose == NA_LOGICAL)
+		error("'verbose' must be TRUE or FALSE.");
 
-	// for-loop of samples
-	for (size_t i=0; i < VCF_NumSample; i++)
-	{
-		// add '\t'
-		if (i > 0) *pLine++ = '\t';
-		// annotation
-		vector<SEXP>::iterator p;
-		vector<SEXP>::iterator st = VCF_FORMAT_List.begin();
-		for (p=st; p != VCF_FORMAT_List.end(); p++)
+	COREARRAY_TRY
+
+		CFileInfo &file = GetFileInfo(gdsfile);
+		if (file.VariantSelNum() > 0)
 		{
-			if (p != st) *pLine++ = ':';
-			size_t n = Rf_length(*p) / VCF_NumSample;
-			FORMAT_Write(*p, n, i, VCF_NumSample);
+			CVCF_Exporter Exporter(file, info_var, info_num, fmt_var,
+				R_GetConnection(File));
+			Exporter.Run(verbose == TRUE);
 		}
-	}
-	*pLine++ = '\n';
-
-	// output
-	if (VCF_File->text)
-	{
-		*pLine = 0;
-		put_text("%s", LineBegin);
-	} else {
-		size_t size = pLine - LineBegin;
-		size_t n = R_WriteConnection(VCF_File, LineBegin, size);
-		if (size != n)
-			throw ErrSeqArray("writing error.");
-	}
 
-	return R_NilValue;
+	COREARRAY_CATCH
 }
 
 } // extern "C"
@@ -103,6 +103,17 @@ COREARRAY_DLL_EXPORT SEXP SEQ_ConvBED2GDS(SEXP GenoNode, SEXP Num, SEXP File,
 }
 
 
+/// the lookup table from a RAW dosage to a 2-bit code in the PLINK BED format
+static struct TBEDCodeTable
+{
+	C_UInt8 Code[256];
+	TBEDCodeTable()
+	{
+		static const C_UInt8 cvt[3] = { 0, 2, 3 };
+		for (int i=0; i < 256; i++) Code[i] = (i < 3) ? cvt[i] : 1;
+	}
+} BED_Code;
+
 COREARRAY_DLL_EXPORT SEXP FC_GDS2BED(SEXP ds)
 {
 	size_t n  = XLENGTH(ds);
@@ -110,25 +121,18 @@ COREARRAY_DLL_EXPORT SEXP FC_GDS2BED(SEXP ds)
 	SEXP rv_ans = PROTECT(NEW_RAW(n4 + (n4r>0 ? 1 : 0)));
 	C_UInt8 *p = (C_UInt8*)RAW(rv_ans);
 	C_UInt8 *s = (C_UInt8*)RAW(ds);
+	const C_UInt8 *cvt = BED_Code.Code;
 	// convert
-	static const C_UInt8 cvt[4] = { 0, 2, 3, 1 };
-	for (; n4 > 0; n4--)
+	for (; n4 > 0; n4--, s+=4)
 	{
-		C_UInt8 b = 0;
-		b |= ((*s < 3) ? cvt[*s] : 1);      s++;
-		b |= ((*s < 3) ? cvt[*s] : 1) << 2; s++;
-		b |= ((*s < 3) ? cvt[*s] : 1) << 4; s++;
-		b |= ((*s < 3) ? cvt[*s] : 1) << 6; s++;
-		*p++ = b;
+		*p++ = cvt[s[0]] | (cvt[s[1]] << 2) | (cvt[s[2]] << 4) |
+			(cvt[s[3]] << 6);
 	}
 	if (n4r > 0)
 	{
 		C_UInt8 b = 0;
 		for (size_t i=0; i < n4r; i++)
-		{
-			b |= ((*s < 3) ? cvt[*s] : 1) << (2*i);
-			s++;
-		}
+			b |= cvt[*s++] << (2*i);
 		*p++ = b;
 	}
 	// output
@@ -20,15 +20,19 @@
 // If not, see <http://www.gnu.org/licenses/>.
 
 #include "Index.h"
+#include "BGZF.h"
+#include "FloatConv.h"
 #include "vectorization.h"
 #include <vector>
 #include <set>
+#include <map>
 #include <algorithm>
+#include <pthread.h>
 
 
-// 1: load format field except GT
-// 2: save format field to GDS file except GT (~70%)
-// 3: load and save info field (< 3%)
+// 1: save genotypes and phases to GDS file
+// 2: save format field to GDS file except GT
+// 3: save info field to GDS file
 #define GDS_TIMING	0
 
 #if (GDS_TIMING > 0)
@@ -69,70 +73,110 @@ static inline void end_timing()
 #endif
 
 static Rconnection VCF_File = NULL;  ///< R connection object
+static CBGZF_Reader *VCF_Reader = NULL;  ///< native file reader if not NULL
+static bool VCF_EOF_Signalled = false;  ///< true if reaching the end of file
 
 static vector<char> VCF_Buffer;  ///< reading buffer
 static char *VCF_Buffer_Ptr;     ///< the current pointer to reading buffer
 static char *VCF_Buffer_EndPtr;  ///< the end pointer to reading buffer
-static const size_t VCF_BUFFER_SIZE = 65536;  ///< reading buffer size
+static size_t VCF_Buffer_Size;   ///< reading buffer size
+static const size_t VCF_BUFFER_SIZE = 65536;  ///< reading buffer size of R connection
+static const size_t VCF_BUFFER_SIZE_FILE = 4*1024*1024;  ///< reading buffer size of native file reader
 static const size_t VCF_BUFFER_SIZE_PLUS = 32;  ///< additional buffer is needed since *VCF_Buffer_EndPtr might be revised
 
-/// initialize
-inline static void Init_VCF_Buffer(SEXP File)
-{
-	VCF_File = R_GetConnection(File);
-	VCF_File->EOF_signalled = FALSE;
-	VCF_Buffer.resize(VCF_BUFFER_SIZE + VCF_BUFFER_SIZE_PLUS);
-	VCF_Buffer_EndPtr = VCF_Buffer_Ptr = &VCF_Buffer[0];
-}
-
 /// finalize
 inline static void Done_VCF_Buffer()
 {
 	VCF_File = NULL;
+	if (VCF_Reader)
+	{
+		VCF_Reader->Close();  // join the threads first
+		delete VCF_Reader; VCF_Reader = NULL;
+	}
 	VCF_Buffer.clear();
 	vector<char>().swap(VCF_Buffer);
 	VCF_Buffer_Ptr = VCF_Buffer_EndPtr = NULL;
 }
 
+/// initialize with an R connection, or a file name read by the native
+/// reader (BGZF blocks are inflated in 'num_thread' threads)
+inline static void Init_VCF_Buffer(SEXP File, int num_thread=1)
+{
+	Done_VCF_Buffer();
+	if (Rf_isString(File))
+	{
+		VCF_Reader = new CBGZF_Reader(CHAR(STRING_ELT(File, 0)), num_thread);
+		VCF_Buffer_Size = VCF_BUFFER_SIZE_FILE;
+	} else {
+		VCF_File = R_GetConnection(File);
+		VCF_Buffer_Size = VCF_BUFFER_SIZE;
+	}
+	VCF_EOF_Signalled = false;
+	VCF_Buffer.resize(VCF_Buffer_Size + VCF_BUFFER_SIZE_PLUS);
+	VCF_Buffer_EndPtr = VCF_Buffer_Ptr = &VCF_Buffer[0];
+}
+
 
 /// read file buffer
 inline static void Read_VCF_Buffer()
 {
 	VCF_Buffer_Ptr = &VCF_Buffer[0];
 	size_t n = 0;
-	size_t unread_len = VCF_File->buff_stored_len - VCF_File->buff_pos;
-	if (unread_len > 0)
-	{
-		if (unread_len > VCF_BUFFER_SIZE) unread_len = VCF_BUFFER_SIZE;
-		memcpy(VCF_Buffer_Ptr, VCF_File->buff + VCF_File->buff_pos, unread_len);
-		VCF_Buffer_Ptr += unread_len;
-		VCF_File->buff_pos += unread_len;
-		n += unread_len;
-	}
-	if (n < VCF_BUFFER_SIZE)
+	if (VCF_Reader)
 	{
-		size_t m = R_ReadConnection(VCF_File, VCF_Buffer_Ptr, VCF_BUFFER_SIZE-n);
-		n += m;
+		n = VCF_Reader->Read(VCF_Buffer_Ptr, VCF_Buffer_Size);
+	} else {
+		size_t unread_len = VCF_File->buff_stored_len - VCF_File->buff_pos;
+		if (unread_len > 0)
+		{
+			if (unread_len > VCF_Buffer_Size) unread_len = VCF_Buffer_Size;
+			memcpy(VCF_Buffer_Ptr, VCF_File->buff + VCF_File->buff_pos, unread_len);
+			VCF_Buffer_Ptr += unread_len;
+			VCF_File->buff_pos += unread_len;
+			n += unread_len;
+		}
+		if (n < VCF_Buffer_Size)
+		{
+			size_t m = R_ReadConnection(VCF_File, VCF_Buffer_Ptr, VCF_Buffer_Size-n);
+			n += m;
+		}
 	}
 	VCF_Buffer_Ptr = &VCF_Buffer[0];
 	VCF_Buffer_EndPtr = VCF_Buffer_Ptr + n;
 	if (n <= 0)
 	{
-		if (VCF_File->EOF_signalled)
+		if (VCF_EOF_Signalled)
 			throw ErrSeqArray("read text error.");
-		VCF_File->EOF_signalled = TRUE;
+		VCF_EOF_Signalled = true;
 	}
 }
 
 /// test EOF
 inline static bool VCF_EOF()
 {
-	if (VCF_File->EOF_signalled) return true;
+	if (VCF_EOF_Signalled) return true;
 	if (VCF_Buffer_Ptr >= VCF_Buffer_EndPtr)
 		Read_VCF_Buffer();
 	return (VCF_Buffer_Ptr >= VCF_Buffer_EndPtr);
 }
 
+/// read 'n' bytes, and return the number of bytes read which is less than
+/// 'n' only at the end of file
+inline static size_t Read_VCF_Bytes(void *buf, size_t n)
+{
+	char *p = (char*)buf;
+	size_t cnt = 0;
+	while ((cnt < n) && !VCF_EOF())
+	{
+		size_t m = VCF_Buffer_EndPtr - VCF_Buffer_Ptr;
+		if (m > n - cnt) m = n - cnt;
+		memcpy(p + cnt, VCF_Buffer_Ptr, m);
+		VCF_Buffer_Ptr += m;
+		cnt += m;
+	}
+	return cnt;
+}
+
 
 
 // ===========================================================
@@ -174,7 +218,7 @@ inline static void DoneText()
 /// get a string with a seperator '\t', which is saved in _Text_Buffer
 inline static void GetText(int last_column)
 {
-	if (VCF_File->EOF_signalled)
+	if (VCF_EOF_Signalled)
 		throw ErrSeqArray("it is the end of file.");
 
 	VCF_ColumnNum = VCF_NextColumnNum;
@@ -220,7 +264,7 @@ inline static void GetText(int last_column)
 		VCF_Buffer_Ptr += n;
 		Text_pEnd += n;
 
-		if (p < VCF_Buffer_EndPtr || VCF_File->EOF_signalled)
+		if (p < VCF_Buffer_EndPtr || VCF_EOF_Signalled)
 			break;
 		else
 			Read_VCF_Buffer();
@@ -245,7 +289,7 @@ inline static void GetText(int last_column)
 				VCF_Buffer_Ptr ++;
 				if (VCF_Buffer_Ptr >= VCF_Buffer_EndPtr)
 				{
-					if (VCF_File->EOF_signalled)
+					if (VCF_EOF_Signalled)
 						break;
 					if (flag)
 					{   // copy to Text_Buffer
@@ -289,7 +333,7 @@ inline static void SkipLine()
 		{
 			ch = *VCF_Buffer_Ptr;
 			break;
-		} else if (!VCF_File->EOF_signalled)
+		} else if (!VCF_EOF_Signalled)
 			Read_VCF_Buffer();
 		else
 			break;
@@ -302,7 +346,7 @@ inline static void SkipLine()
 			VCF_Buffer_Ptr ++;
 			if (VCF_Buffer_Ptr >= VCF_Buffer_EndPtr)
 			{
-				if (VCF_File->EOF_signalled)
+				if (VCF_EOF_Signalled)
 					break;
 				Read_VCF_Buffer();
 			}
@@ -315,24 +359,6 @@ inline static void SkipLine()
 	save_pBegin = save_pEnd = Text_pBegin;
 }
 
-/// skip white space
-inline static void SkipWhiteSpace()
-{
-	// skip whitespace
-	while ((Text_pBegin < Text_pEnd) && (*Text_pBegin == ' '))
-		Text_pBegin ++;
-	while ((Text_pBegin < Text_pEnd) && (*(Text_pEnd-1) == ' '))
-		Text_pEnd --;
-}
-
-/// skip a dot
-inline static void SkipTextWithDot()
-{
-	SkipWhiteSpace();
-	if ((Text_pEnd-Text_pBegin == 1) && (*Text_pBegin == '.'))
-		Text_pBegin ++;
-}
-
 
 
 // ===========================================================
@@ -516,6 +542,25 @@ inline static C_Int16 getGeno(const char *p, const char *end, int num_allele)
 	return val;
 }
 
+/// get a diploid genotype '[0-9.][|/][0-9.]' ending with ':' or 'end', and
+/// return false if it is not the case
+inline static bool getGenoDiploid(const char *p, const char *end,
+	int num_allele, C_Int16 *geno, C_Int8 *phase)
+{
+	if ((end - p < 3) || ((p + 3 < end) && (p[3] != ':')))
+		return false;
+	if ((p[1] != '|') && (p[1] != '/'))
+		return false;
+	int a = p[0], b = p[2];
+	if (a == '.') a = -1;
+	else if ((a < '0') || (a > '9') || ((a -= '0') >= num_allele)) return false;
+	if (b == '.') b = -1;
+	else if ((b < '0') || (b > '9') || ((b -= '0') >= num_allele)) return false;
+	geno[0] = a; geno[1] = b;
+	*phase = (p[1] == '|') ? 1 : 0;
+	return true;
+}
+
 
 /// get a real number from a string
 inline static double getFloat(char *p, char *end)
@@ -528,7 +573,7 @@ inline static double getFloat(char *p, char *end)
 	{
 		char *endptr = (char*)p;
 		*end = 0;  // no worry, see VCF_BUFFER_SIZE_PLUS
-		double val = strtod(p, &endptr);
+		double val = fast_strtod(p, &endptr);
 
 		if (endptr == p)
 		{
@@ -577,7 +622,7 @@ inline static void getFloatArray(char *p, char *end, vector<double> &F64s)
 		if (!is_dot)
 		{
 			char *endptr = (char*)p;
-			val = strtod(p, &endptr);
+			val = fast_strtod(p, &endptr);
 
 			if (endptr == p)
 			{
@@ -640,6 +685,42 @@ static const int FIELD_TYPE_STRING = 4;
 static const char *ERR_NUMBER = "please consider revising it to 'Number=.'";
 
 
+/// the columnar values of an INFO or FORMAT variable in a chunk of lines,
+/// only one of I32, F64 and S8 is used according to the type
+struct COREARRAY_DLL_LOCAL TVCF_Column
+{
+	vector<C_Int32> I32;    //< integers or flags
+	vector<C_Float64> F64;  //< real numbers
+	vector<string> S8;      //< strings
+	vector<C_Int32> Len;    //< the values of the length variable ('@')
+
+	void Clear()
+	{
+		I32.clear(); F64.clear(); S8.clear(); Len.clear();
+	}
+
+	/// append all values to the GDS nodes
+	void Append(PdAbstractArray data_obj, PdAbstractArray len_obj)
+	{
+		if (!I32.empty())
+			GDS_Array_AppendData(data_obj, I32.size(), &I32[0], svInt32);
+		if (!F64.empty())
+			GDS_Array_AppendData(data_obj, F64.size(), &F64[0], svFloat64);
+		if (!S8.empty())
+			GDS_Array_AppendData(data_obj, S8.size(), &S8[0], svStrUTF8);
+		if (len_obj && !Len.empty())
+			GDS_Array_AppendData(len_obj, Len.size(), &Len[0], svInt32);
+	}
+};
+
+/// append the elements of 'src' to 'dst'
+template<typename TYPE>
+	inline static void AppendVec(vector<TYPE> &dst, const vector<TYPE> &src)
+{
+	dst.insert(dst.end(), src.begin(), src.end());
+}
+
+
 /// the structure of INFO field
 struct COREARRAY_DLL_LOCAL TVCF_Info
 {
@@ -661,7 +742,9 @@ struct COREARRAY_DLL_LOCAL TVCF_Info
 		used = false;
 	}
 
-	template<typename TYPE> inline void Index(vector<TYPE> &array,
+	/// check the number of values, and return the value of the length
+	/// variable ('@') or -1 if the length is fixed
+	template<typename TYPE> inline C_Int32 Index(vector<TYPE> &array,
 		int num_allele, TYPE missing)
 	{
 		C_Int32 I32 = array.size();
@@ -669,8 +752,7 @@ struct COREARRAY_DLL_LOCAL TVCF_Info
 		switch (number)
 		{
 		case -1:  // variable-length, .
-			GDS_Array_AppendData(len_obj, 1, &I32, svInt32);
-			break;
+			return I32;
 
 		case -2:  // # of alternate alleles, A
 			N = num_allele - 1;
@@ -681,8 +763,7 @@ struct COREARRAY_DLL_LOCAL TVCF_Info
 					name.c_str(), N, I32, ERR_NUMBER);
 			} else if (I32 < N)
 				array.resize(N, missing);
-			GDS_Array_AppendData(len_obj, 1, &N, svInt32);
-			break;
+			return N;
 
 		case -3:  // # of all possible genotypes, G
 			N = (num_allele + 1) * num_allele / 2;
@@ -693,8 +774,7 @@ struct COREARRAY_DLL_LOCAL TVCF_Info
 					name.c_str(), N, I32, ERR_NUMBER);
 			} else if (I32 < N)
 				array.resize(N, missing);
-			GDS_Array_AppendData(len_obj, 1, &N, svInt32);
-			break;
+			return N;
 
 		case -4:  // # of alleles, R
 			N = num_allele;
@@ -705,8 +785,7 @@ struct COREARRAY_DLL_LOCAL TVCF_Info
 					name.c_str(), N, I32, ERR_NUMBER);
 			} else if (I32 < N)
 				array.resize(N, missing);
-			GDS_Array_AppendData(len_obj, 1, &N, svInt32);
-			break;
+			return N;
 
 		default:
 			if (number >= 0)
@@ -722,20 +801,17 @@ struct COREARRAY_DLL_LOCAL TVCF_Info
 			} else
 				throw ErrSeqArray("Invalid value 'number' in TVCF_Info.");
 		}
+		return -1;
 	}
 
-	template<typename TYPE> void Fill(vector<TYPE> &array, TYPE val)
+	/// fill missing values into a chunk column if it is not in the line
+	template<typename TYPE> void Fill(vector<TYPE> &col, vector<C_Int32> &len,
+		TYPE val)
 	{
 		if (number < 0)
-		{
-			C_Int32 I32 = 0;
-			GDS_Array_AppendData(len_obj, 1, &I32, svInt32);
-		} else {
-			array.clear();
-			array.resize(number, val);
-			GDS_Array_AppendData(data_obj, number, &(array[0]),
-				TdTraits<TYPE>::SVType);
-		}
+			len.push_back(0);
+		else
+			col.resize(col.size() + number, val);
 	}
 };
 
@@ -902,7 +978,7 @@ public:
 			if (!is_dot)
 			{
 				char *endptr = (char*)p;
-				val = strtod(p, &endptr);
+				val = fast_strtod(p, &endptr);
 				if (endptr == p)
 				{
 					if (VCF_RaiseError)
@@ -947,6 +1023,30 @@ public:
 		}
 	}
 
+	/// set multiple integers decoded from a typed vector
+	void SetInt32s(const vector<C_Int32> &I32s, size_t samp_idx)
+	{
+		CellNum = 0;
+		for (size_t i=0; i < I32s.size(); i++)
+			Push_I32(I32s[i], samp_idx);
+	}
+
+	/// set multiple real numbers decoded from a typed vector
+	void SetFloats(const vector<C_Float64> &F64s, size_t samp_idx)
+	{
+		CellNum = 0;
+		for (size_t i=0; i < F64s.size(); i++)
+			Push_F64(F64s[i], samp_idx);
+	}
+
+	/// set multiple strings decoded from a typed vector
+	void SetStrings(const vector<string> &S8s, size_t samp_idx)
+	{
+		CellNum = 0;
+		for (size_t i=0; i < S8s.size(); i++)
+			Push_S8(S8s[i], samp_idx);
+	}
+
 	/// checking
 	inline void Check(size_t num_allele)
 	{
@@ -998,151 +1098,2358 @@ public:
 		}
 	}
 
-	/// Save
-	inline void SaveToGDS()
+	/// append the values of the current line to a chunk column
+	inline void SaveTo(TVCF_Column &col)
 	{
 		if (used)
 		{
-			size_t n = MaxCellNum * SampleNum;
 			switch (type)
 			{
 			case FIELD_TYPE_INT:
-				GDS_Array_AppendData(data_obj, n, &I32ss[0], svInt32);
-				break;
+				AppendVec(col.I32, I32ss); break;
 			case FIELD_TYPE_FLOAT:
-				GDS_Array_AppendData(data_obj, n, &F64ss[0], svFloat64);
-				break;
+				AppendVec(col.F64, F64ss); break;
 			case FIELD_TYPE_STRING:
-				GDS_Array_AppendData(data_obj, n, &S8ss[0], svStrUTF8);
-				break;
+				AppendVec(col.S8, S8ss); break;
 			default:
 				throw ErrSeqArray("Invalid FORMAT Type.");
 			}
+			col.Len.push_back(MaxCellNum);
+		} else
+			col.Len.push_back(0);
+	}
+};
 
-			C_Int32 I32 = MaxCellNum;
-			GDS_Array_AppendData(len_obj, 1, &I32, svInt32);
 
-		} else {
-			C_Int32 I32 = 0;
-			GDS_Array_AppendData(len_obj, 1, &I32, svInt32);
+/// the sorted IDs of INFO or FORMAT fields for the binary search by name
+class COREARRAY_DLL_LOCAL CVCF_IdIndex
+{
+public:
+	/// build the index from the list of TVCF_Info or TVCF_Format
+	template<typename TYPE> void Init(const vector<TYPE> &list)
+	{
+		Ids.clear();
+		Ids.reserve(list.size());
+		for (size_t i=0; i < list.size(); i++)
+			Ids.push_back(TId(list[i].name, (int)i));
+		// the first one if the ID is duplicated
+		sort(Ids.begin(), Ids.end());
+	}
+
+	/// return the index in the list, or -1 if not found
+	int Find(const char *p, const char *end) const
+	{
+		const size_t n = end - p;
+		size_t lo = 0, hi = Ids.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (Ids[mid].first.compare(0, string::npos, p, n) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
 		}
+		if ((lo < Ids.size()) && (Ids[lo].first.size() == n) &&
+				(memcmp(Ids[lo].first.data(), p, n) == 0))
+			return Ids[lo].second;
+		return -1;
 	}
+	inline int Find(const string &s) const
+		{ return Find(s.data(), s.data() + s.size()); }
+
+private:
+	typedef pair<string, int> TId;
+	vector<TId> Ids;  //< sorted by ID
 };
 
+
+// ===========================================================
+// Multithreaded parsing of line-aligned chunks
+// ===========================================================
+
+/// the number of bytes in a chunk of lines (at least one line)
+static const size_t VCF_CHUNK_SIZE = 4*1024*1024;
+/// the default number of variants in a chunk, which are buffered and
+/// appended to each GDS node at once
+static const int VCF_BATCH_SIZE = 4096;
+
+/// return true, if matching
+inline static bool StrCaseCmp(const char *prefix, const char *txt, size_t nmax)
+{
+	while (*prefix && *txt && nmax>0)
+	{
+		if (toupper(*prefix) != toupper(*txt))
+			return false;
+		prefix ++; txt ++; nmax --;
+	}
+	return (*prefix == 0);
 }
 
 
-extern "C"
+/// a chunk of VCF lines and the parsed values in columns
+struct COREARRAY_DLL_LOCAL TVCF_Chunk
 {
-using namespace SeqArray;
+	// input
+	vector<char> Text;     //< the lines, each of them ends with '\n'
+	size_t TextLen;        //< the number of bytes in Text
+	int NumLine;           //< the number of lines
+	C_Int64 LineStart;     //< the line number of the first line
+	C_Int64 VariantStart;  //< the variant index before the first line
 
-// ===========================================================
-// Get the number of lines in a VCF file
-// ===========================================================
+	// output
+	vector<C_Int32> VarIdx, Pos;
+	vector<string> Chr, RSID, Allele, Filter;
+	vector<C_Float64> Qual;
+	vector<TVCF_Column> Info, Format;
+	vector<C_Int32> GenoLen;
+	vector<C_Int16> Geno;   //< genotypes, 2-bit layers of each variant
+	vector<C_Int8> Phase;
+	vector<C_Int32> GenoExtraIdx, GenoExtra, PhaseExtraIdx;
+	vector<C_Int8> PhaseExtra;
+	/// 0: a message, 1: unknown INFO ID, 2: unknown FORMAT ID
+	vector< pair<int, string> > Warning;
+	bool HasError;   //< true if fails, the message is saved in ErrMsg
+	string ErrMsg;   //< the error message with the line and column numbers
+	bool Parsed;     //< true if it has been parsed
+
+	TVCF_Chunk()
+	{
+		TextLen = 0; NumLine = 0;
+		LineStart = VariantStart = 0;
+		HasError = false; Parsed = true;
+	}
 
-COREARRAY_DLL_EXPORT SEXP SEQ_VCF_NumLines(SEXP File, SEXP SkipHead)
+	void ClearResult(size_t n_info, size_t n_fmt)
+	{
+		VarIdx.clear(); Pos.clear();
+		Chr.clear(); RSID.clear(); Allele.clear(); Filter.clear();
+		Qual.clear();
+		Info.resize(n_info);
+		for (size_t i=0; i < n_info; i++) Info[i].Clear();
+		Format.resize(n_fmt);
+		for (size_t i=0; i < n_fmt; i++) Format[i].Clear();
+		GenoLen.clear(); Geno.clear(); Phase.clear();
+		GenoExtraIdx.clear(); GenoExtra.clear();
+		PhaseExtraIdx.clear(); PhaseExtra.clear();
+		Warning.clear();
+		HasError = false; ErrMsg.clear();
+	}
+};
+
+
+
+/// the genomic regions imported using a tabix or CSI index, and the records
+/// are filtered in the main thread
+class COREARRAY_DLL_LOCAL CVCF_RegionFilter
 {
-	Init_VCF_Buffer(File);
+public:
+	/// the results of checking a record
+	enum TCheck { rcKeep=0, rcSkip=1, rcDone=2 };
+
+	/// 'region' is list(chr, start, end, by.start, index), and 'contig' is
+	/// used if no sequence name in the index (e.g., BCF2), and the warnings
+	/// are appended to 'warnings' (raised by the caller)
+	CVCF_RegionFilter(SEXP region, const vector<string> &contig,
+		vector<string> &warnings);
+
+	/// seek to the next region which has records, return false if no
+	/// region is left (and the end of file is signalled)
+	bool Next();
+	/// check a VCF line [p, end) without the line ending
+	TCheck CheckLine(const char *p, const char *end) const;
+	/// check a BCF2 record
+	TCheck CheckRecord(const C_UInt8 *p, size_t size) const;
 
-	if (Rf_asLogical(SkipHead) == TRUE)
+private:
+	struct TRegion
 	{
-		InitText();
-		// get the starting line
-		while (!VCF_EOF())
+		string Chr;  //< the sequence name
+		int Ref;     //< the sequence index in the index file
+		C_UInt64 RefOffset;  //< the first offset of the sequence in the file
+		C_Int64 Start, End;  //< 1-based, inclusive
+		bool operator< (const TRegion &R) const
 		{
-			GetText(NA_INTEGER);
-			if (strncmp(Text_pBegin, "#CHROM", 6) == 0)
-			{
-				SkipLine();
-				break;
-			}
+			if (RefOffset != R.RefOffset) return RefOffset < R.RefOffset;
+			if (Ref != R.Ref) return Ref < R.Ref;
+			return Start < R.Start;
 		}
-		DoneText();
+	};
+	CBGZF_Index fIndex;
+	vector<TRegion> fList;  //< sorted and merged regions
+	int fIdx;          //< the current region
+	C_Int64 fPrevEnd;  //< the end of the previous region on the same sequence
+	bool fByStart;     //< false for the records overlapping the regions,
+	                   //< true for the records starting in the regions
+
+	inline TCheck Check(C_Int64 pos) const
+	{
+		if (pos > fList[fIdx].End) return rcDone;
+		// the records overlapping the previous region have been imported
+		if (pos <= fPrevEnd) return rcSkip;
+		return (pos >= fList[fIdx].Start) ? rcKeep : rcSkip;
 	}
+};
 
-	// get the number of left lines
-	C_Int64 n = 0;
-	while (!VCF_EOF())
+CVCF_RegionFilter::CVCF_RegionFilter(SEXP region, const vector<string> &contig,
+	vector<string> &warnings):
+	fIndex(CHAR(STRING_ELT(RGetListElement(region, "index"), 0)))
+{
+	fIdx = -1; fPrevEnd = 0;
+	fByStart = (Rf_asLogical(RGetListElement(region, "by.start")) == TRUE);
+
+	const vector<string> &names =
+		fIndex.Names().empty() ? contig : fIndex.Names();
+	if ((int)names.size() < fIndex.NumRef())
+		throw ErrSeqArray("No sequence name in the index.");
+	map<string, int> ref;
+	for (int i=0; i < fIndex.NumRef(); i++)
+		ref.insert(pair<string, int>(names[i], i));
+
+	SEXP chr = RGetListElement(region, "chr");
+	SEXP start = RGetListElement(region, "start");
+	SEXP end = RGetListElement(region, "end");
+	vector<TRegion> lst;
+	for (size_t i=0; i < RLength(chr); i++)
 	{
-		n ++;
-		SkipLine();
+		TRegion R;
+		R.Chr = CHAR(STRING_ELT(chr, i));
+		map<string, int>::iterator it = ref.find(R.Chr);
+		if (it == ref.end())
+		{
+			warnings.push_back("No '" + R.Chr +
+				"' in the index, and the region is ignored.");
+			continue;
+		}
+		R.Ref = it->second;
+		// in the order of the file
+		if (!fIndex.Query(R.Ref, 0, (C_Int64)1 << 62, R.RefOffset))
+			continue;
+		R.Start = (C_Int64)REAL(start)[i];
+		R.End = (C_Int64)REAL(end)[i];
+		if (R.Start < 1) R.Start = 1;
+		if (R.Start <= R.End) lst.push_back(R);
 	}
 
-	Done_VCF_Buffer();
-	return ScalarReal(n);
+	// sort and merge the overlapping regions
+	std::sort(lst.begin(), lst.end());
+	for (size_t i=0; i < lst.size(); i++)
+	{
+		if (!fList.empty() && (fList.back().Ref == lst[i].Ref) &&
+			(lst[i].Start <= fList.back().End))
+		{
+			if (fList.back().End < lst[i].End)
+				fList.back().End = lst[i].End;
+		} else
+			fList.push_back(lst[i]);
+	}
 }
 
+bool CVCF_RegionFilter::Next()
+{
+	while (++fIdx < (int)fList.size())
+	{
+		const TRegion &R = fList[fIdx];
+		fPrevEnd = ((fIdx > 0) && (fList[fIdx-1].Ref == R.Ref)) ?
+			fList[fIdx-1].End : 0;
+		C_UInt64 voffset;
+		if (fIndex.Query(R.Ref, R.Start-1, R.End, voffset))
+		{
+			VCF_Reader->Seek(voffset);
+			VCF_Buffer_Ptr = VCF_Buffer_EndPtr = &VCF_Buffer[0];
+			VCF_EOF_Signalled = false;
+			return true;
+		}
+	}
+	fIdx = fList.size();
+	VCF_Buffer_Ptr = VCF_Buffer_EndPtr;
+	VCF_EOF_Signalled = true;
+	return false;
+}
 
+CVCF_RegionFilter::TCheck CVCF_RegionFilter::CheckLine(const char *p,
+	const char *end) const
+{
+	const TRegion &R = fList[fIdx];
+	// CHROM
+	const char *s = p;
+	while ((p < end) && (*p != '\t')) p ++;
+	if (((size_t)(p - s) != R.Chr.size()) ||
+			(memcmp(s, R.Chr.c_str(), p - s) != 0))
+		return rcDone;
+	// POS, invalid values are left to the parser
+	if (p < end) p ++;
+	C_Int64 pos = 0;
+	for (s = p; (p < end) && isdigit(*p) && (p - s < 16); p++)
+		pos = pos*10 + (*p - '0');
+	if ((p == s) || ((p < end) && (*p != '\t')))
+		return rcKeep;
+
+	TCheck rv = Check(pos);
+	if ((rv != rcSkip) || fByStart || (pos <= fPrevEnd)) return rv;
+
+	// the end position of the record, using REF or INFO END
+	int col = 1;
+	const char *ref = NULL, *ref_end = NULL;
+	for (; p < end; p++)
+	{
+		if (*p != '\t') continue;
+		col ++;
+		if (col == 3) ref = p + 1;
+		else if (col == 4) ref_end = p;
+		else if (col == 7) { p ++; break; }
+	}
+	C_Int64 pos_end = (ref && ref_end) ? pos + (ref_end - ref) - 1 : pos;
+	if (col == 7)
+	{
+		const char *info_end = p;
+		while ((info_end < end) && (*info_end != '\t')) info_end ++;
+		for (; p < info_end; p++)
+		{
+			if ((info_end - p > 4) && (memcmp(p, "END=", 4) == 0))
+			{
+				C_Int64 v = 0;
+				for (p += 4, s = p; (p < info_end) && isdigit(*p) &&
+					(p - s < 16); p++)
+					v = v*10 + (*p - '0');
+				if ((p > s) && (v > pos_end)) pos_end = v;
+				break;
+			}
+			while ((p < info_end) && (*p != ';')) p ++;
+		}
+	}
+	return (pos_end >= R.Start) ? rcKeep : rcSkip;
+}
 
-// ===========================================================
-// Split VCF files
-// ===========================================================
+/// test EOF, and seek to the next region at the end of file
+inline static bool VCF_EOF(CVCF_RegionFilter *region)
+{
+	while (VCF_EOF())
+	{
+		if (!region || !region->Next())
+			return true;
+	}
+	return false;
+}
 
-COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Split(SEXP start, SEXP count, SEXP pnum,
-	SEXP multiple)
+/// read the next lines into a chunk (only in the main thread), no more than
+/// 'max_line' lines, and only the records in the regions if 'region' is set
+static void Read_VCF_Chunk(TVCF_Chunk &C, C_Int64 max_line,
+	CVCF_RegionFilter *region)
 {
-	int num = Rf_asInteger(pnum);
-	if (num <= 0) error("'pnum' should be > 0.");
-	int multi = Rf_asInteger(multiple);
-	if (multi <= 0) error("'multiple' should be > 0.");
-	SEXP ans = PROTECT(NEW_LIST(2));
-	SEXP start_array = PROTECT(NEW_NUMERIC(num));
-	SEXP count_array = PROTECT(NEW_NUMERIC(num));
-	SET_ELEMENT(ans, 0, start_array);
-	SET_ELEMENT(ans, 1, count_array);
+	C.TextLen = 0;
+	C.NumLine = 0;
+	C.LineStart = VCF_NextLineNum;
 
-	double cnt = Rf_asReal(count);
-	double scale = cnt / num;
-	double st = Rf_asReal(start);
-	for (int i=0; i < num; i++)
+	while ((C.NumLine < max_line) && (C.TextLen < VCF_CHUNK_SIZE) &&
+		!VCF_EOF(region))
 	{
-		double old_st = REAL(start_array)[i] = round(st);
-		st += scale;
-		C_Int64 n = (C_Int64)(round(st) - old_st);
-		if (n % multi)  // should be a multiple of 'multi'
+		const size_t line_start = C.TextLen;
+		// copy the line
+		while (true)
 		{
-			int m = ((n / multi) + 1) * multi;
-			st += m - n;
-			n = m;
+			char *p = (char*)vec_char_find_CRLF(VCF_Buffer_Ptr,
+				VCF_Buffer_EndPtr - VCF_Buffer_Ptr);
+			size_t n = p - VCF_Buffer_Ptr;
+			if (C.TextLen + n + VCF_BUFFER_SIZE_PLUS > C.Text.size())
+				C.Text.resize((C.TextLen + n) * 2 + VCF_BUFFER_SIZE_PLUS);
+			memcpy(&C.Text[C.TextLen], VCF_Buffer_Ptr, n);
+			C.TextLen += n;
+			VCF_Buffer_Ptr = p;
+			if ((p < VCF_Buffer_EndPtr) || VCF_EOF_Signalled)
+				break;
+			Read_VCF_Buffer();
 		}
-		if ((old_st + n) > (cnt + 1))
-			n = round(cnt + 1 - old_st);
-		REAL(count_array)[i] = (n >= 0) ? n : 0;
-	}
+		C.Text[C.TextLen++] = '\n';
+		C.NumLine ++;
+		VCF_NextLineNum ++;
 
-	UNPROTECT(3);
-	return ans;
-}
+		// skip '\n' and '\r'
+		while (true)
+		{
+			while ((VCF_Buffer_Ptr < VCF_Buffer_EndPtr) &&
+					(*VCF_Buffer_Ptr=='\n' || *VCF_Buffer_Ptr=='\r'))
+				VCF_Buffer_Ptr ++;
+			if ((VCF_Buffer_Ptr < VCF_Buffer_EndPtr) || VCF_EOF_Signalled)
+				break;
+			Read_VCF_Buffer();
+		}
 
+		// remove the line out of the current region
+		if (region)
+		{
+			CVCF_RegionFilter::TCheck rv = region->CheckLine(
+				&C.Text[line_start], &C.Text[C.TextLen-1]);
+			if (rv != CVCF_RegionFilter::rcKeep)
+			{
+				C.TextLen = line_start;
+				C.NumLine --;
+				VCF_NextLineNum --;
+				if (rv == CVCF_RegionFilter::rcDone)
+					region->Next();
+			}
+		}
+	}
+}
 
 
 // ===========================================================
-// Conversion: VCF --> GDS
+// BCF2 format
 // ===========================================================
 
-/// return true, if matching
-inline static bool StrCaseCmp(const char *prefix, const char *txt, size_t nmax)
+static const char *ERR_BCF_RECORD = "Invalid BCF record.";
+static const char *ERR_BCF_EOF = "Unexpected end of BCF file.";
+
+// the types of typed values
+static const int BCF_TYPE_NULL  = 0;
+static const int BCF_TYPE_INT8  = 1;
+static const int BCF_TYPE_INT16 = 2;
+static const int BCF_TYPE_INT32 = 3;
+static const int BCF_TYPE_FLOAT = 5;
+static const int BCF_TYPE_CHAR  = 7;
+
+/// the end of a vector returned by BCF_Int()
+static const C_Int32 BCF_INT_EOV = INT_MIN + 1;
+/// the bit patterns of a missing float and the end of a float vector
+static const C_UInt32 BCF_FLOAT_MISSING = 0x7F800001;
+static const C_UInt32 BCF_FLOAT_EOV = 0x7F800002;
+
+/// get a little-endian 32-bit integer
+inline static C_UInt32 BCF_U32(const C_UInt8 *p)
 {
-	while (*prefix && *txt && nmax>0)
+	return (C_UInt32)p[0] | ((C_UInt32)p[1] << 8) | ((C_UInt32)p[2] << 16) |
+		((C_UInt32)p[3] << 24);
+}
+
+/// the number of bytes of a value in the type
+inline static size_t BCF_TypeSize(int type)
+{
+	switch (type)
 	{
-		if (toupper(*prefix) != toupper(*txt))
-			return false;
-		prefix ++; txt ++; nmax --;
+	case BCF_TYPE_NULL:  return 0;
+	case BCF_TYPE_INT8:  return 1;
+	case BCF_TYPE_INT16: return 2;
+	case BCF_TYPE_INT32: return 4;
+	case BCF_TYPE_FLOAT: return 4;
+	case BCF_TYPE_CHAR:  return 1;
+	default:
+		throw ErrSeqArray("Invalid type (%d) in BCF record.", type);
 	}
-	return (*prefix == 0);
 }
 
-
-/// VCF format --> SeqArray GDS format
-COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
-	SEXP gds_root, SEXP param, SEXP line_cnt, SEXP rho)
+/// get an integer, NA_INTEGER if missing or BCF_INT_EOV for the end of vector
+inline static C_Int32 BCF_Int(const C_UInt8 *p, int type)
 {
-	const char *fn = CHAR(STRING_ELT(vcf_fn, 0));
+	switch (type)
+	{
+	case BCF_TYPE_INT8:
+		{
+			C_Int32 v = (C_Int8)p[0];
+			if (v > -121) return v;
+			return (v == -127) ? BCF_INT_EOV : NA_INTEGER;
+		}
+	case BCF_TYPE_INT16:
+		{
+			C_Int32 v = (C_Int16)(p[0] | (p[1] << 8));
+			if (v > -32761) return v;
+			return (v == -32767) ? BCF_INT_EOV : NA_INTEGER;
+		}
+	case BCF_TYPE_INT32:
+		{
+			C_Int32 v = (C_Int32)BCF_U32(p);
+			if (v > INT_MIN + 7) return v;
+			return (v == INT_MIN + 1) ? BCF_INT_EOV : NA_INTEGER;
+		}
+	default:
+		throw ErrSeqArray("Invalid integer type (%d) in BCF record.", type);
+	}
+}
 
-	COREARRAY_TRY
+/// get a real number, and return false for the end of vector
+inline static bool BCF_Float(const C_UInt8 *p, double &val)
+{
+	C_UInt32 u = BCF_U32(p);
+	if (u == BCF_FLOAT_EOV) return false;
+	if (u != BCF_FLOAT_MISSING)
+	{
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		val = f;
+	} else
+		val = R_NaN;
+	return true;
+}
 
-	#if (GDS_TIMING > 0)
-		_timing_ = 0;
+/// get the type and the number of values of a typed value, and return the
+/// pointer to the values
+inline static const C_UInt8 *BCF_Typed(const C_UInt8 *p, const C_UInt8 *end,
+	int &type, size_t &num)
+{
+	if (p >= end) throw ErrSeqArray(ERR_BCF_RECORD);
+	type = (*p) & 0x0F;
+	num = (*p) >> 4;
+	p ++;
+	if (num == 15)
+	{
+		// the number is given by the next typed integer
+		int t; size_t n;
+		p = BCF_Typed(p, end, t, n);
+		if ((n != 1) || (t < BCF_TYPE_INT8) || (t > BCF_TYPE_INT32))
+			throw ErrSeqArray(ERR_BCF_RECORD);
+		C_Int32 v = BCF_Int(p, t);
+		if ((v < 0) || (v == NA_INTEGER))
+			throw ErrSeqArray(ERR_BCF_RECORD);
+		num = v;
+		p += BCF_TypeSize(t);
+	}
+	if ((size_t)(end - p) < num * BCF_TypeSize(type))
+		throw ErrSeqArray(ERR_BCF_RECORD);
+	return p;
+}
+
+/// get a typed integer, e.g., the key of INFO or FORMAT
+inline static C_Int32 BCF_TypedInt(const C_UInt8 *&p, const C_UInt8 *end)
+{
+	int type; size_t num;
+	p = BCF_Typed(p, end, type, num);
+	if ((num != 1) || (type < BCF_TYPE_INT8) || (type > BCF_TYPE_INT32))
+		throw ErrSeqArray(ERR_BCF_RECORD);
+	C_Int32 v = BCF_Int(p, type);
+	p += BCF_TypeSize(type);
+	return v;
+}
+
+/// get a typed string, and a single '.' is treated as an empty string
+inline static void BCF_TypedStr(const C_UInt8 *&p, const C_UInt8 *end,
+	string &s)
+{
+	int type; size_t num;
+	p = BCF_Typed(p, end, type, num);
+	if ((type != BCF_TYPE_CHAR) && (num > 0))
+		throw ErrSeqArray(ERR_BCF_RECORD);
+	const C_UInt8 *e = (const C_UInt8*)memchr(p, 0, num);
+	s.assign((const char*)p, e ? (const char*)e : (const char*)(p + num));
+	if ((s.size() == 1) && (s[0] == '.')) s.clear();
+	p += num;
+}
+
+/// get multiple integers from a typed vector of 'num' values
+inline static void BCF_Int32Array(const C_UInt8 *p, int type, size_t num,
+	vector<C_Int32> &I32s, string &buf)
+{
+	I32s.clear();
+	switch (type)
+	{
+	case BCF_TYPE_NULL:
+		break;
+	case BCF_TYPE_FLOAT:
+		for (size_t i=0; i < num; i++, p+=4)
+		{
+			double v;
+			if (!BCF_Float(p, v)) break;
+			if (ISNAN(v))
+			{
+				I32s.push_back(NA_INTEGER);
+			} else if ((v > INT_MIN) && (v <= INT_MAX) && (v == (C_Int32)v))
+			{
+				I32s.push_back((C_Int32)v);
+			} else {
+				if (VCF_RaiseError)
+				{
+					char s[64];
+					snprintf(s, sizeof(s), "%g", v);
+					throw ErrSeqArray(ERR_INT_CONV, s);
+				}
+				I32s.push_back(NA_INTEGER);
+			}
+		}
+		break;
+	case BCF_TYPE_CHAR:
+		{
+			const C_UInt8 *e = (const C_UInt8*)memchr(p, 0, num);
+			buf.assign((const char*)p, e ? (const char*)e : (const char*)(p + num));
+			getInt32Array(buf.c_str(), buf.c_str() + buf.size(), I32s);
+			break;
+		}
+	default:
+		{
+			const size_t sz = BCF_TypeSize(type);
+			for (size_t i=0; i < num; i++, p+=sz)
+			{
+				C_Int32 v = BCF_Int(p, type);
+				if (v == BCF_INT_EOV) break;
+				I32s.push_back(v);
+			}
+		}
+	}
+}
+
+/// get multiple real numbers from a typed vector of 'num' values
+inline static void BCF_FloatArray(const C_UInt8 *p, int type, size_t num,
+	vector<C_Float64> &F64s, string &buf)
+{
+	F64s.clear();
+	switch (type)
+	{
+	case BCF_TYPE_NULL:
+		break;
+	case BCF_TYPE_FLOAT:
+		for (size_t i=0; i < num; i++, p+=4)
+		{
+			double v;
+			if (!BCF_Float(p, v)) break;
+			F64s.push_back(v);
+		}
+		break;
+	case BCF_TYPE_CHAR:
+		{
+			const C_UInt8 *e = (const C_UInt8*)memchr(p, 0, num);
+			buf.assign((const char*)p, e ? (const char*)e : (const char*)(p + num));
+			getFloatArray(&buf[0], &buf[0] + buf.size(), F64s);
+			break;
+		}
+	default:
+		{
+			const size_t sz = BCF_TypeSize(type);
+			for (size_t i=0; i < num; i++, p+=sz)
+			{
+				C_Int32 v = BCF_Int(p, type);
+				if (v == BCF_INT_EOV) break;
+				F64s.push_back((v != NA_INTEGER) ? v : R_NaN);
+			}
+		}
+	}
+}
+
+/// get multiple strings from a typed vector of 'num' values
+inline static void BCF_StringArray(const C_UInt8 *p, int type, size_t num,
+	vector<string> &S8s, string &buf)
+{
+	S8s.clear();
+	char s[64];
+	switch (type)
+	{
+	case BCF_TYPE_NULL:
+		break;
+	case BCF_TYPE_CHAR:
+		{
+			const C_UInt8 *e = (const C_UInt8*)memchr(p, 0, num);
+			buf.assign((const char*)p, e ? (const char*)e : (const char*)(p + num));
+			getStringArray(&buf[0], &buf[0] + buf.size(), S8s);
+			break;
+		}
+	case BCF_TYPE_FLOAT:
+		for (size_t i=0; i < num; i++, p+=4)
+		{
+			double v;
+			if (!BCF_Float(p, v)) break;
+			if (!ISNAN(v))
+			{
+				*fast_gtoa(s, v) = 0;
+				S8s.push_back(s);
+			} else
+				S8s.push_back(BlankString);
+		}
+		break;
+	default:
+		{
+			const size_t sz = BCF_TypeSize(type);
+			for (size_t i=0; i < num; i++, p+=sz)
+			{
+				C_Int32 v = BCF_Int(p, type);
+				if (v == BCF_INT_EOV) break;
+				if (v != NA_INTEGER)
+				{
+					snprintf(s, sizeof(s), "%d", v);
+					S8s.push_back(s);
+				} else
+					S8s.push_back(BlankString);
+			}
+		}
+	}
+}
+
+/// get an allele index from a genotype value, -1 for a missing allele
+inline static C_Int16 BCF_Geno(C_Int32 v, int num_allele)
+{
+	if (v == NA_INTEGER) return -1;
+	int g = (v >> 1) - 1;
+	if ((g < -1) || (g > 32767) || (g >= num_allele))
+	{
+		if (VCF_RaiseError)
+		{
+			char s[64];
+			snprintf(s, sizeof(s), "%d", g);
+			throw ErrSeqArray((g < -1) ? ERR_GENO_CONV : ERR_GENO_OUT_RANGE, s);
+		}
+		return -1;
+	}
+	return g;
+}
+
+
+/// get the value of 'key' in a structured header line, e.g.,
+/// '##INFO=<ID=DP,Number=1,Type=Integer,Description="...">'
+static bool BCF_HeaderValue(const string &line, const char *key, string &val)
+{
+	const char *p = strchr(line.c_str(), '<');
+	if (!p) return false;
+	const size_t key_len = strlen(key);
+	p ++;
+	while (*p && (*p != '>'))
+	{
+		const char *k = p;
+		while (*p && (*p != '=') && (*p != ',') && (*p != '>')) p ++;
+		bool match = ((size_t)(p - k) == key_len) &&
+			(strncmp(k, key, key_len) == 0);
+		val.clear();
+		if (*p == '=')
+		{
+			p ++;
+			if (*p == '"')
+			{
+				for (p++; *p && (*p != '"'); p++)
+				{
+					if ((*p == '\\') && p[1]) p ++;
+					val.push_back(*p);
+				}
+				if (*p == '"') p ++;
+			} else {
+				while (*p && (*p != ',') && (*p != '>'))
+					val.push_back(*p ++);
+			}
+		}
+		if (match) return true;
+		if (*p == ',') p ++;
+	}
+	return false;
+}
+
+/// add an ID to a dictionary at the position of 'IDX' if it is given
+static void BCF_AddDict(vector<string> &dict, map<string, int> &index,
+	const string &line)
+{
+	string id, idx;
+	if (!BCF_HeaderValue(line, "ID", id)) return;
+	if (BCF_HeaderValue(line, "IDX", idx))
+	{
+		int i = atoi(idx.c_str());
+		if (i < 0)
+			throw ErrSeqArray("Invalid IDX in the BCF header: %s", line.c_str());
+		if ((size_t)i >= dict.size()) dict.resize(i + 1);
+		dict[i] = id;
+		index[id] = i;
+	} else if (index.find(id) == index.end())
+	{
+		index[id] = dict.size();
+		dict.push_back(id);
+	}
+}
+
+/// read the header of a BCF2 file, and build the dictionary of strings
+/// (the IDs of FILTER, INFO and FORMAT) and the dictionary of contigs
+static void Read_BCF_Header(vector<string> &dict, vector<string> &contig)
+{
+	C_UInt8 s[9];
+	if ((Read_VCF_Bytes(s, 9) < 9) || (memcmp(s, "BCF\2", 4) != 0))
+		throw ErrSeqArray("Invalid BCF2 file.");
+	string text(BCF_U32(s + 5), 0);
+	if (Read_VCF_Bytes(&text[0], text.size()) < text.size())
+		throw ErrSeqArray(ERR_BCF_EOF);
+
+	map<string, int> dict_index, contig_index;
+	dict.clear(); contig.clear();
+	// PASS is always the first one
+	BCF_AddDict(dict, dict_index, "##FILTER=<ID=PASS>");
+
+	string line;
+	for (const char *p = text.c_str(); *p; )
+	{
+		const char *e = p;
+		while (*e && (*e != '\n')) e ++;
+		line.assign(p, e);
+		p = *e ? e + 1 : e;
+		if (line.compare(0, 6, "#CHROM") == 0) break;
+		if ((line.compare(0, 10, "##FILTER=<") == 0) ||
+			(line.compare(0, 8, "##INFO=<") == 0) ||
+			(line.compare(0, 10, "##FORMAT=<") == 0))
+		{
+			BCF_AddDict(dict, dict_index, line);
+		} else if (line.compare(0, 10, "##contig=<") == 0)
+			BCF_AddDict(contig, contig_index, line);
+	}
+}
+
+/// read a BCF2 record (l_shared, l_indiv and the data) into 'buf' at 'pos',
+/// and return the number of bytes or 0 at the end of file
+static size_t Read_BCF_Record(vector<char> &buf, size_t pos)
+{
+	C_UInt8 s[8];
+	size_t n = Read_VCF_Bytes(s, 8);
+	if (n == 0) return 0;
+	if (n < 8) throw ErrSeqArray(ERR_BCF_EOF);
+	n = 8 + (size_t)BCF_U32(s) + BCF_U32(s + 4);
+	if (pos + n + VCF_BUFFER_SIZE_PLUS > buf.size())
+		buf.resize((pos + n) * 2 + VCF_BUFFER_SIZE_PLUS);
+	memcpy(&buf[pos], s, 8);
+	if (Read_VCF_Bytes(&buf[pos + 8], n - 8) < n - 8)
+		throw ErrSeqArray(ERR_BCF_EOF);
+	return n;
+}
+
+CVCF_RegionFilter::TCheck CVCF_RegionFilter::CheckRecord(const C_UInt8 *p,
+	size_t size) const
+{
+	// invalid records are left to the parser
+	if ((size < 20) || (BCF_U32(p) < 12)) return rcKeep;
+	if ((C_Int32)BCF_U32(p + 8) != fList[fIdx].Ref) return rcDone;
+	const C_Int64 pos = (C_Int32)BCF_U32(p + 12) + 1;
+	TCheck rv = Check(pos);
+	if ((rv != rcSkip) || fByStart || (pos <= fPrevEnd)) return rv;
+	const C_Int64 pos_end = pos + (C_Int32)BCF_U32(p + 16) - 1;
+	return (pos_end >= fList[fIdx].Start) ? rcKeep : rcSkip;
+}
+
+/// read the next BCF2 records into a chunk (only in the main thread), no
+/// more than 'max_line' records, and only the records in the regions if
+/// 'region' is set
+static void Read_BCF_Chunk(TVCF_Chunk &C, C_Int64 max_line,
+	CVCF_RegionFilter *region)
+{
+	C.TextLen = 0;
+	C.NumLine = 0;
+	C.LineStart = VCF_NextLineNum;
+
+	while ((C.NumLine < max_line) && (C.TextLen < VCF_CHUNK_SIZE))
+	{
+		VCF_LineNum = VCF_NextLineNum;
+		size_t n = Read_BCF_Record(C.Text, C.TextLen);
+		if (n == 0)
+		{
+			if (region && region->Next()) continue;
+			break;
+		}
+		if (region)
+		{
+			CVCF_RegionFilter::TCheck rv = region->CheckRecord(
+				(const C_UInt8*)&C.Text[C.TextLen], n);
+			if (rv == CVCF_RegionFilter::rcDone)
+				region->Next();
+			if (rv != CVCF_RegionFilter::rcKeep)
+				continue;
+		}
+		C.TextLen += n;
+		C.NumLine ++;
+		VCF_NextLineNum ++;
+	}
+}
+
+
+/// the parameters shared by all chunk parsers
+struct COREARRAY_DLL_LOCAL TVCF_ParseParam
+{
+	const char *FileName;   //< the file name in error messages
+	string GenoID;          //< the variable name for genotypic data
+	size_t NumPloidy;       //< the number of ploidy
+	bool HasPhase;          //< whether phase/data exists
+	C_Int64 VariantStartIndex;  //< the variant index before the first line
+	vector<const char *> ChrPrefix;  //< the chromosome prefixes removed
+	bool IsBCF;  //< true for the chunks of BCF2 records instead of lines
+	vector<string> BCFDict;    //< the IDs of FILTER, INFO and FORMAT in BCF2
+	vector<string> BCFContig;  //< the contig names in BCF2
+};
+
+
+/// determine how many alleles in 'REF,ALT', INT_MAX if it is missing
+inline static int getNumAllele(const string &allele)
+{
+	if ((allele == ".") || (allele == ".,."))
+		return INT_MAX;
+	int num_allele = 0;
+	for (const char *p = allele.c_str(); *p; )
+	{
+		num_allele ++;
+		while (*p && (*p != ',')) p ++;
+		if (*p == ',') p ++;
+	}
+	return num_allele;
+}
+
+
+/// the parser of line-aligned chunks, one object per thread
+class COREARRAY_DLL_LOCAL CVCF_ChunkParser
+{
+public:
+	CVCF_ChunkParser(const TVCF_ParseParam &param,
+		const vector<TVCF_Info> &info, const vector<TVCF_Format> &fmt);
+
+	/// parse all lines in the chunk, no exception is thrown
+	void Parse(TVCF_Chunk &C);
+
+private:
+	const TVCF_ParseParam &Param;
+	vector<TVCF_Info> info_list;      //< a copy with its own flags
+	vector<TVCF_Format> format_list;  //< a copy with its own buffers
+	vector<TVCF_Format*> fmt_ptr;
+	CVCF_IdIndex info_index, format_index;  //< INFO and FORMAT IDs
+	string last_format;  //< the FORMAT column of fmt_ptr, or empty
+	bool last_fmt_is_geno;  //< whether the first FORMAT ID is genotype
+	int last_num_fmt_id;    //< the number of FORMAT IDs
+	set<string> info_missing, format_missing;
+	vector<int> bcf_info, bcf_format;  //< BCF2 dictionary --> the list index
+
+	char *pCur;  //< the current position in the chunk
+	char *pTextEnd;  //< the end of the lines in the chunk
+	char *Text_pBegin, *Text_pEnd;    //< the current field
+	char *save_pBegin, *save_pEnd;    //< save Text_pBegin, Text_pEnd
+	C_Int64 LineNum;  //< the current line number
+	int ColumnNum, NextColumnNum;  //< the current and next column numbers
+
+	string cell;
+	vector<C_Int8> I8s;
+	vector<C_Int32> I32s;
+	vector<C_Float64> F64s;
+	vector<string> S8s;
+	vector<C_Int16> Genotypes;
+	vector<C_Int8> Phases;
+
+	void ParseLine(TVCF_Chunk &C, C_Int64 variant_index);
+	void ParseBCF(TVCF_Chunk &C, C_Int64 variant_index);
+	void PushChr(TVCF_Chunk &C, const char *p, const char *end);
+	void FillInfo(TVCF_Chunk &C);
+	void SaveSamples(TVCF_Chunk &C, int num_allele, bool has_geno);
+	void GetText(int last_column);
+	void SkipWhiteSpace();
+	void SkipTextWithDot();
+};
+
+CVCF_ChunkParser::CVCF_ChunkParser(const TVCF_ParseParam &param,
+	const vector<TVCF_Info> &info, const vector<TVCF_Format> &fmt):
+	Param(param), info_list(info), format_list(fmt)
+{
+	fmt_ptr.reserve(format_list.size());
+	info_index.Init(info_list);
+	format_index.Init(format_list);
+	last_fmt_is_geno = false;
+	last_num_fmt_id = 0;
+	pCur = pTextEnd = Text_pBegin = Text_pEnd = save_pBegin = save_pEnd = NULL;
+	LineNum = 0;
+	ColumnNum = 0; NextColumnNum = 1;
+	cell.reserve(1024);
+	I8s.reserve(SampleNum);
+	I32s.reserve(SampleNum);
+	F64s.reserve(SampleNum);
+	S8s.reserve(SampleNum);
+	Genotypes.resize(SampleNum * param.NumPloidy);
+	Phases.resize(SampleNum * (param.NumPloidy - 1));
+	if (param.IsBCF)
+	{
+		// map the BCF2 dictionary to the INFO and FORMAT variables
+		bcf_info.assign(param.BCFDict.size(), -1);
+		bcf_format.assign(param.BCFDict.size(), -1);
+		for (size_t i=0; i < param.BCFDict.size(); i++)
+		{
+			bcf_info[i] = info_index.Find(param.BCFDict[i]);
+			bcf_format[i] = format_index.Find(param.BCFDict[i]);
+		}
+	}
+}
+
+void CVCF_ChunkParser::Parse(TVCF_Chunk &C)
+{
+	C.ClearResult(info_list.size(), format_list.size());
+	pCur = &C.Text[0];
+	pTextEnd = pCur + C.TextLen;
+	save_pBegin = save_pEnd = pCur;
+	ColumnNum = 0;
+
+	try {
+		for (int i=0; i < C.NumLine; i++)
+		{
+			LineNum = C.LineStart + i;
+			ColumnNum = 0; NextColumnNum = 1;
+			if (Param.IsBCF)
+				ParseBCF(C, C.VariantStart + i + 1);
+			else
+				ParseLine(C, C.VariantStart + i + 1);
+		}
+	}
+	catch (std::exception &E) {
+		char buf[4096];
+		if ((ColumnNum > 0) && (save_pBegin < save_pEnd))
+		{
+			snprintf(buf, sizeof(buf),
+				"%s\nFILE: %s\nLINE: %lld, COLUMN: %d, %s\n",
+				E.what(), Param.FileName, (long long int)LineNum, ColumnNum,
+				string(save_pBegin, save_pEnd).c_str());
+		} else {
+			snprintf(buf, sizeof(buf), "%s\nFILE: %s\n%s: %lld\n",
+				E.what(), Param.FileName, Param.IsBCF ? "RECORD" : "LINE",
+				(long long int)LineNum);
+		}
+		C.ErrMsg = buf;
+		C.HasError = true;
+	}
+	catch (...) {
+		C.ErrMsg = "Unknown error in parsing VCF.";
+		C.HasError = true;
+	}
+}
+
+/// get a field ending with '\t' or '\n' in the current line
+inline void CVCF_ChunkParser::GetText(int last_column)
+{
+	ColumnNum = NextColumnNum;
+	char *p = pCur;
+	while ((*p != '\t') && (*p != '\n')) p ++;
+	Text_pBegin = pCur;
+	Text_pEnd = p;
+
+	if (*p == '\t')
+	{
+		if (last_column == TRUE)
+			throw ErrSeqArray("more columns than what expected.");
+		NextColumnNum ++;
+	} else {
+		if (last_column == FALSE)
+			throw ErrSeqArray("fewer columns than what expected.");
+		NextColumnNum = 1;
+	}
+	pCur = p + 1;
+
+	save_pBegin = Text_pBegin;
+	save_pEnd = Text_pEnd;
+}
+
+/// skip white space
+inline void CVCF_ChunkParser::SkipWhiteSpace()
+{
+	while ((Text_pBegin < Text_pEnd) && (*Text_pBegin == ' '))
+		Text_pBegin ++;
+	while ((Text_pBegin < Text_pEnd) && (*(Text_pEnd-1) == ' '))
+		Text_pEnd --;
+}
+
+/// skip a dot
+inline void CVCF_ChunkParser::SkipTextWithDot()
+{
+	SkipWhiteSpace();
+	if ((Text_pEnd-Text_pBegin == 1) && (*Text_pBegin == '.'))
+		Text_pBegin ++;
+}
+
+/// append the chromosome name without the prefix
+inline void CVCF_ChunkParser::PushChr(TVCF_Chunk &C, const char *p,
+	const char *end)
+{
+	for (vector<const char *>::const_iterator s=Param.ChrPrefix.begin();
+		s != Param.ChrPrefix.end(); s++)
+	{
+		if (StrCaseCmp(*s, p, end-p))
+		{
+			p += strlen(*s);
+			break;
+		}
+	}
+	C.Chr.push_back(string(p, end));
+}
+
+/// fill missing values for the INFO variables not in the current line
+void CVCF_ChunkParser::FillInfo(TVCF_Chunk &C)
+{
+	vector<TVCF_Info>::iterator pI;
+	for (pI = info_list.begin(); pI != info_list.end(); pI++)
+	{
+		if (!pI->used && pI->import_flag)
+		{
+			TVCF_Column &col = C.Info[pI - info_list.begin()];
+			switch (pI->type)
+			{
+			case FIELD_TYPE_INT:
+				pI->Fill(col.I32, col.Len, (C_Int32)NA_INTEGER);
+				break;
+			case FIELD_TYPE_FLOAT:
+				pI->Fill(col.F64, col.Len, (C_Float64)R_NaN);
+				break;
+			case FIELD_TYPE_FLAG:
+				col.I32.push_back(0);
+				break;
+			case FIELD_TYPE_STRING:
+				pI->Fill(col.S8, col.Len, BlankString);
+				break;
+			default:
+				throw ErrSeqArray("Invalid INFO Type.");
+			}
+			pI->used = true;
+		}
+	}
+}
+
+/// append the genotypes and FORMAT values of the current line to the chunk
+void CVCF_ChunkParser::SaveSamples(TVCF_Chunk &C, int num_allele,
+	bool has_geno)
+{
+	const size_t num_samp_ploidy = SampleNum * Param.NumPloidy;
+
+	if (has_geno)
+	{
+		// need to identify num_allele if missing
+		if (num_allele == INT_MAX)
+		{
+			num_allele = 0;
+			C_Int16 *p = &Genotypes[0];
+			for (size_t n=num_samp_ploidy; n > 0; n--, p++)
+			{
+				if ((*p >= 0) && (*p > num_allele))
+					num_allele = *p;
+			}
+			num_allele ++;
+		}
+
+		// determine how many bits, plus ONE for missing value
+		int num_bits = 2;
+		while ((num_allele + 1) > (1 << num_bits))
+			num_bits += 2;
+		C.GenoLen.push_back(num_bits >> 1);
+
+		for (int bits=0; bits < num_bits; )
+		{
+			AppendVec(C.Geno, Genotypes);
+			bits += 2;
+			if (bits < num_bits)
+				vec_i16_shr_b2(&Genotypes[0], num_samp_ploidy);
+		}
+
+		if (Param.HasPhase)
+			AppendVec(C.Phase, Phases);
+	}
+
+	// all format IDs
+	for (size_t i=0; i < format_list.size(); i++)
+	{
+		if (format_list[i].import_flag)
+			format_list[i].SaveTo(C.Format[i]);
+	}
+}
+
+void CVCF_ChunkParser::ParseLine(TVCF_Chunk &C, C_Int64 variant_index)
+{
+	const size_t num_ploidy = Param.NumPloidy;
+	const size_t num_ploidy_less = num_ploidy - 1;
+	const size_t num_samp_ploidy_less = SampleNum * num_ploidy_less;
+	const C_Int32 variant_offset = variant_index - Param.VariantStartIndex;
+	vector<TVCF_Info>::iterator pI;
+	vector<TVCF_Format*>::iterator pF;
+
+	// -----------------------------------------------------
+	// column 1: CHROM
+	GetText(FALSE);
+	C.VarIdx.push_back(variant_index);
+	PushChr(C, Text_pBegin, Text_pEnd);
+
+	// -----------------------------------------------------
+	// column 2: POS
+	GetText(FALSE);
+	C.Pos.push_back(getInt32(Text_pBegin, Text_pEnd));
+
+	// -----------------------------------------------------
+	// column 3: ID
+	GetText(FALSE);
+	SkipTextWithDot();
+	C.RSID.push_back(string(Text_pBegin, Text_pEnd));
+
+	// -----------------------------------------------------
+	// column 4 & 5: REF + ALT
+	GetText(FALSE);  // REF
+	SkipWhiteSpace();
+	cell.assign(Text_pBegin, Text_pEnd);
+
+	GetText(FALSE);  // ALT
+	SkipTextWithDot();
+	if (Text_pEnd > Text_pBegin)
+	{
+		cell.push_back(',');
+		cell.append(Text_pBegin, Text_pEnd);
+	}
+	C.Allele.push_back(cell);
+
+	// determine how many alleles
+	int num_allele = getNumAllele(cell);
+
+	// -----------------------------------------------------
+	// column 6: QUAL
+	GetText(FALSE);
+	C.Qual.push_back(getFloat(Text_pBegin, Text_pEnd));
+
+	// -----------------------------------------------------
+	// column 7: FILTER, the level is assigned by the writer
+	GetText(FALSE);
+	SkipTextWithDot();
+	C.Filter.push_back(string(Text_pBegin, Text_pEnd));
+
+	// -----------------------------------------------------
+	// column 8: INFO
+
+	for (pI = info_list.begin(); pI != info_list.end(); pI++)
+		pI->used = false;
+	GetText(SampleNum<=0);
+	SkipTextWithDot();
+
+	while (Text_pBegin < Text_pEnd)
+	{
+		// format: name=val | name
+		char *s, *p;
+		s = p = Text_pBegin;
+		while ((p < Text_pEnd) && (*p != ';') && (*p != '='))
+			p ++;
+		Text_pBegin = p;
+
+		// variable name
+		while ((s < p) && (*(p-1) == ' ')) p --;
+		cell.assign(s, p);
+
+		// variable value
+		char *ValBegin, *ValEnd;
+		ValBegin = ValEnd = p = Text_pBegin;
+		if (p < Text_pEnd)
+		{
+			if (*p == '=')
+			{
+				p ++;
+				while ((p < Text_pEnd) && (*p == ' ')) p ++;
+				ValBegin = p;
+				while ((p < Text_pEnd) && (*p != ';')) p ++;
+				Text_pBegin = p;
+				if (p < Text_pEnd) Text_pBegin ++;
+				while ((ValBegin < p) && (*(p-1) == ' ')) p --;
+				ValEnd = p;
+			} else if (*p == ';')
+				Text_pBegin = p + 1;
+			else
+				Text_pBegin = p;
+		}
+
+		const int k = info_index.Find(cell);
+		pI = (k >= 0) ? (info_list.begin() + k) : info_list.end();
+
+		if (pI != info_list.end())
+		{
+			// it is in the list of INFO variables
+			if (pI->used)
+			{
+				char buf[1024];
+				snprintf(buf, sizeof(buf),
+					"LINE: %lld, ignore duplicated INFO ID (%s).",
+					(long long int)LineNum, cell.c_str());
+				C.Warning.push_back(pair<int, string>(0, buf));
+				continue;
+			}
+
+			if (pI->import_flag)
+			{
+				TVCF_Column &col = C.Info[pI - info_list.begin()];
+				C_Int32 len = -1;
+				switch (pI->type)
+				{
+				case FIELD_TYPE_INT:
+					getInt32Array(ValBegin, ValEnd, I32s);
+					len = pI->Index(I32s, num_allele, NA_INTEGER);
+					AppendVec(col.I32, I32s);
+					break;
+
+				case FIELD_TYPE_FLOAT:
+					getFloatArray(ValBegin, ValEnd, F64s);
+					len = pI->Index(F64s, num_allele, R_NaN);
+					AppendVec(col.F64, F64s);
+					break;
+
+				case FIELD_TYPE_FLAG:
+					if (ValBegin < ValEnd)
+					{
+						throw ErrSeqArray(
+							"INFO ID '%s' should be a flag without values.",
+							cell.c_str());
+					}
+					col.I32.push_back(1);
+					break;
+
+				case FIELD_TYPE_STRING:
+					getStringArray(ValBegin, ValEnd, S8s);
+					len = pI->Index(S8s, num_allele, BlankString);
+					AppendVec(col.S8, S8s);
+					break;
+
+				default:
+					throw ErrSeqArray("Invalid INFO Type.");
+				}
+				if (len >= 0) col.Len.push_back(len);
+			}
+
+			pI->used = true;
+		} else {
+			if (info_missing.insert(cell).second)
+				C.Warning.push_back(pair<int, string>(1, cell));
+		}
+	}
+
+	// for which does not exist
+	FillInfo(C);
+
+	// -----------------------------------------------------
+	// column 9: FORMAT
+
+	if (SampleNum <= 0) return;
+
+	for (pF = fmt_ptr.begin(); pF != fmt_ptr.end(); pF++)
+		(*pF)->Init();
+	GetText(FALSE);
+
+	bool first_fmt_id_flag = true;
+	bool first_fmt_id_is_geno = false;
+	int num_fmt_id = 0;
+
+	// the same FORMAT column as the previous line, reuse the layout
+	const size_t fmt_len = Text_pEnd - Text_pBegin;
+	if ((fmt_len > 0) && (fmt_len == last_format.size()) &&
+		(memcmp(Text_pBegin, last_format.data(), fmt_len) == 0))
+	{
+		first_fmt_id_is_geno = last_fmt_is_geno;
+		num_fmt_id = last_num_fmt_id;
+		for (pF = fmt_ptr.begin(); pF != fmt_ptr.end(); pF++)
+			(*pF)->used = true;
+		Text_pBegin = Text_pEnd;
+	} else {
+		last_format.clear();
+		fmt_ptr.clear();
+	}
+	char *fmt_begin = Text_pBegin;
+
+	while (Text_pBegin < Text_pEnd)
+	{
+		while ((Text_pBegin<Text_pEnd) && (*Text_pBegin==' '))
+			Text_pBegin ++;
+
+		const char *start = Text_pBegin;
+		while ((Text_pBegin<Text_pEnd) && (*Text_pBegin!=':'))
+			Text_pBegin ++;
+
+		const char *end = Text_pBegin;
+		while ((start < end) && (*(end-1) == ' '))
+			end --;
+		cell.assign(start, end);
+
+		if ((Text_pBegin<Text_pEnd) && (*Text_pBegin==':'))
+			Text_pBegin ++;
+		num_fmt_id ++;
+
+		if (first_fmt_id_flag)
+		{
+			first_fmt_id_flag = false;
+			// genotype ID
+			first_fmt_id_is_geno = (cell == Param.GenoID);
+			if (first_fmt_id_is_geno) continue;
+		}
+
+		// find ID
+		const int k = format_index.Find(cell);
+		if (k < 0)
+		{
+			if (format_missing.insert(cell).second)
+				C.Warning.push_back(pair<int, string>(2, cell));
+		} else {
+			TVCF_Format *p = &format_list[k];
+			p->used = true;
+			fmt_ptr.push_back(p);
+		}
+	}
+	if (fmt_begin < Text_pEnd)
+	{
+		last_format.assign(fmt_begin, Text_pEnd);
+		last_fmt_is_geno = first_fmt_id_is_geno;
+		last_num_fmt_id = num_fmt_id;
+	}
+
+	// -----------------------------------------------------
+	// Columns for samples
+
+	C_Int16 *pGeno = &Genotypes[0];
+	C_Int8 *pPhase = num_samp_ploidy_less ? &Phases[0] : NULL;
+	size_t si = 0;
+
+	// the vectorized fast path of diploid GT-only samples, e.g., '0|1<TAB>',
+	// and the remaining samples are parsed by the general parser
+	if (first_fmt_id_is_geno && (num_fmt_id == 1) && (num_ploidy == 2) &&
+		(SampleNum > 1))
+	{
+		size_t n = SampleNum - 1;
+		if ((size_t)(pTextEnd - pCur) / 4 < n)
+			n = (pTextEnd - pCur) / 4;
+		si = vec_char_geno_diploid(pCur, n, num_allele, pGeno, pPhase);
+		pCur += 4 * si;
+		NextColumnNum += si;
+		pGeno += 2 * si;
+		pPhase += si;
+	}
+
+	for (; si < SampleNum; si ++)
+	{
+		GetText(si >= (SampleNum-1));
+
+		// skip whitespace
+		while ((Text_pBegin<Text_pEnd) && (*Text_pBegin==' '))
+			Text_pBegin ++;
+
+		// the fast path of a diploid genotype, e.g., '0|1'
+		if (first_fmt_id_is_geno && (num_ploidy == 2) &&
+			getGenoDiploid(Text_pBegin, Text_pEnd, num_allele, pGeno, pPhase))
+		{
+			pGeno += 2; pPhase ++;
+			Text_pBegin += (Text_pBegin + 3 < Text_pEnd) ? 4 : 3;
+		} else if (first_fmt_id_is_geno)
+		{
+			// the first field -- genotypes (GT)
+			const char *p = Text_pBegin;
+			while ((Text_pBegin<Text_pEnd) && (*Text_pBegin!=':'))
+				Text_pBegin ++;
+			const char *end = Text_pBegin;
+
+			if ((Text_pBegin<Text_pEnd) && (*Text_pBegin==':'))
+				Text_pBegin ++;
+
+			I32s.clear(); // genotype extra data
+			I8s.clear(); // phase extra data
+			size_t tmp_num_ploidy = 0;
+			C_Int8 *pPhaseEnd = pPhase + num_ploidy_less;
+
+			while (p < end)
+			{
+				const char *start = p;
+				while ((p<end) && (*p!='|') && (*p!='/'))
+					p ++;
+				C_Int16 g = getGeno(start, p, num_allele);
+
+				tmp_num_ploidy ++;
+				if (tmp_num_ploidy <= num_ploidy)
+					*pGeno ++ = g;
+				else
+					I32s.push_back(g);
+
+				if (p < end)
+				{
+					C_Int8 v = 0;
+					if (*p == '|')
+					{
+						v = 1; p ++;
+					} else if (*p == '/')
+					{
+						v = 0; p ++;
+					}
+					if (tmp_num_ploidy <= num_ploidy_less)
+						*pPhase ++ = v;
+					else
+						I8s.push_back(v);
+				}
+			}
+
+			for (size_t m=tmp_num_ploidy; m < num_ploidy; m++)
+				*pGeno ++ = -1;
+			while (pPhase < pPhaseEnd)
+				*pPhase ++ = 0;
+
+			// genotype/extra, e.g., triploid call: 0/0/1
+			if (!I32s.empty())
+			{
+				AppendVec(C.GenoExtra, I32s);
+				C.GenoExtraIdx.push_back(si + 1);
+				C.GenoExtraIdx.push_back(variant_offset);
+				C.GenoExtraIdx.push_back(I32s.size());
+			}
+
+			// phase/extra
+			if (Param.HasPhase && !I8s.empty())
+			{
+				AppendVec(C.PhaseExtra, I8s);
+				C.PhaseExtraIdx.push_back(si + 1);
+				C.PhaseExtraIdx.push_back(variant_offset);
+				C.PhaseExtraIdx.push_back(I8s.size());
+			}
+		}
+
+		// the other field -- format id
+		for (size_t i=0; i < fmt_ptr.size(); i++)
+		{
+			TVCF_Format *pFmt = fmt_ptr[i];
+
+			char *start = Text_pBegin;
+			while ((Text_pBegin<Text_pEnd) && (*Text_pBegin!=':'))
+				Text_pBegin ++;
+			char *end = Text_pBegin;
+
+			if ((Text_pBegin<Text_pEnd) && (*Text_pBegin==':'))
+				Text_pBegin ++;
+
+			if (pFmt && pFmt->import_flag)
+			{
+				switch (pFmt->type)
+				{
+				case FIELD_TYPE_INT:
+					pFmt->GetInt32s(start, end, si); break;
+				case FIELD_TYPE_FLOAT:
+					pFmt->GetFloats(start, end, si); break;
+				case FIELD_TYPE_STRING:
+					pFmt->GetStrings(start, end, si); break;
+				default:
+					throw ErrSeqArray("Invalid FORMAT Type.");
+				}
+				pFmt->Check(num_allele);
+			}
+		}
+	}
+
+	SaveSamples(C, num_allele, first_fmt_id_is_geno);
+}
+
+
+void CVCF_ChunkParser::ParseBCF(TVCF_Chunk &C, C_Int64 variant_index)
+{
+	const size_t num_ploidy = Param.NumPloidy;
+	const size_t num_ploidy_less = num_ploidy - 1;
+	const C_Int32 variant_offset = variant_index - Param.VariantStartIndex;
+	const vector<string> &dict = Param.BCFDict;
+	vector<TVCF_Info>::iterator pI;
+	vector<TVCF_Format*>::iterator pF;
+	int type;
+	size_t num;
+
+	// the shared and per-sample data of the record
+	const C_UInt8 *p = (const C_UInt8*)pCur;
+	const C_UInt8 *end_shared = p + 8 + BCF_U32(p);
+	const C_UInt8 *end = end_shared + BCF_U32(p + 4);
+	pCur = (char*)end;
+	if (end_shared < p + 32)
+		throw ErrSeqArray(ERR_BCF_RECORD);
+	p += 8;
+
+	// -----------------------------------------------------
+	// CHROM, POS, QUAL
+	C_Int32 chr = BCF_U32(p);
+	if ((chr < 0) || ((size_t)chr >= Param.BCFContig.size()))
+		throw ErrSeqArray("Invalid contig index (%d) in BCF record.", chr);
+	C.VarIdx.push_back(variant_index);
+	const string &chr_name = Param.BCFContig[chr];
+	PushChr(C, chr_name.c_str(), chr_name.c_str() + chr_name.size());
+	// 0-based position
+	C.Pos.push_back((C_Int32)BCF_U32(p + 4) + 1);
+	// the reference length is skipped
+	double qual;
+	if (!BCF_Float(p + 12, qual)) qual = R_NaN;
+	C.Qual.push_back(qual);
+
+	const size_t n_allele = BCF_U32(p + 16) >> 16;
+	const size_t n_info = BCF_U32(p + 16) & 0xFFFF;
+	const size_t n_fmt = BCF_U32(p + 20) >> 24;
+	const size_t n_sample = BCF_U32(p + 20) & 0xFFFFFF;
+	p += 24;
+
+	// -----------------------------------------------------
+	// ID
+	BCF_TypedStr(p, end_shared, cell);
+	C.RSID.push_back(cell);
+
+	// -----------------------------------------------------
+	// REF + ALT
+	string allele;
+	for (size_t i=0; i < n_allele; i++)
+	{
+		BCF_TypedStr(p, end_shared, cell);
+		if (i > 0) allele.push_back(',');
+		allele.append(cell);
+	}
+	if (n_allele <= 0) allele = ".";
+	C.Allele.push_back(allele);
+	int num_allele = getNumAllele(allele);
+
+	// -----------------------------------------------------
+	// FILTER, the level is assigned by the writer
+	p = BCF_Typed(p, end_shared, type, num);
+	cell.clear();
+	if (type != BCF_TYPE_NULL)
+	{
+		const size_t sz = BCF_TypeSize(type);
+		for (size_t i=0; i < num; i++, p+=sz)
+		{
+			C_Int32 k = BCF_Int(p, type);
+			if (k == BCF_INT_EOV) break;
+			if (k == NA_INTEGER) continue;
+			if ((k < 0) || ((size_t)k >= dict.size()))
+				throw ErrSeqArray("Invalid FILTER index (%d) in BCF record.", k);
+			if (!cell.empty()) cell.push_back(';');
+			cell.append(dict[k]);
+		}
+	}
+	C.Filter.push_back(cell);
+
+	// -----------------------------------------------------
+	// INFO
+
+	for (pI = info_list.begin(); pI != info_list.end(); pI++)
+		pI->used = false;
+
+	for (size_t i=0; i < n_info; i++)
+	{
+		C_Int32 key = BCF_TypedInt(p, end_shared);
+		if ((key < 0) || ((size_t)key >= dict.size()))
+			throw ErrSeqArray("Invalid INFO key (%d) in BCF record.", key);
+		p = BCF_Typed(p, end_shared, type, num);
+		const C_UInt8 *val = p;
+		p += num * BCF_TypeSize(type);
+
+		if (bcf_info[key] < 0)
+		{
+			if (info_missing.insert(dict[key]).second)
+				C.Warning.push_back(pair<int, string>(1, dict[key]));
+			continue;
+		}
+
+		// it is in the list of INFO variables
+		pI = info_list.begin() + bcf_info[key];
+		if (pI->used)
+		{
+			char buf[1024];
+			snprintf(buf, sizeof(buf),
+				"RECORD: %lld, ignore duplicated INFO ID (%s).",
+				(long long int)LineNum, pI->name.c_str());
+			C.Warning.push_back(pair<int, string>(0, buf));
+			continue;
+		}
+
+		if (pI->import_flag)
+		{
+			TVCF_Column &col = C.Info[bcf_info[key]];
+			C_Int32 len = -1;
+			switch (pI->type)
+			{
+			case FIELD_TYPE_INT:
+				BCF_Int32Array(val, type, num, I32s, cell);
+				len = pI->Index(I32s, num_allele, NA_INTEGER);
+				AppendVec(col.I32, I32s);
+				break;
+
+			case FIELD_TYPE_FLOAT:
+				BCF_FloatArray(val, type, num, F64s, cell);
+				len = pI->Index(F64s, num_allele, R_NaN);
+				AppendVec(col.F64, F64s);
+				break;
+
+			case FIELD_TYPE_FLAG:
+				col.I32.push_back(1);
+				break;
+
+			case FIELD_TYPE_STRING:
+				BCF_StringArray(val, type, num, S8s, cell);
+				len = pI->Index(S8s, num_allele, BlankString);
+				AppendVec(col.S8, S8s);
+				break;
+
+			default:
+				throw ErrSeqArray("Invalid INFO Type.");
+			}
+			if (len >= 0) col.Len.push_back(len);
+		}
+
+		pI->used = true;
+	}
+
+	// for which does not exist
+	FillInfo(C);
+
+	// -----------------------------------------------------
+	// FORMAT and samples, one typed vector per FORMAT key for all samples
+
+	if (SampleNum <= 0) return;
+	if (n_sample != SampleNum)
+	{
+		throw ErrSeqArray("The BCF record has %d sample(s), but it should be %d.",
+			(int)n_sample, (int)SampleNum);
+	}
+
+	for (pF = fmt_ptr.begin(); pF != fmt_ptr.end(); pF++)
+		(*pF)->Init();
+	fmt_ptr.clear();
+
+	bool first_fmt_id_is_geno = false;
+	p = end_shared;
+
+	for (size_t i=0; i < n_fmt; i++)
+	{
+		C_Int32 key = BCF_TypedInt(p, end);
+		if ((key < 0) || ((size_t)key >= dict.size()))
+			throw ErrSeqArray("Invalid FORMAT key (%d) in BCF record.", key);
+		p = BCF_Typed(p, end, type, num);
+		const size_t sz = num * BCF_TypeSize(type);
+		if ((sz > 0) && ((size_t)(end - p) / sz < SampleNum))
+			throw ErrSeqArray(ERR_BCF_RECORD);
+		const C_UInt8 *val = p;
+		p += sz * SampleNum;
+
+		if ((i == 0) && (dict[key] == Param.GenoID))
+		{
+			// the first field -- genotypes (GT)
+			first_fmt_id_is_geno = true;
+			if ((type < BCF_TYPE_INT8) || (type > BCF_TYPE_INT32))
+				throw ErrSeqArray("Genotypes should be integers in BCF record.");
+			const size_t tsize = BCF_TypeSize(type);
+			C_Int16 *pGeno = &Genotypes[0];
+			C_Int8 *pPhase = num_ploidy_less ? &Phases[0] : NULL;
+
+			for (size_t si=0; si < SampleNum; si++, val += sz)
+			{
+				// the fast path of a diploid genotype in 8-bit integers
+				if ((type == BCF_TYPE_INT8) && (num == 2) && (num_ploidy == 2))
+				{
+					C_Int8 a = val[0], b = val[1];
+					if ((a >= 0) && (b >= 0) && ((a >> 1) <= num_allele) &&
+						((b >> 1) <= num_allele))
+					{
+						pGeno[0] = (a >> 1) - 1; pGeno[1] = (b >> 1) - 1;
+						*pPhase = b & 0x01;
+						pGeno += 2; pPhase ++;
+						continue;
+					}
+				}
+
+				I32s.clear(); // genotype extra data
+				I8s.clear(); // phase extra data
+				size_t tmp_num_ploidy = 0;
+				C_Int8 *pPhaseEnd = pPhase + num_ploidy_less;
+
+				for (size_t j=0; j < num; j++)
+				{
+					C_Int32 v = BCF_Int(val + j*tsize, type);
+					if (v == BCF_INT_EOV) break;
+					C_Int16 g = BCF_Geno(v, num_allele);
+
+					tmp_num_ploidy ++;
+					if (tmp_num_ploidy <= num_ploidy)
+						*pGeno ++ = g;
+					else
+						I32s.push_back(g);
+
+					// the phase of the separator before the allele
+					if (j > 0)
+					{
+						C_Int8 ph = (v != NA_INTEGER) ? (v & 0x01) : 0;
+						if (j <= num_ploidy_less)
+							*pPhase ++ = ph;
+						else
+							I8s.push_back(ph);
+					}
+				}
+
+				for (size_t m=tmp_num_ploidy; m < num_ploidy; m++)
+					*pGeno ++ = -1;
+				while (pPhase < pPhaseEnd)
+					*pPhase ++ = 0;
+
+				// genotype/extra, e.g., triploid call: 0/0/1
+				if (!I32s.empty())
+				{
+					AppendVec(C.GenoExtra, I32s);
+					C.GenoExtraIdx.push_back(si + 1);
+					C.GenoExtraIdx.push_back(variant_offset);
+					C.GenoExtraIdx.push_back(I32s.size());
+				}
+
+				// phase/extra
+				if (Param.HasPhase && !I8s.empty())
+				{
+					AppendVec(C.PhaseExtra, I8s);
+					C.PhaseExtraIdx.push_back(si + 1);
+					C.PhaseExtraIdx.push_back(variant_offset);
+					C.PhaseExtraIdx.push_back(I8s.size());
+				}
+			}
+			continue;
+		}
+
+		// the other field -- format id
+		if (bcf_format[key] < 0)
+		{
+			if (format_missing.insert(dict[key]).second)
+				C.Warning.push_back(pair<int, string>(2, dict[key]));
+			continue;
+		}
+		TVCF_Format *pFmt = &format_list[bcf_format[key]];
+		pFmt->used = true;
+		fmt_ptr.push_back(pFmt);
+
+		if (pFmt->import_flag)
+		{
+			for (size_t si=0; si < SampleNum; si++, val += sz)
+			{
+				switch (pFmt->type)
+				{
+				case FIELD_TYPE_INT:
+					BCF_Int32Array(val, type, num, I32s, cell);
+					pFmt->SetInt32s(I32s, si); break;
+				case FIELD_TYPE_FLOAT:
+					BCF_FloatArray(val, type, num, F64s, cell);
+					pFmt->SetFloats(F64s, si); break;
+				case FIELD_TYPE_STRING:
+					BCF_StringArray(val, type, num, S8s, cell);
+					pFmt->SetStrings(S8s, si); break;
+				default:
+					throw ErrSeqArray("Invalid FORMAT Type.");
+				}
+				pFmt->Check(num_allele);
+			}
+		}
+	}
+
+	if (p != end)
+		throw ErrSeqArray(ERR_BCF_RECORD);
+
+	SaveSamples(C, num_allele, first_fmt_id_is_geno);
+}
+
+
+/// parse the chunks of lines in worker threads, and the chunks are returned
+/// in the order of submission (parsing in the calling thread if num_thread=1)
+class COREARRAY_DLL_LOCAL CVCF_ParallelParser
+{
+public:
+	CVCF_ParallelParser(const TVCF_ParseParam &param,
+		const vector<TVCF_Info> &info, const vector<TVCF_Format> &fmt,
+		int num_thread);
+	~CVCF_ParallelParser();
+
+	/// the number of chunks which can be submitted ahead
+	inline size_t NumSlot() const { return Chunks.size(); }
+	/// the chunk buffer for the i-th submission
+	inline TVCF_Chunk &Chunk(C_Int64 i) { return Chunks[i % Chunks.size()]; }
+	/// parse the i-th chunk in a worker thread
+	void Submit(C_Int64 i);
+	/// wait until the i-th chunk is parsed
+	TVCF_Chunk &Wait(C_Int64 i);
+
+private:
+	vector<TVCF_Chunk> Chunks;
+	vector<CVCF_ChunkParser*> Parsers;
+	vector<pthread_t> Threads;
+	pthread_mutex_t Mutex;
+	pthread_cond_t CondSubmit, CondParsed;
+	C_Int64 NumSubmit;  //< the number of submitted chunks
+	C_Int64 NumTaken;   //< the number of chunks taken by the threads
+	size_t NumRun;      //< the number of running threads
+	bool Stop;
+
+	void Run();
+	static void *thread_proc(void *ptr);
+};
+
+CVCF_ParallelParser::CVCF_ParallelParser(const TVCF_ParseParam &param,
+	const vector<TVCF_Info> &info, const vector<TVCF_Format> &fmt,
+	int num_thread)
+{
+	if (num_thread < 1) num_thread = 1;
+	NumSubmit = NumTaken = 0;
+	NumRun = 0;
+	Stop = false;
+	Chunks.resize(num_thread > 1 ? 2*num_thread : 1);
+	for (int i=0; i < num_thread; i++)
+		Parsers.push_back(new CVCF_ChunkParser(param, info, fmt));
+
+	pthread_mutex_init(&Mutex, NULL);
+	pthread_cond_init(&CondSubmit, NULL);
+	pthread_cond_init(&CondParsed, NULL);
+	for (int i=0; (num_thread > 1) && (i < num_thread); i++)
+	{
+		pthread_t th;
+		if (pthread_create(&th, NULL, thread_proc, this) != 0) break;
+		Threads.push_back(th);
+	}
+}
+
+CVCF_ParallelParser::~CVCF_ParallelParser()
+{
+	pthread_mutex_lock(&Mutex);
+	Stop = true;
+	pthread_cond_broadcast(&CondSubmit);
+	pthread_mutex_unlock(&Mutex);
+	for (size_t i=0; i < Threads.size(); i++)
+		pthread_join(Threads[i], NULL);
+	pthread_cond_destroy(&CondParsed);
+	pthread_cond_destroy(&CondSubmit);
+	pthread_mutex_destroy(&Mutex);
+	for (size_t i=0; i < Parsers.size(); i++)
+		delete Parsers[i];
+}
+
+void CVCF_ParallelParser::Submit(C_Int64 i)
+{
+	pthread_mutex_lock(&Mutex);
+	Chunk(i).Parsed = false;
+	NumSubmit = i + 1;
+	pthread_cond_signal(&CondSubmit);
+	pthread_mutex_unlock(&Mutex);
+}
+
+TVCF_Chunk &CVCF_ParallelParser::Wait(C_Int64 i)
+{
+	TVCF_Chunk &C = Chunk(i);
+	if (Threads.empty())
+	{
+		// no worker thread, parse it in the current thread
+		if (!C.Parsed)
+			{ Parsers[0]->Parse(C); C.Parsed = true; }
+		return C;
+	}
+	pthread_mutex_lock(&Mutex);
+	while (!C.Parsed)
+		pthread_cond_wait(&CondParsed, &Mutex);
+	pthread_mutex_unlock(&Mutex);
+	return C;
+}
+
+void CVCF_ParallelParser::Run()
+{
+	pthread_mutex_lock(&Mutex);
+	CVCF_ChunkParser *P = Parsers[NumRun++];
+	while (true)
+	{
+		while (!Stop && (NumTaken >= NumSubmit))
+			pthread_cond_wait(&CondSubmit, &Mutex);
+		if (Stop) break;
+		TVCF_Chunk &C = Chunk(NumTaken++);
+		pthread_mutex_unlock(&Mutex);
+
+		P->Parse(C);
+
+		pthread_mutex_lock(&Mutex);
+		C.Parsed = true;
+		pthread_cond_broadcast(&CondParsed);
+	}
+	pthread_mutex_unlock(&Mutex);
+}
+
+void *CVCF_ParallelParser::thread_proc(void *ptr)
+{
+	((CVCF_ParallelParser*)ptr)->Run();
+	return NULL;
+}
+
+
+/// the ordered writer appending the parsed chunks to GDS nodes, only in
+/// the main thread
+struct COREARRAY_DLL_LOCAL TVCF_Writer
+{
+	PdAbstractArray varIdx, varChr, varPos, varRSID, varAllele;
+	PdAbstractArray varQual, varFilter;
+	PdAbstractArray varGeno, varGenoLen, varGenoExtraIdx, varGenoExtra;
+	PdAbstractArray varPhase, varPhaseExtraIdx, varPhaseExtra;
+	vector<TVCF_Info> *InfoList;
+	vector<TVCF_Format> *FormatList;
+	vector<string> *FilterList;
+	set<string> InfoMissing, FormatMissing;
+	vector<string> *Warnings;  ///< raised after the worker threads stop
+	vector<C_Int32> I32s;
+
+	/// queue the warnings, and append the values if there is no error
+	void Write(TVCF_Chunk &C)
+	{
+		vector< pair<int, string> >::iterator w;
+		for (w = C.Warning.begin(); w != C.Warning.end(); w++)
+		{
+			switch (w->first)
+			{
+			case 0:
+				Warnings->push_back(w->second); break;
+			case 1:
+				if (InfoMissing.insert(w->second).second)
+				{
+					Warnings->push_back("Unknown INFO ID '" + w->second +
+						"' is ignored (it should be defined in the meta-information lines).");
+				}
+				break;
+			case 2:
+				if (FormatMissing.insert(w->second).second)
+				{
+					Warnings->push_back("Unknown FORMAT ID '" + w->second +
+						"' is ignored (it should be defined in the meta-information lines).");
+				}
+				break;
+			}
+		}
+		if (C.HasError) return;
+
+		const size_t n = C.VarIdx.size();
+		if (n <= 0) return;
+		GDS_Array_AppendData(varIdx, n, &C.VarIdx[0], svInt32);
+		GDS_Array_AppendData(varChr, n, &C.Chr[0], svStrUTF8);
+		GDS_Array_AppendData(varPos, n, &C.Pos[0], svInt32);
+		GDS_Array_AppendData(varRSID, n, &C.RSID[0], svStrUTF8);
+		GDS_Array_AppendData(varAllele, n, &C.Allele[0], svStrUTF8);
+		GDS_Array_AppendData(varQual, n, &C.Qual[0], svFloat64);
+
+		// filter levels in the order of appearance
+		I32s.resize(n);
+		for (size_t i=0; i < n; i++)
+		{
+			const string &s = C.Filter[i];
+			if (!s.empty())
+			{
+				vector<string>::iterator p =
+					std::find(FilterList->begin(), FilterList->end(), s);
+				if (p == FilterList->end())
+				{
+					FilterList->push_back(s);
+					I32s[i] = FilterList->size();
+				} else
+					I32s[i] = p - FilterList->begin() + 1;
+			} else
+				I32s[i] = NA_INTEGER;
+		}
+		GDS_Array_AppendData(varFilter, n, &I32s[0], svInt32);
+
+		// INFO
+	#if (GDS_TIMING == 3)
+		start_timing();
+	#endif
+		for (size_t i=0; i < InfoList->size(); i++)
+		{
+			TVCF_Info &I = (*InfoList)[i];
+			if (I.import_flag) C.Info[i].Append(I.data_obj, I.len_obj);
+		}
+	#if (GDS_TIMING == 3)
+		end_timing();
+	#endif
+
+		// genotypes and phases
+	#if (GDS_TIMING == 1)
+		start_timing();
+	#endif
+		if (!C.GenoLen.empty())
+		{
+			GDS_Array_AppendData(varGenoLen, C.GenoLen.size(), &C.GenoLen[0],
+				svInt32);
+		}
+		if (!C.Geno.empty())
+			GDS_Array_AppendData(varGeno, C.Geno.size(), &C.Geno[0], svInt16);
+		if (!C.GenoExtra.empty())
+		{
+			GDS_Array_AppendData(varGenoExtra, C.GenoExtra.size(),
+				&C.GenoExtra[0], svInt32);
+			GDS_Array_AppendData(varGenoExtraIdx, C.GenoExtraIdx.size(),
+				&C.GenoExtraIdx[0], svInt32);
+		}
+		if (varPhase && !C.Phase.empty())
+			GDS_Array_AppendData(varPhase, C.Phase.size(), &C.Phase[0], svInt8);
+		if (varPhase && !C.PhaseExtra.empty())
+		{
+			GDS_Array_AppendData(varPhaseExtra, C.PhaseExtra.size(),
+				&C.PhaseExtra[0], svInt8);
+			GDS_Array_AppendData(varPhaseExtraIdx, C.PhaseExtraIdx.size(),
+				&C.PhaseExtraIdx[0], svInt32);
+		}
+	#if (GDS_TIMING == 1)
+		end_timing();
+	#endif
+
+		// FORMAT
+	#if (GDS_TIMING == 2)
+		start_timing();
+	#endif
+		for (size_t i=0; i < FormatList->size(); i++)
+		{
+			TVCF_Format &F = (*FormatList)[i];
+			if (F.import_flag) C.Format[i].Append(F.data_obj, F.len_obj);
+		}
+	#if (GDS_TIMING == 2)
+		end_timing();
+	#endif
+	}
+};
+
+}
+
+
+extern "C"
+{
+using namespace SeqArray;
+
+// ===========================================================
+// Get the number of lines in a VCF file
+// ===========================================================
+
+COREARRAY_DLL_EXPORT SEXP SEQ_VCF_NumLines(SEXP File, SEXP SkipHead)
+{
+	Init_VCF_Buffer(File);
+
+	if (Rf_asLogical(SkipHead) == TRUE)
+	{
+		InitText();
+		// get the starting line
+		while (!VCF_EOF())
+		{
+			GetText(NA_INTEGER);
+			if (strncmp(Text_pBegin, "#CHROM", 6) == 0)
+			{
+				SkipLine();
+				break;
+			}
+		}
+		DoneText();
+	}
+
+	// get the number of left lines
+	C_Int64 n = 0;
+	while (!VCF_EOF())
+	{
+		n ++;
+		SkipLine();
+	}
+
+	Done_VCF_Buffer();
+	return ScalarReal(n);
+}
+
+
+/// get the genotypes of the first record in text (to determine the ploidy)
+/// and the number of records (NaN if 'GetNum' is not TRUE) in a BCF2 file
+COREARRAY_DLL_EXPORT SEXP SEQ_BCF_Scan(SEXP File, SEXP GetNum)
+{
+	const bool getnum = (Rf_asLogical(GetNum) == TRUE);
+
+	COREARRAY_TRY
+
+		Init_VCF_Buffer(File);
+		vector<string> dict, contig, geno;
+		Read_BCF_Header(dict, contig);
+
+		vector<char> buf;
+		C_Int64 n = 0;
+		if (Read_BCF_Record(buf, 0) > 0)
+		{
+			n ++;
+			const C_UInt8 *p = (const C_UInt8*)&buf[0];
+			const C_UInt8 *end = p + 8 + BCF_U32(p) + BCF_U32(p + 4);
+			if (BCF_U32(p) < 24) throw ErrSeqArray(ERR_BCF_RECORD);
+			const size_t n_fmt = BCF_U32(p + 28) >> 24;
+			const size_t n_sample = BCF_U32(p + 28) & 0xFFFFFF;
+			p += 8 + BCF_U32(p);
+			if (n_fmt > 0)
+			{
+				// the first FORMAT field
+				C_Int32 key = BCF_TypedInt(p, end);
+				int type; size_t num;
+				p = BCF_Typed(p, end, type, num);
+				const size_t sz = num * BCF_TypeSize(type);
+				if ((key >= 0) && ((size_t)key < dict.size()) &&
+					(dict[key] == "GT") && (type >= BCF_TYPE_INT8) &&
+					(type <= BCF_TYPE_INT32) && (sz > 0) &&
+					((size_t)(end - p) / sz >= n_sample))
+				{
+					char s[32];
+					for (size_t i=0; i < n_sample; i++, p += sz)
+					{
+						string g;
+						for (size_t j=0; j < num; j++)
+						{
+							C_Int32 v = BCF_Int(p + j*BCF_TypeSize(type), type);
+							if (v == BCF_INT_EOV) break;
+							if (v == NA_INTEGER) v = 0;
+							if (j > 0) g.push_back((v & 0x01) ? '|' : '/');
+							if ((v >> 1) > 0)
+							{
+								snprintf(s, sizeof(s), "%d", (v >> 1) - 1);
+								g.append(s);
+							} else
+								g.push_back('.');
+						}
+						geno.push_back(g);
+					}
+				}
+			}
+		}
+		if (getnum)
+		{
+			while (Read_BCF_Record(buf, 0) > 0) n ++;
+		}
+		Done_VCF_Buffer();
+
+		PROTECT(rv_ans = NEW_LIST(2));
+		SEXP geno_text = NEW_CHARACTER(geno.size());
+		SET_ELEMENT(rv_ans, 0, geno_text);
+		for (size_t i=0; i < geno.size(); i++)
+			SET_STRING_ELT(geno_text, i, mkChar(geno[i].c_str()));
+		SET_ELEMENT(rv_ans, 1, ScalarReal(getnum ? n : R_NaN));
+		UNPROTECT(1);
+
+	CORE_CATCH({
+		has_error = true;
+		Done_VCF_Buffer();
+	});
+	if (has_error) error(GDS_GetError());
+
+	return rv_ans;
+}
+
+
+
+/// get the windows of a BGZF file in the tabix or CSI index, i.e.,
+/// list(chr, pos, offset), in the order of the file, where 'pos' is the
+/// 1-based starting position and 'offset' is the compressed file offset
+COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Index(SEXP File, SEXP IndexFile)
+{
+	COREARRAY_TRY
+
+		CBGZF_Index Index(CHAR(STRING_ELT(IndexFile, 0)));
+		vector<string> names = Index.Names();
+		if (names.empty())
+		{
+			// the contig names in the BCF2 header
+			vector<string> dict;
+			Init_VCF_Buffer(File);
+			Read_BCF_Header(dict, names);
+			Done_VCF_Buffer();
+		}
+		if ((int)names.size() < Index.NumRef())
+			throw ErrSeqArray("No sequence name in the index.");
+
+		// the sequences in the order of the file
+		vector< vector<C_Int64> > pos(Index.NumRef());
+		vector< vector<C_UInt64> > voff(Index.NumRef());
+		vector< pair<C_UInt64, int> > ord;
+		size_t num = 0;
+		for (int i=0; i < Index.NumRef(); i++)
+		{
+			Index.Windows(i, pos[i], voff[i]);
+			if (!voff[i].empty())
+			{
+				ord.push_back(pair<C_UInt64, int>(voff[i][0], i));
+				num += voff[i].size();
+			}
+		}
+		sort(ord.begin(), ord.end());
+
+		PROTECT(rv_ans = NEW_LIST(3));
+		SEXP chr = NEW_CHARACTER(num);
+		SET_ELEMENT(rv_ans, 0, chr);
+		SEXP pos_array = NEW_NUMERIC(num);
+		SET_ELEMENT(rv_ans, 1, pos_array);
+		SEXP off_array = NEW_NUMERIC(num);
+		SET_ELEMENT(rv_ans, 2, off_array);
+		size_t k = 0;
+		for (size_t i=0; i < ord.size(); i++)
+		{
+			const int r = ord[i].second;
+			SEXP nm = mkChar(names[r].c_str());
+			for (size_t j=0; j < voff[r].size(); j++, k++)
+			{
+				SET_STRING_ELT(chr, k, nm);
+				REAL(pos_array)[k] = pos[r][j] + 1;
+				REAL(off_array)[k] = voff[r][j] >> 16;
+			}
+		}
+		UNPROTECT(1);
+
+	CORE_CATCH({
+		has_error = true;
+		Done_VCF_Buffer();
+	});
+	if (has_error) error(GDS_GetError());
+
+	return rv_ans;
+}
+
+
+
+// ===========================================================
+// Split VCF files
+// ===========================================================
+
+COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Split(SEXP start, SEXP count, SEXP pnum,
+	SEXP multiple)
+{
+	int num = Rf_asInteger(pnum);
+	if (num <= 0) error("'pnum' should be > 0.");
+	int multi = Rf_asInteger(multiple);
+	if (multi <= 0) error("'multiple' should be > 0.");
+	SEXP ans = PROTECT(NEW_LIST(2));
+	SEXP start_array = PROTECT(NEW_NUMERIC(num));
+	SEXP count_array = PROTECT(NEW_NUMERIC(num));
+	SET_ELEMENT(ans, 0, start_array);
+	SET_ELEMENT(ans, 1, count_array);
+
+	double cnt = Rf_asReal(count);
+	double scale = cnt / num;
+	double st = Rf_asReal(start);
+	for (int i=0; i < num; i++)
+	{
+		double old_st = REAL(start_array)[i] = round(st);
+		st += scale;
+		C_Int64 n = (C_Int64)(round(st) - old_st);
+		if (n % multi)  // should be a multiple of 'multi'
+		{
+			int m = ((n / multi) + 1) * multi;
+			st += m - n;
+			n = m;
+		}
+		if ((old_st + n) > (cnt + 1))
+			n = round(cnt + 1 - old_st);
+		REAL(count_array)[i] = (n >= 0) ? n : 0;
+	}
+
+	UNPROTECT(3);
+	return ans;
+}
+
+
+
+// ===========================================================
+// Conversion: VCF --> GDS
+// ===========================================================
+
+/// the arguments and the objects with worker threads in SEQ_VCF_Parse(),
+/// the objects are released by VCF_Parse_Cleanup() even if R jumps out
+/// (an R error, a warning converted to an error or a user interrupt)
+struct COREARRAY_DLL_LOCAL TVCF_ParseArgs
+{
+	SEXP vcf_fn, header, gds_root, param, line_cnt;
+	CVCF_ParallelParser *Parser;  ///< the parser, or NULL
+	CVCF_RegionFilter *Region;    ///< the genomic regions, or NULL
+	vector<string> Warnings;      ///< raised after the threads stop
+	bool HasError;                ///< true if fails, see GDS_GetError()
+};
+
+static void VCF_Parse_Cleanup(void *ptr)
+{
+	TVCF_ParseArgs *p = (TVCF_ParseArgs*)ptr;
+	// join the worker threads
+	if (p->Parser)
+		{ delete p->Parser; p->Parser = NULL; }
+	if (p->Region)
+		{ delete p->Region; p->Region = NULL; }
+	// join the inflating threads of the native reader
+	Done_VCF_Buffer();
+}
+
+static SEXP VCF_Parse(void *ptr)
+{
+	TVCF_ParseArgs *args = (TVCF_ParseArgs*)ptr;
+	SEXP header = args->header, gds_root = args->gds_root;
+	SEXP param = args->param, line_cnt = args->line_cnt;
+	const char *fn = CHAR(STRING_ELT(args->vcf_fn, 0));
+	// true if the error message has the line and column numbers
+	bool chunk_error = false;
+	// true if reading BCF2 records, and the line numbers are record numbers
+	bool is_bcf = false;
+	// the genomic regions using the index, or NULL for all records
+	CVCF_RegionFilter *&region = args->Region;
+
+	COREARRAY_TRY
+
+	#if (GDS_TIMING > 0)
+		_timing_ = 0;
 		clock_t _start_time = clock();
 	#endif
 
@@ -1162,12 +3469,19 @@ COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
 		C_Int64 variant_start = (C_Int64)Rf_asReal(RGetListElement(param, "start"));
 		// variant count
 		C_Int64 variant_count = (C_Int64)Rf_asReal(RGetListElement(param, "count"));
-		// input file
-		Init_VCF_Buffer(RGetListElement(param, "infile"));
 		// chromosome prefix
 		SEXP ChrPrefix = RGetListElement(param, "chr.prefix");
 		// progress file
 		SEXP progfile = RGetListElement(param, "progfile");
+		// the number of parsing threads
+		int num_thread = Rf_asInteger(RGetListElement(param, "num.thread"));
+		if (num_thread == NA_INTEGER) num_thread = 1;
+		// the maximum number of variants buffered before appending
+		int batch_size = Rf_asInteger(RGetListElement(param, "batch.size"));
+		if ((batch_size == NA_INTEGER) || (batch_size < 1))
+			batch_size = VCF_BATCH_SIZE;
+		// input file, a connection or a file name read by the native reader
+		Init_VCF_Buffer(RGetListElement(param, "infile"), num_thread);
 		// verbose
 		// bool Verbose = (LOGICAL(RGetListElement(param, "verbose"))[0] == TRUE);
 
@@ -1176,9 +3490,6 @@ COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
 		if (num_ploidy <= 0)
 			throw ErrSeqArray("Invalid header$ploidy: %d.", (int)num_ploidy);
 
-		size_t num_ploidy_less = num_ploidy - 1;
-		size_t num_samp_ploidy = SampleNum * num_ploidy;
-		size_t num_samp_ploidy_less = SampleNum * num_ploidy_less;
 
 		// filter level list
 		vector<string> filter_list;
@@ -1275,39 +3586,6 @@ COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
 		C_Int64 variant_index = (C_Int64)Rf_asReal(line_cnt);
 		C_Int64 variant_start_index = variant_index;
 
-		// the string buffer
-		string cell;
-		cell.reserve(1024);
-
-		// the numeric buffer
-		vector<C_Int8> I8s;
-		I8s.reserve(SampleNum);
-
-		C_Int32 I32;
-		vector<C_Int32> I32s;
-		I32s.reserve(SampleNum);
-
-		C_Float64 F64;
-		vector<C_Float64> F64s;
-		F64s.reserve(SampleNum);
-
-		// the string buffer
-		vector<string> S8s;
-		S8s.reserve(SampleNum);
-
-		// genotypes
-		vector<C_Int16> Genotypes;
-		Genotypes.resize(num_samp_ploidy);
-
-		// phase
-		vector<C_Int8> Phases;
-		Phases.resize(num_samp_ploidy_less);
-
-		vector< TVCF_Info >::iterator pI;
-		vector< TVCF_Format* >::iterator pF;
-		vector< TVCF_Format* > fmt_ptr;
-		fmt_ptr.reserve(format_list.size());
-
 		// chromosome prefix
 		vector<const char *> ChrPref;
 		for (size_t i=0; i < RLength(ChrPrefix); i++)
@@ -1319,550 +3597,132 @@ COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
 
 		InitText();
 
-		if (!Rf_isNull(progfile))
-		{
-			while (!VCF_EOF())
-			{
-				GetText(NA_INTEGER);
-				if (strncmp(Text_pBegin, "#CHROM", 6) == 0)
-				{
-					SkipLine();
-					break;
-				}
-			}
-		}
-
-		while (!VCF_EOF() && (variant_index+1 < variant_start))
-		{
-			variant_index ++;
-			SkipLine();
-		}
-
-
-		// =========================================================
-		// parse the context
-
-		// progress information
-		CProgress Progress(variant_index - variant_start + 1, variant_count,
-			progfile, true);
+		// BCF2 records instead of text lines, read by the native reader
+		is_bcf = VCF_Reader && !VCF_EOF() &&
+			(VCF_Buffer_EndPtr - VCF_Buffer_Ptr >= 4) &&
+			(memcmp(VCF_Buffer_Ptr, "BCF\2", 4) == 0);
+		vector<string> bcf_dict, bcf_contig;
 
-		while (!VCF_EOF())
+		if (is_bcf)
 		{
-			// -----------------------------------------------------
-			// column 1: CHROM
-			GetText(FALSE);
-
-			// -----------------------------------------------------
-			// variant id
-			variant_index ++;
-			if (variant_count >= 0)
-			{
-				if (variant_index >= variant_start+variant_count)
-				{
-					variant_index --;
-					break;
-				}
-			}
-			I32 = variant_index;
-			GDS_Array_AppendData(varIdx, 1, &I32, svInt32);
-
-			// column 1: CHROM
-			for (vector<const char *>::iterator p=ChrPref.begin(); p != ChrPref.end(); p++)
-			{
-				if (StrCaseCmp(*p, Text_pBegin, Text_pEnd-Text_pBegin))
-				{
-					Text_pBegin += strlen(*p);
-					break;
-				}
-			}
-			GDS_Array_AppendStrLen(varChr, Text_pBegin, Text_pEnd-Text_pBegin);
-
-
-			// -----------------------------------------------------
-			// column 2: POS
-			GetText(FALSE);
-			I32 = getInt32(Text_pBegin, Text_pEnd);
-			GDS_Array_AppendData(varPos, 1, &I32, svInt32);
-
-
-			// -----------------------------------------------------
-			// column 3: ID
-			GetText(FALSE);
-			SkipTextWithDot();
-			GDS_Array_AppendStrLen(varRSID, Text_pBegin, Text_pEnd-Text_pBegin);
-
-
-			// -----------------------------------------------------
-			// column 4 & 5: REF + ALT 
-			GetText(FALSE);  // REF
-			SkipWhiteSpace();
-			cell.assign(Text_pBegin, Text_pEnd);
-
-			GetText(FALSE);  // ALT
-			SkipTextWithDot();
-			if (Text_pEnd > Text_pBegin)
-			{
-				cell.push_back(',');
-				cell.append(Text_pBegin, Text_pEnd);
-			}
-
-			GDS_Array_AppendData(varAllele, 1, &cell, svStrUTF8);
-
-			// determine how many alleles
-			int num_allele;
-			if (cell != "." && cell != ".,.")
-			{
-				num_allele = 0;
-				for (const char *p = cell.c_str(); *p; )
-				{
-					num_allele ++;
-					while (*p && (*p != ',')) p ++;
-					if (*p == ',') p ++;
-				}
-			} else {
-				num_allele = INT_MAX;
-			}
-
-
-			// -----------------------------------------------------
-			// column 6: QUAL
-			GetText(FALSE);
-			F64 = getFloat(Text_pBegin, Text_pEnd);
-			GDS_Array_AppendData(varQual, 1, &F64, svFloat64);
-
-
-			// -----------------------------------------------------
-			// column 7: FILTER
-			GetText(FALSE);
-			SkipTextWithDot();
-			if (Text_pBegin < Text_pEnd)
-			{
-				cell.assign(Text_pBegin, Text_pEnd);
-				vector<string>::iterator p =
-					std::find(filter_list.begin(), filter_list.end(), cell);
-				if (p == filter_list.end())
-				{
-					filter_list.push_back(cell);
-					I32 = filter_list.size();
-				} else
-					I32 = p - filter_list.begin() + 1;
-			} else
-				I32 = NA_INTEGER;
-			GDS_Array_AppendData(varFilter, 1, &I32, svInt32);
-
-
-			// -----------------------------------------------------
-			// column 8: INFO
-
-		#if (GDS_TIMING == 3)
-			start_timing();
-		#endif
-
-			// initialize
-			for (pI = info_list.begin(); pI != info_list.end(); pI++)
-				pI->used = false;
-			GetText(SampleNum<=0);
-			SkipTextWithDot();
-
-			// parse
-			while (Text_pBegin < Text_pEnd)
+			// the line numbers are the record numbers
+			Read_BCF_Header(bcf_dict, bcf_contig);
+			vector<char> buf;
+			while ((variant_index+1 < variant_start) && Read_BCF_Record(buf, 0))
 			{
-				// format: name=val | name
-				char *s, *p;
-				s = p = Text_pBegin;
-				while ((p < Text_pEnd) && (*p != ';') && (*p != '='))
-					p ++;
-				Text_pBegin = p;
-
-				// variable name
-				while ((s < p) && (*(p-1) == ' ')) p --;
-				cell.assign(s, p);
-
-				// variable value
-				char *ValBegin, *ValEnd;
-				ValBegin = ValEnd = p = Text_pBegin;
-				if (p < Text_pEnd)
-				{
-					if (*p == '=')
-					{
-						p ++;
-						while ((p < Text_pEnd) && (*p == ' ')) p ++;
-						ValBegin = p;
-						while ((p < Text_pEnd) && (*p != ';')) p ++;
-						Text_pBegin = p;
-						if (p < Text_pEnd) Text_pBegin ++;
-						while ((ValBegin < p) && (*(p-1) == ' ')) p --;
-						ValEnd = p;
-					} else if (*p == ';')
-						Text_pBegin = p + 1;
-					else
-						Text_pBegin = p;
-				}
-
-				for (pI=info_list.begin(); pI != info_list.end(); pI++)
-				{
-					if (pI->name == cell)
-						break;
-				}
-
-				if (pI != info_list.end())
-				{
-					// it is in the list of INFO variables
-					if (pI->used)
-					{
-						Rf_warning("LINE: %d, ignore duplicated INFO ID (%s).",
-							VCF_LineNum, cell.c_str());
-						continue;
-					}
-
-					if (pI->import_flag)
-					{
-						switch (pI->type)
-						{
-						case FIELD_TYPE_INT:
-							getInt32Array(ValBegin, ValEnd, I32s);
-							pI->Index(I32s, num_allele, NA_INTEGER);
-							GDS_Array_AppendData(pI->data_obj, I32s.size(),
-								&(I32s[0]), svInt32);
-							break;
-
-						case FIELD_TYPE_FLOAT:
-							getFloatArray(ValBegin, ValEnd, F64s);
-							pI->Index(F64s, num_allele, R_NaN);
-							GDS_Array_AppendData(pI->data_obj, F64s.size(),
-								&(F64s[0]), svFloat64);
-							break;
-
-						case FIELD_TYPE_FLAG:
-							if (ValBegin < ValEnd)
-							{
-								throw ErrSeqArray(
-									"INFO ID '%s' should be a flag without values.",
-									cell.c_str());
-							}
-							I32 = 1;
-							GDS_Array_AppendData(pI->data_obj, 1, &I32, svInt32);
-							break;
-
-						case FIELD_TYPE_STRING:
-							getStringArray(ValBegin, ValEnd, S8s);
-							pI->Index(S8s, num_allele, BlankString);
-							GDS_Array_AppendData(pI->data_obj, S8s.size(),
-								&(S8s[0]), svStrUTF8);
-							break;
-
-						default:
-							throw ErrSeqArray("Invalid INFO Type.");
-						}
-					}
-
-					pI->used = true;
-				} else {
-					set<string>::iterator it = info_missing.find(cell);
-					if (it == info_missing.end())
-					{
-						info_missing.insert(cell);
-						Rf_warning("Unknown INFO ID '%s' is ignored (it should be defined in the meta-information lines).",
-							cell.c_str());
-					}
-				}
+				variant_index ++;
+				VCF_NextLineNum ++;
 			}
-
-			// for which does not exist
-			for (pI = info_list.begin(); pI != info_list.end(); pI++)
+		} else {
+			if (!Rf_isNull(progfile))
 			{
-				if (!pI->used && pI->import_flag)
+				while (!VCF_EOF())
 				{
-					switch (pI->type)
+					GetText(NA_INTEGER);
+					if (strncmp(Text_pBegin, "#CHROM", 6) == 0)
 					{
-					case FIELD_TYPE_INT:
-						pI->Fill(I32s, NA_INTEGER);
-						break;
-					case FIELD_TYPE_FLOAT:
-						pI->Fill(F64s, R_NaN);
+						SkipLine();
 						break;
-					case FIELD_TYPE_FLAG:
-						I32 = 0;
-						GDS_Array_AppendData(pI->data_obj, 1, &I32, svInt32);
-						break;
-					case FIELD_TYPE_STRING:
-						pI->Fill(S8s, BlankString);
-						break;
-					default:
-						throw ErrSeqArray("Invalid INFO Type.");
 					}
-					pI->used = true;
 				}
 			}
 
-		#if (GDS_TIMING == 3)
-			end_timing();
-		#endif
-
-
-			// -----------------------------------------------------
-			// column 9: FORMAT
-
-			if (SampleNum <= 0) continue;
-
-			// initialize
-			for (pF = fmt_ptr.begin(); pF != fmt_ptr.end(); pF++)
-				(*pF)->Init();
-			GetText(FALSE);
-
-			bool first_fmt_id_flag = true;
-			bool first_fmt_id_is_geno = false;
-			fmt_ptr.clear();
-
-			// parse
-			while (Text_pBegin < Text_pEnd)
+			while (!VCF_EOF() && (variant_index+1 < variant_start))
 			{
-				while ((Text_pBegin<Text_pEnd) && (*Text_pBegin==' '))
-					Text_pBegin ++;
-
-				const char *start = Text_pBegin;
-				while ((Text_pBegin<Text_pEnd) && (*Text_pBegin!=':'))
-					Text_pBegin ++;
-
-				const char *end = Text_pBegin;
-				while ((start < end) && (*(end-1) == ' '))
-					end --;
-				cell.assign(start, end);
-
-				if ((Text_pBegin<Text_pEnd) && (*Text_pBegin==':'))
-					Text_pBegin ++;
-
-				if (first_fmt_id_flag)
-				{
-					first_fmt_id_flag = false;
-					// genotype ID
-					first_fmt_id_is_geno = (cell == geno_id);
-					if (first_fmt_id_is_geno) continue;
-				}
-
-				// find ID
-				vector<TVCF_Format>::iterator p;
-				for (p=format_list.begin(); p != format_list.end(); p++)
-				{
-					if (p->name == cell)
-						{ p->used = true; break; }
-				}
-				if (p == format_list.end())
-				{
-					set<string>::iterator it = format_missing.find(cell);
-					if (it == format_missing.end())
-					{
-						format_missing.insert(cell);
-						warning("Unknown FORMAT ID '%s' is ignored (it should be defined in the meta-information lines).",
-							cell.c_str());
-					}
-				} else {
-					// push
-					fmt_ptr.push_back(&(*p));
-				}
+				variant_index ++;
+				SkipLine();
 			}
+		}
 
+		// seek to the first region
+		SEXP Region = RGetListElement(param, "region");
+		if (!Rf_isNull(Region))
+		{
+			if (!VCF_Reader || (VCF_Reader->FileType()!=CBGZF_Reader::ftBGZF))
+				throw ErrSeqArray("'region' needs a BGZF-compressed file.");
+			region = new CVCF_RegionFilter(Region, bcf_contig, args->Warnings);
+			region->Next();
+		}
 
-			// -----------------------------------------------------
-			// Columns for samples
-
-			// pointer to genotype buffer
-			C_Int16 *pGeno = &Genotypes[0];
-			// pointer to phase buffer
-			C_Int8 *pPhase = &Phases[0];
-
-			// for-loop
-			for (size_t si=0; si < SampleNum; si ++)
-			{
-				// read
-				GetText(si >= (SampleNum-1));
-
-				// skip whitespace
-				while ((Text_pBegin<Text_pEnd) && (*Text_pBegin==' '))
-					Text_pBegin ++;
-
-				if (first_fmt_id_is_geno)
-				{
-					// -------------------------------------------------
-					// the first field -- genotypes (GT)
-
-					const char *p = Text_pBegin;
-					while ((Text_pBegin<Text_pEnd) && (*Text_pBegin!=':'))
-						Text_pBegin ++;
-					const char *end = Text_pBegin;
-
-					if ((Text_pBegin<Text_pEnd) && (*Text_pBegin==':'))
-						Text_pBegin ++;
-
-					I32s.clear(); // genotype extra data
-					I8s.clear(); // phase extra data
-					size_t tmp_num_ploidy = 0;
-
-					while (p < end)
-					{
-						const char *start = p;
-						while ((p<end) && (*p!='|') && (*p!='/'))
-							p ++;
-						C_Int16 g = getGeno(start, p, num_allele);
-
-						tmp_num_ploidy ++;
-						if (tmp_num_ploidy <= num_ploidy)
-							*pGeno ++ = g;
-						else
-							I32s.push_back(g);
-
-						if (p < end)
-						{
-							C_Int8 v = 0;
-							if (*p == '|')
-							{
-								v = 1; p ++;
-							} else if (*p == '/')
-							{
-								v = 0; p ++;
-							}
-							if (tmp_num_ploidy <= num_ploidy_less)
-								*pPhase ++ = v;
-							else
-								I8s.push_back(v);
-						}
-					}
-
-					for (size_t m=tmp_num_ploidy; m < num_ploidy; m++)
-						*pGeno ++ = -1;
-					for (size_t m=tmp_num_ploidy; m < num_ploidy_less; m++)
-						*pPhase ++ = 0;
-
-					// check "genotype/extra", e.g., triploid call: 0/0/1
-					if (!I32s.empty())
-					{
-						GDS_Array_AppendData(varGenoExtra, I32s.size(), &(I32s[0]), svInt32);
-						I32 = si + 1;
-						GDS_Array_AppendData(varGenoExtraIdx, 1, &I32, svInt32);
-						I32 = variant_index - variant_start_index;
-						GDS_Array_AppendData(varGenoExtraIdx, 1, &I32, svInt32);
-						I32 = I32s.size();
-						GDS_Array_AppendData(varGenoExtraIdx, 1, &I32, svInt32);
-					}
-
-					// check "phase/extra", e.g., triploid call: 0/0/1
-					if (varPhase && !I8s.empty())
-					{
-						GDS_Array_AppendData(varPhaseExtra, I8s.size(), &(I8s[0]), svInt8);
-						I32 = si + 1;
-						GDS_Array_AppendData(varPhaseExtraIdx, 1, &I32, svInt32);
-						I32 = variant_index - variant_start_index;
-						GDS_Array_AppendData(varPhaseExtraIdx, 1, &I32, svInt32);
-						I32 = I8s.size();
-						GDS_Array_AppendData(varPhaseExtraIdx, 1, &I32, svInt32);
-					}
-				}
-
-				// -------------------------------------------------
-				// the other field -- format id
-				for (size_t i=0; i < fmt_ptr.size(); i++)
-				{
-					TVCF_Format *pFmt = fmt_ptr[i];
-
-					char *start = Text_pBegin;
-					while ((Text_pBegin<Text_pEnd) && (*Text_pBegin!=':'))
-						Text_pBegin ++;
-					char *end = Text_pBegin;
-
-					if ((Text_pBegin<Text_pEnd) && (*Text_pBegin==':'))
-						Text_pBegin ++;
-
-					// parse the field
-					if (pFmt && pFmt->import_flag)
-					{
-					#if (GDS_TIMING == 1)
-						start_timing();
-					#endif
-
-						switch (pFmt->type)
-						{
-						case FIELD_TYPE_INT:
-							pFmt->GetInt32s(start, end, si); break;
-						case FIELD_TYPE_FLOAT:
-							pFmt->GetFloats(start, end, si); break;
-						case FIELD_TYPE_STRING:
-							pFmt->GetStrings(start, end, si); break;
-						default:
-							throw ErrSeqArray("Invalid FORMAT Type.");
-						}
-						pFmt->Check(num_allele);
 
-					#if (GDS_TIMING == 1)
-						end_timing();
-					#endif
-					}
-				}
-			}
+		// =========================================================
+		// parse the context
 
+		// progress information
+		CProgress Progress(variant_index - variant_start + 1, variant_count,
+			progfile, true);
 
-			if (first_fmt_id_is_geno)
+		// the main thread reads line-aligned chunks and writes the parsed
+		// chunks in order, while the worker threads parse the chunks
+		TVCF_ParseParam PP;
+		PP.FileName = fn;
+		PP.GenoID = geno_id;
+		PP.NumPloidy = num_ploidy;
+		PP.HasPhase = (varPhase != NULL);
+		PP.VariantStartIndex = variant_start_index;
+		PP.ChrPrefix = ChrPref;
+		PP.IsBCF = is_bcf;
+		PP.BCFDict = bcf_dict;
+		PP.BCFContig = bcf_contig;
+
+		TVCF_Writer Writer;
+		Writer.varIdx = varIdx; Writer.varChr = varChr;
+		Writer.varPos = varPos; Writer.varRSID = varRSID;
+		Writer.varAllele = varAllele; Writer.varQual = varQual;
+		Writer.varFilter = varFilter;
+		Writer.varGeno = varGeno; Writer.varGenoLen = varGenoLen;
+		Writer.varGenoExtraIdx = varGenoExtraIdx;
+		Writer.varGenoExtra = varGenoExtra;
+		Writer.varPhase = varPhase;
+		Writer.varPhaseExtraIdx = varPhaseExtraIdx;
+		Writer.varPhaseExtra = varPhaseExtra;
+		Writer.InfoList = &info_list;
+		Writer.FormatList = &format_list;
+		Writer.FilterList = &filter_list;
+		Writer.Warnings = &args->Warnings;
+
+		args->Parser = new CVCF_ParallelParser(PP, info_list, format_list,
+			num_thread);
+		CVCF_ParallelParser &Parser = *args->Parser;
+		C_Int64 n_submit=0, n_write=0;
+		bool eof = false;
+
+		while (true)
+		{
+			// fill the free chunks, each of them has no more than
+			//   'batch_size' lines
+			while (!eof && (n_submit < n_write + (C_Int64)Parser.NumSlot()))
 			{
-				// -------------------------------------------------
-				// write genotypes
-
-				// need to identify num_allele if missing
-				if (num_allele == INT_MAX)
-				{
-					num_allele = 0;
-					C_Int16 *p = &Genotypes[0];
-					for (size_t n=num_samp_ploidy; n > 0; n--, p++)
-					{
-						if ((*p >= 0) && (*p > num_allele))
-							num_allele = *p;
-					}
-					num_allele ++;
-				}
-
-				// determine how many bits
-				int num_bits = 2;
-				// plus ONE for missing value
-				while ((num_allele + 1) > (1 << num_bits))
-					num_bits += 2;
-				I32 = num_bits >> 1;
-				GDS_Array_AppendData(varGenoLen, 1, &I32, svInt32);
-
-				for (int bits=0; bits < num_bits; )
-				{
-					GDS_Array_AppendData(varGeno, num_samp_ploidy, &Genotypes[0],
-						svInt16);
-					bits += 2;
-					if (bits < num_bits)
-						vec_i16_shr_b2(&Genotypes[0], num_samp_ploidy);
-				}
-
-				// -------------------------------------------------
-				// write phase information
-
-				if (varPhase)
+				C_Int64 max_line = batch_size;
+				if (variant_count >= 0)
 				{
-					GDS_Array_AppendData(varPhase, num_samp_ploidy_less,
-						&(Phases[0]), svInt8);
+					C_Int64 n = variant_start + variant_count - 1 - variant_index;
+					if (n < max_line) max_line = n;
 				}
+				if ((max_line <= 0) || VCF_EOF(region))
+					{ eof = true; break; }
+				TVCF_Chunk &C = Parser.Chunk(n_submit);
+				if (is_bcf)
+					Read_BCF_Chunk(C, max_line, region);
+				else
+					Read_VCF_Chunk(C, max_line, region);
+				if (C.NumLine <= 0)
+					{ eof = true; break; }
+				C.VariantStart = variant_index;
+				variant_index += C.NumLine;
+				Parser.Submit(n_submit++);
 			}
+			if (n_write >= n_submit) break;
 
-
-			// -------------------------------------------------
-			// for-loop all format IDs: write
-
-		#if (GDS_TIMING == 2)
-			start_timing();
-		#endif
-			for (vector<TVCF_Format>::iterator p = format_list.begin();
-				p != format_list.end(); p ++)
+			// write the next chunk in order, one append per column
+			TVCF_Chunk &C = Parser.Wait(n_write++);
+			Writer.Write(C);
+			if (C.HasError)
 			{
-				if (p->import_flag) p->SaveToGDS();
+				chunk_error = true;
+				throw ErrSeqArray(C.ErrMsg);
 			}
-		#if (GDS_TIMING == 2)
-			end_timing();
-		#endif
-
-			// update progress
-			Progress.Forward();
+			Progress.Forward(C.NumLine);
 		}
 
 		// set returned value: levels(filter)
@@ -1875,7 +3735,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
 
 		UNPROTECT(nProtected);
 
-		Done_VCF_Buffer();
+		VCF_Parse_Cleanup(args);
 		DoneText();
 
 
@@ -1887,23 +3747,58 @@ COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
 
 	CORE_CATCH({
 		char buf[4096];
-		if ((VCF_ColumnNum > 0) && (save_pBegin < save_pEnd))
+		if (chunk_error)
+		{
+			snprintf(buf, sizeof(buf), "%s", GDS_GetError());
+		} else if ((VCF_ColumnNum > 0) && (save_pBegin < save_pEnd))
 		{
 			snprintf(buf, sizeof(buf),
 				"%s\nFILE: %s\nLINE: %lld, COLUMN: %d, %s\n",
 				GDS_GetError(), fn, (long long int)VCF_LineNum, VCF_ColumnNum,
 				string(save_pBegin, save_pEnd).c_str());
 		} else {
-			snprintf(buf, sizeof(buf), "%s\nFILE: %s\nLINE: %lld\n",
-				GDS_GetError(), fn, (long long int)VCF_LineNum);
+			snprintf(buf, sizeof(buf), "%s\nFILE: %s\n%s: %lld\n",
+				GDS_GetError(), fn, is_bcf ? "RECORD" : "LINE",
+				(long long int)VCF_LineNum);
 		}
 		GDS_SetError(buf);
 		has_error = true;
+		// stop the threads of the parser and the native reader
+		VCF_Parse_Cleanup(args);
 	});
-	if (has_error) error(GDS_GetError());
+	args->HasError = has_error;
 
 	// output
 	return rv_ans;
 }
 
+/// VCF format --> SeqArray GDS format
+COREARRAY_DLL_EXPORT SEXP SEQ_VCF_Parse(SEXP vcf_fn, SEXP header,
+	SEXP gds_root, SEXP param, SEXP line_cnt, SEXP rho)
+{
+	TVCF_ParseArgs args;
+	args.vcf_fn = vcf_fn; args.header = header; args.gds_root = gds_root;
+	args.param = param; args.line_cnt = line_cnt;
+	args.Parser = NULL; args.Region = NULL;
+	args.HasError = false;
+
+	SEXP rv_ans = PROTECT(R_ExecWithCleanup(VCF_Parse, &args,
+		VCF_Parse_Cleanup, &args));
+
+	// no worker thread now, and no C++ object is alive when R jumps out
+	char err[4096] = { 0 };
+	if (args.HasError)
+		snprintf(err, sizeof(err), "%s", GDS_GetError());
+	SEXP warn = PROTECT(NEW_CHARACTER(args.Warnings.size()));
+	for (size_t i=0; i < args.Warnings.size(); i++)
+		SET_STRING_ELT(warn, i, mkChar(args.Warnings[i].c_str()));
+	vector<string>().swap(args.Warnings);
+	for (R_xlen_t i=0; i < XLENGTH(warn); i++)
+		Rf_warning("%s", CHAR(STRING_ELT(warn, i)));
+	if (args.HasError) error("%s", err);
+
+	UNPROTECT(2);
+	return rv_ans;
+}
+
 } // extern "C"
@@ -0,0 +1,200 @@
+// ===========================================================
+//
+// FloatConv.h: Conversion between real numbers and text
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     FloatConv.h
+ *	\author   Xiuwen Zheng [zhengx@u.washington.edu]
+ *	\version  1.0
+ *	\date     2020
+ *	\brief    Conversion between real numbers and text
+ *	\details  Locale-free fast paths of strtod() and sprintf("%g") used in
+ *	          VCF import and export, falling back to the C library if the
+ *	          result cannot be guaranteed to be the same.
+**/
+
+
+#ifndef _HEADER_SEQ_FLOAT_CONV_
+#define _HEADER_SEQ_FLOAT_CONV_
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+
+
+namespace SeqArray
+{
+
+/// the powers of 10 which are exact in double
+static const double FLOAT_CONV_POW10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/// convert a string to a real number like strtod(), the decimal numbers with
+/// at most 15 significant digits and a small exponent are converted by one
+/// exact multiplication or division (correctly rounded), otherwise strtod()
+inline static double fast_strtod(const char *p, char **endptr)
+{
+	const char *s = p;
+	bool neg = false;
+	if ((*s == '-') || (*s == '+'))
+		{ neg = (*s == '-'); s ++; }
+
+	unsigned long long m = 0;
+	int num_digit = 0, exp10 = 0;
+	bool has_digit = false;
+	for (; (*s >= '0') && (*s <= '9'); s++)
+	{
+		has_digit = true;
+		if (m || (*s != '0'))
+			{ m = m*10 + (*s - '0'); num_digit ++; }
+		if (num_digit > 15) return strtod(p, endptr);
+	}
+	// a hexadecimal number
+	if ((*s == 'x') || (*s == 'X')) return strtod(p, endptr);
+	if (*s == '.')
+	{
+		for (s++; (*s >= '0') && (*s <= '9'); s++)
+		{
+			has_digit = true;
+			if (m || (*s != '0'))
+				{ m = m*10 + (*s - '0'); num_digit ++; }
+			if (num_digit > 15) return strtod(p, endptr);
+			exp10 --;
+		}
+	}
+	// e.g., 'nan' or 'inf'
+	if (!has_digit) return strtod(p, endptr);
+
+	if ((*s == 'e') || (*s == 'E'))
+	{
+		const char *e = s + 1;
+		bool eneg = false;
+		if ((*e == '-') || (*e == '+'))
+			{ eneg = (*e == '-'); e ++; }
+		if ((*e >= '0') && (*e <= '9'))
+		{
+			int v = 0;
+			for (; (*e >= '0') && (*e <= '9'); e++)
+				if (v < 10000) v = v*10 + (*e - '0');
+			exp10 += eneg ? -v : v;
+			s = e;
+		}
+	}
+
+	double val = (double)m;
+	if (m != 0)
+	{
+		if ((exp10 < -22) || (exp10 > 22))
+			return strtod(p, endptr);
+		if (exp10 < 0)
+			val /= FLOAT_CONV_POW10[-exp10];
+		else
+			val *= FLOAT_CONV_POW10[exp10];
+	}
+	if (endptr) *endptr = (char*)s;
+	return neg ? -val : val;
+}
+
+
+/// append the text of a finite real number like sprintf("%g") (6 significant
+/// digits, trailing zeros removed), and return the end of the text; it falls
+/// back to sprintf() if the rounding is close to a tie or the exponent is
+/// out of range
+inline static char *fast_gtoa(char *p, double val)
+{
+	double a = fabs(val);
+	if (a == 0)
+	{
+		if (std::signbit(val)) *p++ = '-';
+		*p++ = '0';
+		return p;
+	}
+	if (!(a >= 1e-17) || !(a < 1e27))
+		return p + sprintf(p, "%g", val);
+
+	// the decimal exponent of 'a'
+	int X = 0;
+	if (a >= 1)
+	{
+		while ((X < 22) && (a >= FLOAT_CONV_POW10[X+1])) X ++;
+		if (a >= FLOAT_CONV_POW10[22]) X = (int)floor(log10(a));
+	} else {
+		X = -1;
+		while (a * FLOAT_CONV_POW10[-X] < 1) X --;
+	}
+
+	// 6 significant digits, 'a' is scaled by one exact power of 10
+	const int k = 5 - X;
+	if ((k > 22) || (k < -22))
+		return p + sprintf(p, "%g", val);
+	double x = (k >= 0) ? (a * FLOAT_CONV_POW10[k]) : (a / FLOAT_CONV_POW10[-k]);
+	double f = floor(x);
+	double frac = x - f;
+	if (fabs(frac - 0.5) < 1e-6)
+		return p + sprintf(p, "%g", val);
+	long m = (long)f + ((frac > 0.5) ? 1 : 0);
+	if (m == 1000000)
+		{ m = 100000; X ++; }
+	else if ((m < 100000) || (m > 1000000))
+		return p + sprintf(p, "%g", val);
+
+	char d[6];
+	for (int i=5; i >= 0; i--)
+		{ d[i] = '0' + (m % 10); m /= 10; }
+	int nd = 6;
+	while ((nd > 1) && (d[nd-1] == '0')) nd --;
+
+	if (val < 0) *p++ = '-';
+	if ((X < -4) || (X >= 6))
+	{
+		// exponential notation, e.g., 1.5e-05
+		*p++ = d[0];
+		if (nd > 1)
+		{
+			*p++ = '.';
+			for (int i=1; i < nd; i++) *p++ = d[i];
+		}
+		*p++ = 'e';
+		if (X < 0) { *p++ = '-'; X = -X; } else *p++ = '+';
+		// two digits, since 1e-17 <= a < 1e27
+		*p++ = '0' + X/10;
+		*p++ = '0' + X%10;
+	} else if (X >= 0)
+	{
+		for (int i=0; i <= X; i++) *p++ = d[i];
+		if (nd > X+1)
+		{
+			*p++ = '.';
+			for (int i=X+1; i < nd; i++) *p++ = d[i];
+		}
+	} else {
+		*p++ = '0'; *p++ = '.';
+		for (int i=X+1; i < 0; i++) *p++ = '0';
+		for (int i=0; i < nd; i++) *p++ = d[i];
+	}
+	return p;
+}
+
+}
+
+#endif /* _HEADER_SEQ_FLOAT_CONV_ */
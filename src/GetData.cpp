@@ -78,13 +78,18 @@ struct COREARRAY_DLL_LOCAL TParam
 	int padNA;
 	int tolist;
 	SEXP Env;
+	CGenoPrefetch *Prefetch;  ///< integer genotypes decoded in advance
+	bool InBlock;  ///< called for each block in seqBlockApply()
 	/// constructor
-	TParam(int _useraw, int _padNA, int _tolist, SEXP _Env)
+	TParam(int _useraw, int _padNA, int _tolist, SEXP _Env,
+		CGenoPrefetch *_Prefetch=NULL, bool _InBlock=false)
 	{
 		use_raw = _useraw;
 		padNA = _padNA;
 		tolist = _tolist;
 		Env = _Env;
+		Prefetch = _Prefetch;
+		InBlock = _InBlock;
 	}
 };
 
@@ -187,10 +192,16 @@ static SEXP get_genotype(CFileInfo &File, TVarMap &Var, void *param)
 		} else {
 			rv_ans = PROTECT(NEW_INTEGER(nVariant * SIZE));
 			int *base = INTEGER(rv_ans);
-			do {
-				NodeVar.ReadGenoData(base);
-				base += SIZE;
-			} while (NodeVar.Next());
+			// not to open the file again for each block
+			const int nThread = P->InBlock ? 1 : GetNumOfThread();
+			if (nThread<=1 || !ThreadScan(File, tsGenotype, nThread, false, base))
+			{
+				NodeVar.SetPrefetch(P->Prefetch);
+				do {
+					NodeVar.ReadGenoData(base);
+					base += SIZE;
+				} while (NodeVar.Next());
+			}
 		}
 		// return R object
 		SEXP dim = PROTECT(NEW_INTEGER(3));
@@ -239,10 +250,14 @@ static SEXP get_dosage(CFileInfo &File, TVarMap &Var, void *param)
 		} else {
 			rv_ans = PROTECT(allocMatrix(INTSXP, nSample, nVariant));
 			int *base = INTEGER(rv_ans);
-			do {
-				NodeVar.ReadDosage(base);
-				base += nSample;
-			} while (NodeVar.Next());
+			const int nThread = P->InBlock ? 1 : GetNumOfThread();
+			if (nThread<=1 || !ThreadScan(File, tsDosage, nThread, false, base))
+			{
+				do {
+					NodeVar.ReadDosage(base);
+					base += nSample;
+				} while (NodeVar.Next());
+			}
 		}
 		SET_DIMNAMES(rv_ans, R_Dosage_Name);
 		UNPROTECT(1);
@@ -273,10 +288,14 @@ static SEXP get_dosage_alt(CFileInfo &File, TVarMap &Var, void *param)
 		} else {
 			rv_ans = PROTECT(allocMatrix(INTSXP, nSample, nVariant));
 			int *base = INTEGER(rv_ans);
-			do {
-				NodeVar.ReadDosageAlt(base);
-				base += nSample;
-			} while (NodeVar.Next());
+			const int nThread = P->InBlock ? 1 : GetNumOfThread();
+			if (nThread<=1 || !ThreadScan(File, tsDosageAlt, nThread, false, base))
+			{
+				do {
+					NodeVar.ReadDosageAlt(base);
+					base += nSample;
+				} while (NodeVar.Next());
+			}
 		}
 		SET_DIMNAMES(rv_ans, R_Dosage_Name);
 		UNPROTECT(1);
@@ -929,7 +948,8 @@ COREARRAY_DLL_LOCAL TVarMap &VarGetStruct(CFileInfo &File, const string &name)
 
 /// get data from a SeqArray GDS file
 static SEXP VarGetData(CFileInfo &File, const string &name, int use_raw,
-	int padNA, int tolist, SEXP Env)
+	int padNA, int tolist, SEXP Env, CGenoPrefetch *Prefetch=NULL,
+	bool InBlock=false)
 {
 	TVarMap &vm = VarGetStruct(File, name);
 	if (vm.Obj)
@@ -943,10 +963,129 @@ static SEXP VarGetData(CFileInfo &File, const string &name, int use_raw,
 			vm.ObjID = node_id;
 		}
 	}
-	TParam param(use_raw, padNA, tolist, Env);
+	TParam param(use_raw, padNA, tolist, Env, Prefetch, InBlock);
 	return (*vm.Func)(File, vm, &param);
 }
 
+
+/// The reader and buffer of genotypes or dosages reused across blocks in
+/// seqBlockApply(), the reader advances over the selected variants
+class COREARRAY_DLL_LOCAL CBlockReader
+{
+public:
+	CBlockReader(CFileInfo &File, const char *name, int use_raw,
+		CGenoPrefetch *prefetch)
+	{
+		if (strcmp(name, "genotype") == 0)
+		{
+			Kind = 0;
+			Reader = new CApply_Variant_Geno(File, use_raw);
+			Reader->SetPrefetch(prefetch);
+		} else {
+			Kind = (strcmp(name, "$dosage") == 0) ? 1 : 2;
+			Reader = new CApply_Variant_Dosage(File, use_raw, Kind==2);
+		}
+		UseRaw = (use_raw != FALSE);
+		NumVariant = 0;
+		Buffer = R_NilValue;
+	}
+	~CBlockReader() { delete Reader; }
+
+	/// return true if the variable can be read by CBlockReader
+	static bool Support(const char *name)
+	{
+		return strcmp(name, "genotype")==0 || strcmp(name, "$dosage")==0 ||
+			strcmp(name, "$dosage_alt")==0;
+	}
+
+	/// read the next 'n' variants, the buffer is allocated for the first
+	/// block and reused for the following blocks of the same size
+	SEXP Read(int n, int &nProtected)
+	{
+		if (Rf_isNull(Buffer) || (n != NumVariant))
+		{
+			PROTECT(Buffer = NewBuffer(n));
+			nProtected ++;
+			NumVariant = n;
+		}
+		if (UseRaw)
+		{
+			C_UInt8 *p = RAW(Buffer);
+			const size_t size = XLENGTH(Buffer) / n;
+			for (int i=0; i < n; i++, p+=size)
+			{
+				switch (Kind)
+				{
+				case 0:
+					Reader->ReadGenoData(p); break;
+				case 1:
+					((CApply_Variant_Dosage*)Reader)->ReadDosage(p); break;
+				default:
+					((CApply_Variant_Dosage*)Reader)->ReadDosageAlt(p);
+				}
+				Reader->Next();
+			}
+		} else {
+			int *p = INTEGER(Buffer);
+			const size_t size = XLENGTH(Buffer) / n;
+			for (int i=0; i < n; i++, p+=size)
+			{
+				switch (Kind)
+				{
+				case 0:
+					Reader->ReadGenoData(p); break;
+				case 1:
+					((CApply_Variant_Dosage*)Reader)->ReadDosage(p); break;
+				default:
+					((CApply_Variant_Dosage*)Reader)->ReadDosageAlt(p);
+				}
+				Reader->Next();
+			}
+		}
+		return Buffer;
+	}
+
+private:
+	CApply_Variant_Geno *Reader;  ///< genotype or dosage reader
+	int Kind;         ///< 0: genotype, 1: dosage, 2: dosage_alt
+	bool UseRaw;      ///< whether use RAW type
+	int NumVariant;   ///< the number of variants in Buffer
+	SEXP Buffer;      ///< the R object storing the current block
+
+	SEXP NewBuffer(int n)
+	{
+		const int type = UseRaw ? RAWSXP : INTSXP;
+		SEXP rv;
+		if (Kind == 0)
+		{
+			rv = PROTECT(allocVector(type, (R_xlen_t)Reader->Ploidy *
+				Reader->SampNum * n));
+			SEXP dim = PROTECT(NEW_INTEGER(3));
+			int *p = INTEGER(dim);
+			p[0] = Reader->Ploidy; p[1] = Reader->SampNum; p[2] = n;
+			SET_DIM(rv, dim);
+			SET_DIMNAMES(rv, R_Geno_Dim3_Name);
+			UNPROTECT(1);
+		} else {
+			rv = PROTECT(allocMatrix(type, Reader->SampNum, n));
+			SET_DIMNAMES(rv, R_Dosage_Name);
+		}
+		UNPROTECT(1);
+		return rv;
+	}
+};
+
+/// the list of CBlockReader objects
+class COREARRAY_DLL_LOCAL CBlockReaderList: public vector<CBlockReader*>
+{
+public:
+	~CBlockReaderList()
+	{
+		for (iterator it=begin(); it != end(); it++)
+			if (*it) delete *it;
+	}
+};
+
 }
 
 
@@ -1012,6 +1151,18 @@ COREARRAY_DLL_EXPORT SEXP SEQ_GetData(SEXP gdsfile, SEXP var_name, SEXP UseRaw,
 COREARRAY_DLL_LOCAL extern const char *Txt_Apply_VarIdx[];
 
 
+/// call the native function, return a length-one vector
+static SEXP call_native(const TNativeApply *Native, SEXP x)
+{
+	PROTECT(x);
+	SEXP rv_ans = PROTECT(allocVector(Native->OutType, 1));
+	(*Native->Func)(x, (Native->OutType == INTSXP) ?
+		(void*)INTEGER(rv_ans) : (void*)REAL(rv_ans));
+	UNPROTECT(2);
+	return rv_ans;
+}
+
+
 /// Apply functions over variants in block
 COREARRAY_DLL_EXPORT SEXP SEQ_BApply_Variant(SEXP gdsfile, SEXP var_name,
 	SEXP FUN, SEXP as_is, SEXP var_index, SEXP param, SEXP rho)
@@ -1037,6 +1188,12 @@ COREARRAY_DLL_EXPORT SEXP SEQ_BApply_Variant(SEXP gdsfile, SEXP var_name,
 	int prog_flag = Rf_asLogical(RGetListElement(param, "progress"));
 	if (prog_flag == NA_LOGICAL)
 		error("'.progress' must be TRUE or FALSE.");
+	// .buf_reuse
+	SEXP pam_buf_reuse = RGetListElement(param, "buf_reuse");
+	int buf_reuse = Rf_isNull(pam_buf_reuse) ? FALSE :
+		Rf_asLogical(pam_buf_reuse);
+	if (buf_reuse == NA_LOGICAL)
+		error("'.buf_reuse' must be TRUE or FALSE.");
 
 	COREARRAY_TRY
 
@@ -1121,10 +1278,42 @@ COREARRAY_DLL_EXPORT SEXP SEQ_BApply_Variant(SEXP gdsfile, SEXP var_name,
 		}
 
 
-		// local selection
+		// the native function if FUN is a registered C function
+		const TNativeApply *Native =
+			(VarIdx == 0) ? FindNativeApply(FUN, rho) : NULL;
+
+		// decode integer genotypes of the next blocks in a background thread
+		CGenoPrefetchPtr Prefetch;
+		if ((use_raw_flag == FALSE) && (GetNumOfThread() > 1))
+		{
+			for (int i=0; i < num_var; i++)
+			{
+				if (strcmp(CHAR(STRING_ELT(var_name, i)), "genotype") == 0)
+				{
+					Prefetch.Ptr = CGenoPrefetch::New(File);
+					break;
+				}
+			}
+		}
+
+		// genotypes and dosages read by the persistent readers
+		CBlockReaderList BlockReader;
+		BlockReader.resize(num_var, NULL);
+		if (buf_reuse)
+		{
+			for (int i=0; i < num_var; i++)
+			{
+				const char *nm = CHAR(STRING_ELT(var_name, i));
+				if (CBlockReader::Support(nm))
+				{
+					BlockReader[i] = new CBlockReader(File, nm, use_raw_flag,
+						Prefetch.Ptr);
+				}
+			}
+		}
+
+		// local selection, the variant selection is initialized with all FALSE
 		TSelection &Sel = File.Push_Selection(true, false);
-		Sel.ClearStructVariant();
-		memset(Sel.pVariant, 0, File.VariantNum());
 
 		C_BOOL *pBase, *pSel, *pEnd;
 		pBase = pSel = Selection.pVariant;
@@ -1177,28 +1366,43 @@ COREARRAY_DLL_EXPORT SEXP SEQ_BApply_Variant(SEXP gdsfile, SEXP var_name,
 			{
 				for (int i=0; i < num_var; i++)
 				{
-					SET_ELEMENT(R_call_param, i,
+					SET_ELEMENT(R_call_param, i, BlockReader[i] ?
+						BlockReader[i]->Read(Sel.varTrueNum, nProtected) :
 						VarGetData(File, CHAR(STRING_ELT(var_name, i)),
-						use_raw_flag, padNA, tolist, rho));
+						use_raw_flag, padNA, tolist, rho, Prefetch.Ptr, true));
 				}
 				// call R function
-				call_val = eval(R_fcall, rho);
+				if (Native)
+					call_val = call_native(Native, R_call_param);
+				else
+					call_val = eval(R_fcall, rho);
 
 			} else {
-				R_call_param = VarGetData(File, CHAR(STRING_ELT(var_name, 0)),
-					use_raw_flag, padNA, tolist, rho);
-				// make a call function
-				if (VarIdx > 0)
+				if (BlockReader[0])
 				{
-					PROTECT(R_fcall = LCONS(FUN, LCONS(R_Index,
-						LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue)))));
+					R_call_param = BlockReader[0]->Read(Sel.varTrueNum,
+						nProtected);
 				} else {
-					PROTECT(R_fcall = LCONS(FUN,
-						LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue))));
+					R_call_param = VarGetData(File, CHAR(STRING_ELT(var_name, 0)),
+						use_raw_flag, padNA, tolist, rho, Prefetch.Ptr, true);
+				}
+				if (Native)
+				{
+					// call the native function without R evaluation
+					PROTECT(call_val = call_native(Native, R_call_param));
+				} else {
+					// make a call function
+					if (VarIdx > 0)
+					{
+						PROTECT(R_fcall = LCONS(FUN, LCONS(R_Index,
+							LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue)))));
+					} else {
+						PROTECT(R_fcall = LCONS(FUN,
+							LCONS(R_call_param, LCONS(R_DotsSymbol, R_NilValue))));
+					}
+					// call R function
+					call_val = eval(R_fcall, rho);
 				}
-
-				// call R function
-				call_val = eval(R_fcall, rho);
 			}
 
 			// store data
@@ -1236,7 +1440,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_BApply_Variant(SEXP gdsfile, SEXP var_name,
 				break;
 			}
 
-			// release R_fcall
+			// release R_fcall (or call_val)
 			if (num_var <= 1) UNPROTECT(1);
 
 			progress.Forward();
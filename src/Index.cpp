@@ -22,6 +22,7 @@
 #include "Index.h"
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 
 using namespace std;
 
@@ -43,6 +44,42 @@ static const char *ERR_INDEX_VALUE =
 	"'%s' should not contain negative values or NA (replaced by zero).";
 
 
+/// build the prefix-sum tables of run-length encoding
+template<typename TVAL>
+	static void build_acc_table(const vector<TVAL> &Values,
+		const vector<C_UInt32> &Lengths, vector<C_Int64> &RunStart,
+		vector<C_Int64> &RunSum)
+{
+	const size_t n = Lengths.size();
+	RunStart.resize(n + 1);
+	RunSum.resize(n + 1);
+	C_Int64 st=0, sum=0;
+	for (size_t i=0; i < n; i++)
+	{
+		RunStart[i] = st; RunSum[i] = sum;
+		st += Lengths[i];
+		sum += (C_Int64)Values[i] * Lengths[i];
+	}
+	RunStart[n] = st; RunSum[n] = sum;
+}
+
+/// find the run containing the position, the sequential cursor is tried first
+static size_t find_run(const vector<C_Int64> &RunStart, size_t cur_pos,
+	size_t cur_idx, size_t pos)
+{
+	if (pos >= cur_pos)
+	{
+		// fast path, sequential access in the current or next run
+		const size_t n = RunStart.size() - 1;
+		for (size_t i=cur_idx; i < n && i <= cur_idx+1; i++)
+			if ((C_Int64)pos < RunStart[i+1]) return i;
+	}
+	// binary search, RunStart[i] <= pos < RunStart[i+1]
+	return (upper_bound(RunStart.begin(), RunStart.end(), (C_Int64)pos) -
+		RunStart.begin()) - 1;
+}
+
+
 // ===========================================================
 // Indexing object
 // ===========================================================
@@ -107,6 +144,7 @@ void CIndex::Init(PdContainer Obj, const char *varname)
 	val_max = 0;
 	for (size_t i=0; i < Values.size(); i++)
 		if (Values[i] > val_max) val_max = Values[i];
+	InitAccTable();
 
 	if (if_neg_val && varname)
 		warning(ERR_INDEX_VALUE, varname);
@@ -124,32 +162,25 @@ void CIndex::InitOne(int num)
 	AccIndex = AccOffset = 0;
 	has_index = false;
 	val_max = 1;
+	InitAccTable();
+}
+
+void CIndex::InitAccTable()
+{
+	build_acc_table(Values, Lengths, RunStart, RunSum);
 }
 
 void CIndex::GetInfo(size_t pos, C_Int64 &Sum, int &Value)
 {
 	if (pos >= TotalLength)
 		throw ErrSeqArray("Invalid position in CIndex.");
-	if (pos < Position)
-	{
-		Position = 0;
-		AccSum = 0;
-		AccIndex = AccOffset = 0;
-	}
-	for (; Position < pos; )
+	if (pos != Position)
 	{
-		size_t L = Lengths[AccIndex];
-		size_t n = L - AccOffset;
-		if ((Position + n) <= pos)
-		{
-			AccSum += (Values[AccIndex] * n);
-			AccIndex ++; AccOffset = 0;
-		} else {
-			n = pos - Position;
-			AccSum += (Values[AccIndex] * n);
-			AccOffset += n;
-		}
-		Position += n;
+		size_t i = find_run(RunStart, Position, AccIndex, pos);
+		AccIndex = i;
+		AccOffset = pos - RunStart[i];
+		AccSum = RunSum[i] + (C_Int64)Values[i] * AccOffset;
+		Position = pos;
 	}
 	Sum = AccSum;
 	Value = Values[AccIndex];
@@ -338,34 +369,27 @@ void CGenoIndex::Init(PdContainer Obj, const char *varname)
 	Position = 0;
 	AccSum = 0;
 	AccIndex = AccOffset = 0;
+	InitAccTable();
 	if (if_neg_val && varname)
 		warning(ERR_INDEX_VALUE, varname);
 }
 
+void CGenoIndex::InitAccTable()
+{
+	build_acc_table(Values, Lengths, RunStart, RunSum);
+}
+
 void CGenoIndex::GetInfo(size_t pos, C_Int64 &Sum, C_UInt8 &Value)
 {
 	if (pos >= TotalLength)
 		throw ErrSeqArray("Invalid position in CIndex.");
-	if (pos < Position)
+	if (pos != Position)
 	{
-		Position = 0;
-		AccSum = 0;
-		AccIndex = AccOffset = 0;
-	}
-	for (; Position < pos; )
-	{
-		size_t L = Lengths[AccIndex];
-		size_t n = L - AccOffset;
-		if ((Position + n) <= pos)
-		{
-			AccSum += (Values[AccIndex] * n);
-			AccIndex ++; AccOffset = 0;
-		} else {
-			n = pos - Position;
-			AccSum += (Values[AccIndex] * n);
-			AccOffset += n;
-		}
-		Position += n;
+		size_t i = find_run(RunStart, Position, AccIndex, pos);
+		AccIndex = i;
+		AccOffset = pos - RunStart[i];
+		AccSum = RunSum[i] + (C_Int64)Values[i] * AccOffset;
+		Position = pos;
 	}
 	Sum = AccSum;
 	Value = Values[AccIndex] & 0x0F;
@@ -501,6 +525,146 @@ size_t CChromIndex::RangeTotalLength(const TRangeList &RngList)
 
 
 
+// ===========================================================
+// Position Indexing
+// ===========================================================
+
+/// compare the positions of two variant indices
+struct COREARRAY_DLL_LOCAL less_pos_idx
+{
+	const C_Int32 *Pos;
+	less_pos_idx(const C_Int32 *p) { Pos = p; }
+	inline bool operator()(C_Int32 i, C_Int32 j) const
+		{ return Pos[i] < Pos[j]; }
+};
+
+/// compare the position of a variant index with a value
+struct COREARRAY_DLL_LOCAL less_pos_val
+{
+	const C_Int32 *Pos;
+	less_pos_val(const C_Int32 *p) { Pos = p; }
+	inline bool operator()(C_Int32 i, int val) const
+		{ return Pos[i] < val; }
+};
+
+/// load '@position_index' (1-based) to 'Order' (0-based), and return false
+/// if it does not sort the positions within each chromosome run
+static bool load_pos_index(PdAbstractArray N, CChromIndex &Chrom,
+	const C_Int32 *pPos, vector<C_Int32> &Order)
+{
+	const size_t nVariant = Order.size();
+	if (GDS_Array_DimCnt(N)!=1 ||
+			GDS_Array_GetTotalCount(N)!=(C_Int64)nVariant)
+		return false;
+	GDS_Array_ReadData(N, NULL, NULL, &Order[0], svInt32);
+	vector<C_BOOL> flag(nVariant, FALSE);
+	less_pos_idx cmp(pPos);
+	map<string, CChromIndex::TRangeList>::const_iterator it;
+	vector<CChromIndex::TRange>::const_iterator p;
+	for (it=Chrom.Map.begin(); it != Chrom.Map.end(); it++)
+	{
+		for (p=it->second.begin(); p != it->second.end(); p++)
+		{
+			C_Int32 *s = &Order[p->Start];
+			for (int n=p->Length; n > 0; n--)
+			{
+				C_Int32 i = (*s++) -= 1;
+				if (i < p->Start || i >= p->Start + p->Length || flag[i])
+					return false;
+				flag[i] = TRUE;
+			}
+			s = &Order[p->Start];
+			for (int n=p->Length-1; n > 0; n--, s++)
+				if (cmp(s[1], s[0])) return false;
+		}
+	}
+	return true;
+}
+
+CPosIndex::CPosIndex() { _init = _invalid = false; }
+
+void CPosIndex::Clear()
+{
+	Order.clear();
+	_init = _invalid = false;
+}
+
+void CPosIndex::Init(PdGDSFolder Root, CChromIndex &Chrom,
+	const vector<C_Int32> &Pos)
+{
+	Clear();
+	const C_Int32 *pPos = Pos.empty() ? NULL : &Pos[0];
+	map<string, CChromIndex::TRangeList>::const_iterator it;
+	vector<CChromIndex::TRange>::const_iterator p;
+
+	// check whether positions are sorted within each chromosome run
+	bool sorted = true;
+	for (it=Chrom.Map.begin(); it != Chrom.Map.end() && sorted; it++)
+	{
+		for (p=it->second.begin(); p != it->second.end() && sorted; p++)
+		{
+			const C_Int32 *s = pPos + p->Start;
+			for (int n=p->Length-1; n > 0; n--, s++)
+				if (s[0] > s[1]) { sorted = false; break; }
+		}
+	}
+
+	if (!sorted)
+	{
+		const size_t nVariant = Pos.size();
+		Order.resize(nVariant);
+		PdAbstractArray N = GDS_Node_Path(Root, "@position_index", FALSE);
+		// load the index stored in the GDS file
+		bool loaded = false;
+		if (N)
+		{
+			loaded = load_pos_index(N, Chrom, pPos, Order);
+			GDS_Node_Unload(N);
+			_invalid = !loaded;
+		}
+		if (!loaded)
+		{
+			// no or incorrect index stored, sort positions in memory
+			for (size_t i=0; i < nVariant; i++) Order[i] = i;
+			for (it=Chrom.Map.begin(); it != Chrom.Map.end(); it++)
+			{
+				for (p=it->second.begin(); p != it->second.end(); p++)
+				{
+					C_Int32 *s = &Order[p->Start];
+					stable_sort(s, s + p->Length, less_pos_idx(pPos));
+				}
+			}
+		}
+	}
+
+	_init = true;
+}
+
+void CPosIndex::SetRange(const CChromIndex::TRange &rng, const C_Int32 *Pos,
+	int from, int to, C_BOOL *array, const C_BOOL *mask)
+{
+	if (rng.Length <= 0) return;
+	if (Order.empty())
+	{
+		// positions are sorted
+		const C_Int32 *s = Pos + rng.Start, *e = s + rng.Length;
+		for (s=lower_bound(s, e, from); s < e && *s <= to; s++)
+		{
+			size_t i = s - Pos;
+			if (!mask || mask[i]) array[i] = TRUE;
+		}
+	} else {
+		const C_Int32 *s = &Order[rng.Start], *e = s + rng.Length;
+		for (s=lower_bound(s, e, from, less_pos_val(Pos));
+			s < e && Pos[*s] <= to; s++)
+		{
+			if (!mask || mask[*s]) array[*s] = TRUE;
+		}
+	}
+}
+
+
+
 // ===========================================================
 // Genomic Range Set
 // ===========================================================
@@ -564,30 +728,94 @@ void CRangeSet::GetRanges(int Start[], int End[])
 // SeqArray GDS file information
 // ===========================================================
 
+static const char *ERR_SEL_MEMORY = "Insufficient memory for selection.";
+
+/// allocate a selection array with all FALSE, untouched pages are not committed
+inline static C_BOOL *sel_alloc_zero(size_t n)
+{
+	C_BOOL *p = (C_BOOL*)calloc(n ? n : 1, 1);
+	if (!p) throw ErrSeqArray(ERR_SEL_MEMORY);
+	return p;
+}
+
+/// allocate a selection array copied from 's'
+inline static C_BOOL *sel_alloc_copy(const C_BOOL *s, size_t n)
+{
+	C_BOOL *p = (C_BOOL*)malloc(n ? n : 1);
+	if (!p) throw ErrSeqArray(ERR_SEL_MEMORY);
+	memcpy(p, s, n);
+	return p;
+}
+
 TSelection::TSelection(CFileInfo &File, bool init)
 {
 	Link = NULL;
 	if (File.Ploidy() <= 0)
 		throw ErrSeqArray("Unable to determine ploidy.");
 	numPloidy = File.Ploidy();
-	numSamp = File.SampleNum(); pSample = new C_BOOL[numSamp];
+	numSamp = File.SampleNum(); pSample = sel_alloc_zero(numSamp);
 	if (init) memset(pSample, TRUE, numSamp);
-	numVar = File.VariantNum(); pVariant = new C_BOOL[numVar];
+	numVar = File.VariantNum(); pVariant = sel_alloc_zero(numVar);
 	if (init) memset(pVariant, TRUE, numVar);
 	pFlagGenoSel = NULL;
 	varTrueNum = -1; varStart = varEnd = 0;
+	sampShared = varShared = false;
+}
+
+TSelection::TSelection(CFileInfo &File, TSelection *link, bool share_samp,
+	bool share_var)
+{
+	Link = link;
+	numPloidy = File.Ploidy();
+	numSamp = File.SampleNum();
+	numVar = File.VariantNum();
+	pSample = pVariant = pFlagGenoSel = NULL;
+	sampShared = varShared = false;
+	if (share_samp)
+	{
+		pSample = link->pSample; sampShared = true;
+	} else
+		pSample = sel_alloc_zero(numSamp);
+	if (share_var)
+	{
+		pVariant = link->pVariant; varShared = true;
+		varTrueNum = link->varTrueNum;
+		varStart = link->varStart; varEnd = link->varEnd;
+	} else {
+		pVariant = sel_alloc_zero(numVar);
+		varTrueNum = varStart = varEnd = 0;
+	}
 }
 
 TSelection::~TSelection()
 {
-	if (pSample)
-		{ delete[] pSample; pSample = NULL; }
-	if (pVariant)
-		{ delete[] pVariant; pVariant = NULL; }
+	if (pSample && !sampShared) free(pSample);
+	if (pVariant && !varShared) free(pVariant);
+	pSample = pVariant = NULL;
 	ClearStructSample();
 	Link = NULL;
 }
 
+C_BOOL *TSelection::Sample_W()
+{
+	if (sampShared)
+	{
+		pSample = sel_alloc_copy(pSample, numSamp);
+		sampShared = false;
+	}
+	return pSample;
+}
+
+C_BOOL *TSelection::Variant_W()
+{
+	if (varShared)
+	{
+		pVariant = sel_alloc_copy(pVariant, numVar);
+		varShared = false;
+	}
+	return pVariant;
+}
+
 TSelection::TSampStruct *TSelection::GetStructSample()
 {
 	// the block size considered in the block reading
@@ -728,6 +956,7 @@ void TSelection::GetStructVariant()
 
 void TSelection::ClearSelectVariant()
 {
+	Variant_W();
 	if (varTrueNum < 0)
 	{
 		memset(pVariant, 0, numVar);
@@ -807,11 +1036,13 @@ CFileInfo::CFileInfo(PdGDSFolder root)
 	_File = NULL; _Root = NULL;
 	_SelList = NULL;
 	_SampleNum = _VariantNum = 0;
+	_ReadOnly = false;
 	ResetRoot(root);
 }
 
 CFileInfo::~CFileInfo()
 {
+	DoneGenoPrefetch(*this);
 	_File = NULL; _Root = NULL;
 	_SampleNum = _VariantNum = 0;
 	clear_selection();
@@ -828,15 +1059,25 @@ void CFileInfo::clear_selection()
 	_SelList = NULL;
 }
 
+void CFileInfo::SetFileName(SEXP gdsfile)
+{
+	SEXP fn = RGetListElement(gdsfile, "filename");
+	_FileName = (Rf_isString(fn) && RLength(fn)>0) ?
+		CHAR(STRING_ELT(fn, 0)) : "";
+	_ReadOnly = (Rf_asLogical(RGetListElement(gdsfile, "readonly")) == TRUE);
+}
+
 void CFileInfo::ResetRoot(PdGDSFolder root)
 {
 	if (_Root != root)
 	{
 		// initialize
+		DoneGenoPrefetch(*this);
 		_File = GDS_Node_File(root);
 		_Root = root;
 		_Chrom.Clear();
 		_Position.clear();
+		_PosIndex.Clear();
 		clear_selection();
 
 		// sample.id
@@ -881,12 +1122,10 @@ TSelection &CFileInfo::Selection()
 
 TSelection &CFileInfo::Push_Selection(bool init_samp, bool init_var)
 {
-	TSelection *n = new TSelection(*this, false);
-	n->Link = _SelList;
-	if (init_samp)
-		memcpy(n->pSample, _SelList->pSample, _SampleNum);
-	if (init_var)
-		memcpy(n->pVariant, _SelList->pVariant, _VariantNum);
+	if (!_SelList)
+		throw ErrSeqArray(ERR_FILE_ROOT);
+	// copy on write, share the arrays of the previous selection
+	TSelection *n = new TSelection(*this, _SelList, init_samp, init_var);
 	_SelList = n;
 	return *n;
 }
@@ -914,6 +1153,8 @@ void CFileInfo::ResetChromosome()
 	if (!_Root)
 		throw ErrSeqArray(ERR_FILE_ROOT);
 	_Chrom.Clear();
+	_Position.clear();
+	_PosIndex.Clear();
 }
 
 vector<C_Int32> &CFileInfo::Position()
@@ -934,6 +1175,13 @@ vector<C_Int32> &CFileInfo::Position()
 	return _Position;
 }
 
+CPosIndex &CFileInfo::PosIndex()
+{
+	if (_PosIndex.Empty())
+		_PosIndex.Init(_Root, Chromosome(), Position());
+	return _PosIndex;
+}
+
 CGenoIndex &CFileInfo::GenoIndex()
 {
 	if (_GenoIndex.Empty())
@@ -987,9 +1235,13 @@ COREARRAY_DLL_LOCAL CFileInfo &GetFileInfo(SEXP gdsfile)
 	{
 		GDSFile_ID_Info[id].ResetRoot(root);
 		p = GDSFile_ID_Info.find(id);
+		p->second.SetFileName(gdsfile);
 	} else {
 		if (p->second.Root() != root)
+		{
 			p->second.ResetRoot(root);
+			p->second.SetFileName(gdsfile);
+		}
 	}
 
 	return p->second;
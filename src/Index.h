@@ -197,6 +197,13 @@ protected:
 	bool has_index;
 	/// the maximum value in Values
 	int val_max;
+	/// the starting positions of runs, with TotalLength appended at the end
+	vector<C_Int64> RunStart;
+	/// the accumulated sums of values at the starting positions of runs
+	vector<C_Int64> RunSum;
+
+	/// build the prefix-sum tables RunStart and RunSum
+	void InitAccTable();
 };
 
 
@@ -230,6 +237,13 @@ protected:
 	size_t AccIndex;
 	/// the offset according the value of Lengths[AccIndex]
 	size_t AccOffset;
+	/// the starting positions of runs, with TotalLength appended at the end
+	vector<C_Int64> RunStart;
+	/// the accumulated sums of values at the starting positions of runs
+	vector<C_Int64> RunSum;
+
+	/// build the prefix-sum tables RunStart and RunSum
+	void InitAccTable();
 };
 
 
@@ -278,6 +292,40 @@ protected:
 
 
 
+/// Position indexing object, variants sorted by position within each chromosome run
+class COREARRAY_DLL_LOCAL CPosIndex
+{
+public:
+	/// constructor
+	CPosIndex();
+
+	/// clear
+	void Clear();
+	/// initialize with '@position_index' if positions are not sorted, or
+	/// sort the positions in memory if '@position_index' is missing or not
+	/// correct
+	void Init(PdGDSFolder Root, CChromIndex &Chrom, const vector<C_Int32> &Pos);
+	/// set array[i]=TRUE for the variants in rng with from <= Pos[i] <= to (and mask[i] if mask is not NULL)
+	void SetRange(const CChromIndex::TRange &rng, const C_Int32 *Pos,
+		int from, int to, C_BOOL *array, const C_BOOL *mask);
+
+	/// whether it is not initialized
+	inline bool Empty() const { return !_init; }
+	/// return true once if '@position_index' is not correct, then the caller
+	/// raises a warning after leaving the C++ scope
+	inline bool TakeInvalid() { bool v = _invalid; _invalid = false; return v; }
+
+protected:
+	/// variant indices sorted by position within each chromosome run, empty if all positions are sorted
+	vector<C_Int32> Order;
+	/// whether it is initialized
+	bool _init;
+	/// whether '@position_index' is not correct
+	bool _invalid;
+};
+
+
+
 // ===========================================================
 // Genomic Range Sets
 // ===========================================================
@@ -338,9 +386,16 @@ struct COREARRAY_DLL_LOCAL TSelection
 
 	/// constructor
 	TSelection(CFileInfo &File, bool init);
+	/// constructor, sharing the selections of 'link' (copy on write) or all FALSE
+	TSelection(CFileInfo &File, TSelection *link, bool share_samp, bool share_var);
 	/// destructor
 	~TSelection();
 
+	/// get pSample for modification, which is copied from Link if shared
+	C_BOOL *Sample_W();
+	/// get pVariant for modification, which is copied from Link if shared
+	C_BOOL *Variant_W();
+
 	/// get the pointer to the sample reading structure
 	TSampStruct *GetStructSample();
 	/// clear the structure of selected samples for resetting the sample filter
@@ -359,6 +414,8 @@ private:
 	size_t numPloidy;  ///< the ploidy
 	C_BOOL *pFlagGenoSel;  ///< the pointer to the genotype selection according to the selected samples
 	vector<TSampStruct> pSampList;
+	bool sampShared;  ///< true if pSample is owned by Link
+	bool varShared;   ///< true if pVariant is owned by Link
 };
 
 
@@ -405,17 +462,19 @@ public:
 
 	/// get the current selection
 	TSelection &Selection();
-	/// push a new selection to the list of selection
+	/// push a new selection (copy of the current one if init_*, or all FALSE)
 	TSelection &Push_Selection(bool init_samp, bool init_var);
 	/// pop back a selection
 	void Pop_Selection();
 
 	/// return _Chrom which has been initialized
 	CChromIndex &Chromosome();
-	/// reload chromosome coding when it is changed
+	/// reload chromosome coding and positions when they are changed
 	void ResetChromosome();
 	/// return _Position which has been initialized
 	vector<C_Int32> &Position();
+	/// return _PosIndex which has been initialized
+	CPosIndex &PosIndex();
 
 	/// return _GenoIndex which has been initialized
 	CGenoIndex &GenoIndex();
@@ -436,6 +495,12 @@ public:
 	inline int VariantNum() const { return _VariantNum; }
 	/// ploidy
 	inline int Ploidy() const { return _Ploidy; }
+	/// the file name
+	inline const string &FileName() const { return _FileName; }
+	/// whether the file is read-only
+	inline bool ReadOnly() const { return _ReadOnly; }
+	/// set the file name and read-only status from the R gds object
+	void SetFileName(SEXP gdsfile);
 
 	/// get the number of selected samples
 	int SampleSelNum();
@@ -449,9 +514,12 @@ protected:
 	int _SampleNum;   ///< the total number of samples
 	int _VariantNum;  ///< the total number of variants
 	int _Ploidy;      ///< ploidy
+	string _FileName; ///< the file name
+	bool _ReadOnly;   ///< whether the file is read-only
 
 	CChromIndex _Chrom;  ///< chromosome indexing
 	vector<C_Int32> _Position;  ///< position
+	CPosIndex _PosIndex;  ///< position indexing
 	CGenoIndex _GenoIndex;  ///< the indexing object for genotypes
 	map<string, TVarMap> _VarMap;  ///< the indexing objects for seqGetData()
 
@@ -465,6 +533,10 @@ extern std::map<int, CFileInfo> COREARRAY_DLL_LOCAL GDSFile_ID_Info;
 /// get the associated CFileInfo
 COREARRAY_DLL_LOCAL CFileInfo &GetFileInfo(SEXP gdsfile);
 
+/// stop the read-ahead threads of the file which were not released because
+/// of an R error in the user-defined function
+COREARRAY_DLL_LOCAL void DoneGenoPrefetch(CFileInfo &File);
+
 /// get TVarMap from a variable name
 COREARRAY_DLL_LOCAL TVarMap &VarGetStruct(CFileInfo &File, const string &name);
 
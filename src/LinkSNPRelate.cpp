@@ -98,7 +98,7 @@ static void SNPRelate_InitSelSampOnly(C_BOOL *Sel, TParam *Param)
 	CFileInfo &File = GetFileInfo(Param->SeqGDSFile);
 	TSelection &s = File.Selection();
 	s.ClearStructSample();
-	memcpy(s.pSample, Sel, *Param->pTotalSampleNum);
+	memcpy(s.Sample_W(), Sel, *Param->pTotalSampleNum);
 
 	Done_Object(Param);
 }
@@ -111,7 +111,7 @@ static void SNPRelate_InitSelSNPOnly(C_BOOL *Sel, TParam *Param)
 	CFileInfo &File = GetFileInfo(Param->SeqGDSFile);
 	TSelection &s = File.Selection();
 	s.ClearStructVariant();
-	memcpy(s.pVariant, Sel, *Param->pTotalSNPNum);
+	memcpy(s.Variant_W(), Sel, *Param->pTotalSNPNum);
 
 	Done_Object(Param);
 }
@@ -349,7 +349,7 @@ static void SNPRelate_SetSnpSelection(C_BOOL *sel, TParam *Param)
 	CFileInfo &File = GetFileInfo(Param->SeqGDSFile);
 	TSelection &s = File.Selection();
 	s.ClearStructVariant();
-	C_BOOL *p = s.pVariant;
+	C_BOOL *p = s.Variant_W();
 
 	int sum = 0;
 	for (int i=0; i < *Param->pTotalSNPNum; i++, p++)
@@ -373,7 +373,7 @@ static void SNPRelate_SetSampSelection(C_BOOL *sel, TParam *Param)
 	CFileInfo &File = GetFileInfo(Param->SeqGDSFile);
 	TSelection &s = File.Selection();
 	s.ClearStructSample();
-	C_BOOL *p = s.pSample;
+	C_BOOL *p = s.Sample_W();
 
 	int sum = 0;
 	for (int i=0; i < *Param->pTotalSampleNum; i++, p++)
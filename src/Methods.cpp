@@ -22,6 +22,7 @@
 #include <Rdefines.h>
 #include <R_ext/Rdynload.h>
 #include "Index.h"
+#include "ReadByVariant.h"
 
 using namespace SeqArray;
 
@@ -29,18 +30,35 @@ using namespace SeqArray;
 extern "C"
 {
 
+// ======================================================================
+// The per-variant functions NF_* (registered as native functions for
+// seqApply) and the R-callable wrappers FC_*
+
+#define NF_RETURN(TYPE, val)    \
+	do { *((TYPE*)out) = (val); return; } while (0)
+
+#define NF_FUNC_REAL(name)    \
+	COREARRAY_DLL_EXPORT SEXP FC_##name(SEXP x)  \
+		{ double v; NF_##name(x, &v); return ScalarReal(v); }
+
+#define NF_FUNC_INT(name)    \
+	COREARRAY_DLL_EXPORT SEXP FC_##name(SEXP x)  \
+		{ int v; NF_##name(x, &v); return ScalarInteger(v); }
+
+
 // ======================================================================
 
 /// Calculate the missing rate per variant
-COREARRAY_DLL_EXPORT SEXP FC_Missing_PerVariant(SEXP Geno)
+static void NF_Missing_PerVariant(SEXP Geno, void *out)
 {
 	size_t n = XLENGTH(Geno), m;
 	if (TYPEOF(Geno) == RAWSXP)
 		m = vec_i8_count((char*)RAW(Geno), n, NA_RAW);
 	else
 		m = vec_i32_count(INTEGER(Geno), n, NA_INTEGER);
-	return ScalarReal((n > 0) ? (double(m) / n) : R_NaN);
+	NF_RETURN(double, (n > 0) ? (double(m) / n) : R_NaN);
 }
+NF_FUNC_REAL(Missing_PerVariant)
 
 /// Calculate the missing rate per sample
 COREARRAY_DLL_EXPORT SEXP FC_Missing_PerSample(SEXP Geno, SEXP sum)
@@ -182,39 +200,20 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_List(SEXP List)
 		break;
 
 	default:
-		int num = 0;
-		memset((void*)pV, 0, sizeof(double)*nAllele);
+		// histogram of alleles
+		vector<size_t> cnt(nAllele > 0 ? nAllele : 1, 0);
+		size_t num;
 		if (TYPEOF(Geno) == RAWSXP)
-		{
-			C_UInt8 *p = (C_UInt8*)RAW(Geno);
-			for (size_t n=N; n > 0; n--)
-			{
-				C_UInt8 g = *p++;
-				if (g != NA_RAW)
-				{
-					num ++;
-					if (g < nAllele) pV[g] ++;
-				}
-			}
-		} else {
-			int *p = INTEGER(Geno);
-			for (size_t n=N; n > 0; n--)
-			{
-				int g = *p++;
-				if (g != NA_INTEGER)
-				{
-					num ++;
-					if ((0 <= g) && (g < nAllele))
-						pV[g] ++;
-				}
-			}
-		}
+			num = vec_u8_histogram((const C_UInt8*)RAW(Geno), N, &cnt[0], nAllele, NA_RAW);
+		else
+			num = vec_i32_histogram(INTEGER(Geno), N, &cnt[0], nAllele, NA_INTEGER);
+		num = N - num;
 		if (num > 0)
 		{
 			const double scale = 1.0 / num;
-			for (; (nAllele--) > 0;) (*pV++) *= scale;
+			for (int i=0; i < nAllele; i++) pV[i] = cnt[i] * scale;
 		} else {
-			for (; (nAllele--) > 0;) (*pV++) = R_NaN;
+			for (int i=0; i < nAllele; i++) pV[i] = R_NaN;
 		}
 	}
 
@@ -222,7 +221,7 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_List(SEXP List)
 }
 
 /// Get reference allele frequency
-COREARRAY_DLL_EXPORT SEXP FC_AF_Ref(SEXP Geno)
+static void NF_AF_Ref(SEXP Geno, void *out)
 {
 	const size_t N = XLENGTH(Geno);
 	size_t n, m;
@@ -235,10 +234,11 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_Ref(SEXP Geno)
 	{
 		double p = double(m) / n;
 		if (AFreq_Minor && p>0.5) p = 1 - p;
-		return ScalarReal(p);
+		NF_RETURN(double, p);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AF_Ref)
 
 #define GET_SUM_NUM(TYPE, TYPEPTR, START, NA_VAL, N)  \
 	{ \
@@ -257,7 +257,7 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_Ref(SEXP Geno)
 static const char *ERR_DS_TYPE = "Invalid type of dosage.";
 
 /// Get reference allele frequency from dosage
-COREARRAY_DLL_EXPORT SEXP FC_AF_DS_Ref(SEXP DS)
+static void NF_AF_DS_Ref(SEXP DS, void *out)
 {
 	int n, m, num=0;
 	get_ds_n_m(DS, n, m);
@@ -279,13 +279,14 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_DS_Ref(SEXP DS)
 	{
 		double p = 1 - sum * m / (num * AFreq_Ploidy);
 		if (AFreq_Minor && p>0.5) p = 1 - p;
-		return ScalarReal(p);
+		NF_RETURN(double, p);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AF_DS_Ref)
 
 /// Get allele frequency
-COREARRAY_DLL_EXPORT SEXP FC_AF_Index(SEXP List)
+static void NF_AF_Index(SEXP List, void *out)
 {
 	SEXP Geno = VECTOR_ELT(List, 0);
 	const int nAllele = Rf_asInteger(VECTOR_ELT(List, 1));
@@ -308,25 +309,26 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_Index(SEXP List)
 	{
 		double p = double(m) / n;
 		if (AFreq_Minor && p>0.5) p = 1 - p;
-		return ScalarReal(p);
+		NF_RETURN(double, p);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AF_Index)
 
 /// Get allele frequency
-COREARRAY_DLL_EXPORT SEXP FC_AF_DS_Index(SEXP List)
+static void NF_AF_DS_Index(SEXP List, void *out)
 {
 	SEXP DS = VECTOR_ELT(List, 0);
 	const int A = (AFreq_RefPtr==NULL) ?
 		AFreq_Index : AFreq_RefPtr[AFreq_Index++];
-	if (A == 0) return FC_AF_DS_Ref(DS);
+	if (A == 0) { NF_AF_DS_Ref(DS, out); return; }
 
 	const int nAllele = Rf_asInteger(VECTOR_ELT(List, 1));
-	if (A >= nAllele) return ScalarReal(R_NaN);
+	if (A >= nAllele) NF_RETURN(double, R_NaN);
 
 	int n, m;
 	get_ds_n_m(DS, n, m);
-	if (A > m) return ScalarReal(R_NaN);
+	if (A > m) NF_RETURN(double, R_NaN);
 
 	double sum=0;
 	int num = 0, nrow = n/m;
@@ -346,13 +348,14 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_DS_Index(SEXP List)
 	{
 		double p = sum / (num * AFreq_Ploidy);
 		if (AFreq_Minor && p>0.5) p = 1 - p;
-		return ScalarReal(p);
+		NF_RETURN(double, p);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AF_DS_Index)
 
 /// Get allele frequency
-COREARRAY_DLL_EXPORT SEXP FC_AF_Allele(SEXP List)
+static void NF_AF_Allele(SEXP List, void *out)
 {
 	SEXP Ref = STRING_ELT(AFreq_Allele, AFreq_Index++);
 	int A = -1;
@@ -379,16 +382,17 @@ COREARRAY_DLL_EXPORT SEXP FC_AF_Allele(SEXP List)
 	{
 		double p = double(m) / n;
 		if (AFreq_Minor && p>0.5) p = 1 - p;
-		return ScalarReal(p);
+		NF_RETURN(double, p);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AF_Allele)
 
 
 // ======================================================================
 
 /// Get reference allele count
-COREARRAY_DLL_EXPORT SEXP FC_AC_Ref(SEXP Geno)
+static void NF_AC_Ref(SEXP Geno, void *out)
 {
 	const size_t N = XLENGTH(Geno);
 	size_t n, m;
@@ -401,11 +405,12 @@ COREARRAY_DLL_EXPORT SEXP FC_AC_Ref(SEXP Geno)
 		n = N - n - m;  // allele count for alternative
 		if (n < m) m = n;
 	}
-	return ScalarInteger(m);
+	NF_RETURN(int, m);
 }
+NF_FUNC_INT(AC_Ref)
 
 /// Get reference allele frequency from dosage
-COREARRAY_DLL_EXPORT SEXP FC_AC_DS_Ref(SEXP DS)
+static void NF_AC_DS_Ref(SEXP DS, void *out)
 {
 	int n, m, num=0;
 	get_ds_n_m(DS, n, m);
@@ -428,13 +433,14 @@ COREARRAY_DLL_EXPORT SEXP FC_AC_DS_Ref(SEXP DS)
 		double totac = double(num * AFreq_Ploidy) / m;
 		double ac = totac - sum;
 		if (AFreq_Minor && ac>0.5*totac) ac = totac - ac;
-		return ScalarReal(ac);
+		NF_RETURN(double, ac);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AC_DS_Ref)
 
 /// Get allele count
-COREARRAY_DLL_EXPORT SEXP FC_AC_Index(SEXP List)
+static void NF_AC_Index(SEXP List, void *out)
 {
 	SEXP Geno = VECTOR_ELT(List, 0);
 	const int nAllele = Rf_asInteger(VECTOR_ELT(List, 1));
@@ -460,23 +466,24 @@ COREARRAY_DLL_EXPORT SEXP FC_AC_Index(SEXP List)
 	} else
 		ans = NA_INTEGER;
 	
-	return ScalarInteger(ans);
+	NF_RETURN(int, ans);
 }
+NF_FUNC_INT(AC_Index)
 
 /// Get allele count
-COREARRAY_DLL_EXPORT SEXP FC_AC_DS_Index(SEXP List)
+static void NF_AC_DS_Index(SEXP List, void *out)
 {
 	SEXP DS = VECTOR_ELT(List, 0);
 	const int A = (AFreq_RefPtr==NULL) ?
 		AFreq_Index : AFreq_RefPtr[AFreq_Index++];
-	if (A == 0) return FC_AC_DS_Ref(DS);
+	if (A == 0) { NF_AC_DS_Ref(DS, out); return; }
 
 	const int nAllele = Rf_asInteger(VECTOR_ELT(List, 1));
-	if (A >= nAllele) return ScalarReal(R_NaN);
+	if (A >= nAllele) NF_RETURN(double, R_NaN);
 
 	int n, m;
 	get_ds_n_m(DS, n, m);
-	if (A > m) return ScalarReal(R_NaN);
+	if (A > m) NF_RETURN(double, R_NaN);
 
 	double sum=0;
 	int num = 0, nrow = n/m;
@@ -496,13 +503,14 @@ COREARRAY_DLL_EXPORT SEXP FC_AC_DS_Index(SEXP List)
 	{
 		double sum2 = num * AFreq_Ploidy - sum;
 		if (AFreq_Minor && sum>sum2) sum = sum2;
-		return ScalarReal(sum);
+		NF_RETURN(double, sum);
 	} else
-		return ScalarReal(R_NaN);
+		NF_RETURN(double, R_NaN);
 }
+NF_FUNC_REAL(AC_DS_Index)
 
 /// Get allele count
-COREARRAY_DLL_EXPORT SEXP FC_AC_Allele(SEXP List)
+static void NF_AC_Allele(SEXP List, void *out)
 {
 	SEXP Geno = VECTOR_ELT(List, 0);
 	int A = GetIndexOfAllele(
@@ -537,8 +545,9 @@ COREARRAY_DLL_EXPORT SEXP FC_AC_Allele(SEXP List)
 		}
 	}
 
-	return ScalarInteger(ans);
+	NF_RETURN(int, ans);
 }
+NF_FUNC_INT(AC_Allele)
 
 
 // ======================================================================
@@ -592,23 +601,13 @@ COREARRAY_DLL_EXPORT SEXP FC_AlleleCount(SEXP List)
 		break;
 
 	default:
-		memset((void*)pV, 0, sizeof(int)*nAllele);
+		// histogram of alleles
+		vector<size_t> cnt(nAllele > 0 ? nAllele : 1, 0);
 		if (TYPEOF(Geno) == RAWSXP)
-		{
-			C_UInt8 *p = (C_UInt8*)RAW(Geno);
-			for (size_t n=N; n > 0; n--)
-			{
-				C_UInt8 g = *p++;
-				if (g < nAllele) pV[g] ++;
-			}
-		} else {
-			int *p = INTEGER(Geno);
-			for (size_t n=N; n > 0; n--)
-			{
-				int g = *p++;
-				if ((0 <= g) && (g < nAllele)) pV[g] ++;
-			}
-		}
+			vec_u8_histogram((const C_UInt8*)RAW(Geno), N, &cnt[0], nAllele, NA_RAW);
+		else
+			vec_i32_histogram(INTEGER(Geno), N, &cnt[0], nAllele, NA_INTEGER);
+		for (int i=0; i < nAllele; i++) pV[i] = cnt[i];
 	}
 
 	return rv;
@@ -873,4 +872,25 @@ COREARRAY_DLL_EXPORT SEXP FC_SetPackedGeno(SEXP index, SEXP dosage, SEXP rawmat)
 	return R_NilValue;
 }
 
+
+// ======================================================================
+
+/// register the native functions used in seqApply()
+COREARRAY_DLL_LOCAL void Register_Native_Functions()
+{
+	#define REG_NF(nm, type)    \
+		RegisterNativeApply((DL_FUNC)&FC_##nm, &NF_##nm, type)
+
+	REG_NF(Missing_PerVariant, REALSXP);
+	REG_NF(AF_Ref, REALSXP);       REG_NF(AF_DS_Ref, REALSXP);
+	REG_NF(AF_Index, REALSXP);     REG_NF(AF_DS_Index, REALSXP);
+	REG_NF(AF_Allele, REALSXP);
+	REG_NF(AC_Ref, INTSXP);        REG_NF(AC_DS_Ref, REALSXP);
+	REG_NF(AC_Index, INTSXP);      REG_NF(AC_DS_Index, REALSXP);
+	REG_NF(AC_Allele, INTSXP);
+
+	R_RegisterCCallable("SeqArray", "SEQ_RegisterNativeApply",
+		(DL_FUNC)&SEQ_RegisterNativeApply);
+}
+
 } // extern "C"
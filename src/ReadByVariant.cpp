@@ -45,21 +45,26 @@ CApply_Variant_Basic::CApply_Variant_Basic(CFileInfo &File,
 
 void CApply_Variant_Basic::ReadData(SEXP val)
 {
-	C_Int32 st = Position, one = 1;
 	if (COREARRAY_SV_INTEGER(SVType))
 	{
-		GDS_Array_ReadData(Node, &st, &one, INTEGER(val), svInt32);
+		ReadData(INTEGER(val), svInt32);
 	} else if (COREARRAY_SV_FLOAT(SVType))
 	{
-		GDS_Array_ReadData(Node, &st, &one, REAL(val), svFloat64);
+		ReadData(REAL(val), svFloat64);
 	} else if (COREARRAY_SV_STRING(SVType))
 	{
 		string s;
-		GDS_Array_ReadData(Node, &st, &one, &s, svStrUTF8);
+		ReadData(&s, svStrUTF8);
 		SET_STRING_ELT(val, 0, mkChar(s.c_str()));
 	}
 }
 
+void CApply_Variant_Basic::ReadData(void *Base, C_SVType sv)
+{
+	C_Int32 st = Position, one = 1;
+	GDS_Array_ReadData(Node, &st, &one, Base, sv);
+}
+
 SEXP CApply_Variant_Basic::NeedRData(int &nProtected)
 {
 	if (VarNode == NULL)
@@ -163,6 +168,7 @@ CApply_Variant_Geno::CApply_Variant_Geno(): CApply_Variant()
 	SampNum = 0; Ploidy = 0;
 	UseRaw = FALSE;
 	VarIntGeno = VarRawGeno = NULL;
+	Prefetch = NULL;
 }
 
 CApply_Variant_Geno::CApply_Variant_Geno(CFileInfo &File, int use_raw):
@@ -200,84 +206,77 @@ void CApply_Variant_Geno::Init(CFileInfo &File, int use_raw)
 	pSampSel = File.Selection().GetStructSample();
 
 	ExtPtr.reset(SiteCount);
+	GenoPtr.reset(CellCount);
 	VarIntGeno = VarRawGeno = NULL;
+	Prefetch = NULL;
 	Reset();
 }
 
-int CApply_Variant_Geno::_ReadGenoData(int *Base)
+C_UInt8 CApply_Variant_Geno::_ReadGenoBytes(C_UInt8 *Base, C_Int64 Index,
+	C_UInt8 NumIndexRaw)
 {
-	C_UInt8 NumIndexRaw;
-	C_Int64 Index;
-	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
-
 	if (NumIndexRaw >= 1)
 	{
 		CdIterator it;
 		GDS_Iter_Position(Node, &it, Index*SiteCount);
 		read_geno(it, Base, pSampSel);
 
-		const int bit_mask = 0x03;
-		int missing = bit_mask;
+		const C_UInt8 bit_mask = 0x03;
+		C_UInt8 missing = bit_mask;
+		if (NumIndexRaw > 4) NumIndexRaw = 4;
+
+		C_UInt8 *s = (C_UInt8*)ExtPtr.get();
 		for (C_UInt8 i=1; i < NumIndexRaw; i++)
 		{
-			GDS_Iter_Position(Node, &it, (Index+1)*SiteCount);
-			read_geno(it, (C_UInt8*)ExtPtr.get(), pSampSel);
-
-			C_UInt8 shift = i * 2;
-			C_UInt8 *s = (C_UInt8*)ExtPtr.get();
-			int *p = Base;
-			for (ssize_t n=CellCount; n > 0; n--)
-				*p++ |= int(*s++) << shift;
-
+			GDS_Iter_Position(Node, &it, (Index+i)*SiteCount);
+			read_geno(it, s, pSampSel);
+			vec_u8_or_shl(Base, s, CellCount, i*2);
 			missing = (missing << 2) | bit_mask;
 		}
 
 		return missing;
 	} else {
-		memset(Base, 0, sizeof(int)*CellCount);
+		memset(Base, 0, CellCount);
 		return 0;
 	}
 }
 
-C_UInt8 CApply_Variant_Geno::_ReadGenoData(C_UInt8 *Base)
+int CApply_Variant_Geno::_ReadGenoData(int *Base)
 {
 	C_UInt8 NumIndexRaw;
 	C_Int64 Index;
 	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
 
-	if (NumIndexRaw >= 1)
+	// the first 4 bit layers in bytes
+	C_UInt8 *g = (C_UInt8*)GenoPtr.get();
+	int missing = _ReadGenoBytes(g, Index, NumIndexRaw);
+	vec_i32_cvt_u8(Base, g, CellCount, 0, 0);
+
+	// more than 4 bit layers
+	if (NumIndexRaw > 4)
 	{
 		CdIterator it;
-		GDS_Iter_Position(Node, &it, Index*SiteCount);
-		read_geno(it, Base, pSampSel);
-
-		const C_UInt8 bit_mask = 0x03;
-		C_UInt8 missing = bit_mask;
-		if (NumIndexRaw > 4)
+		C_UInt8 *s = (C_UInt8*)ExtPtr.get();
+		for (C_UInt8 i=4; i < NumIndexRaw; i++)
 		{
-			NumIndexRaw = 4;
-			warning("RAW type may not be sufficient to store genotypes.");
+			GDS_Iter_Position(Node, &it, (Index+i)*SiteCount);
+			read_geno(it, s, pSampSel);
+			vec_i32_or_u8_shl(Base, s, CellCount, i*2);
+			missing = (missing << 2) | 0x03;
 		}
+	}
 
-		for (C_UInt8 i=1; i < NumIndexRaw; i++)
-		{
-			GDS_Iter_Position(Node, &it, (Index+1)*SiteCount);
-			read_geno(it, (C_UInt8*)ExtPtr.get(), pSampSel);
-
-			C_UInt8 shift = i * 2;
-			C_UInt8 *s = (C_UInt8*)ExtPtr.get();
-			C_UInt8 *p = Base;
-			for (ssize_t n=CellCount; n > 0; n--)
-				*p++ |= (*s++) << shift;
-
-			missing = (missing << 2) | bit_mask;
-		}
+	return missing;
+}
 
-		return missing;
-	} else {
-		memset(Base, 0, CellCount);
-		return 0;
-	}
+C_UInt8 CApply_Variant_Geno::_ReadGenoData(C_UInt8 *Base)
+{
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+	if (NumIndexRaw > 4)
+		warning("RAW type may not be sufficient to store genotypes.");
+	return _ReadGenoBytes(Base, Index, NumIndexRaw);
 }
 
 void CApply_Variant_Geno::ReadData(SEXP val)
@@ -294,15 +293,20 @@ void CApply_Variant_Geno::ReadData(SEXP val)
 	}
 }
 
+bool CApply_Variant_Geno::NeedIntGeno()
+{
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+	return (NumIndexRaw > 4);
+}
+
 SEXP CApply_Variant_Geno::NeedRData(int &nProtected)
 {
 	bool int_type;
 	if (UseRaw == NA_INTEGER)
 	{
-		C_UInt8 NumIndexRaw;
-		C_Int64 Index;
-		GenoIndex->GetInfo(Position, Index, NumIndexRaw);
-		int_type = (NumIndexRaw > 4);
+		int_type = NeedIntGeno();
 	} else if (UseRaw == FALSE)
 		int_type = true;
 	else
@@ -330,8 +334,23 @@ SEXP CApply_Variant_Geno::NeedRData(int &nProtected)
 
 void CApply_Variant_Geno::ReadGenoData(int *Base)
 {
-	int missing = _ReadGenoData(Base);
-	vec_i32_replace(Base, CellCount, missing, NA_INTEGER);
+	if (Prefetch && Prefetch->Pop(Position, Base))
+		return;
+
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+
+	if (NumIndexRaw <= 4)
+	{
+		// decode in bytes, then widen and replace missing values in one pass
+		C_UInt8 *g = (C_UInt8*)GenoPtr.get();
+		C_UInt8 missing = _ReadGenoBytes(g, Index, NumIndexRaw);
+		vec_i32_cvt_u8(Base, g, CellCount, missing, NA_INTEGER);
+	} else {
+		int missing = _ReadGenoData(Base);
+		vec_i32_replace(Base, CellCount, missing, NA_INTEGER);
+	}
 }
 
 void CApply_Variant_Geno::ReadGenoData(C_UInt8 *Base)
@@ -340,6 +359,34 @@ void CApply_Variant_Geno::ReadGenoData(C_UInt8 *Base)
 	vec_i8_replace((C_Int8*)Base, CellCount, missing, NA_RAW);
 }
 
+void CApply_Variant_Geno::CountGeno(size_t &n_ref, size_t &n_miss, int *buf)
+{
+	if (Prefetch && Prefetch->Pop(Position, buf))
+	{
+		vec_i32_count2(buf, CellCount, 0, NA_INTEGER, &n_ref, &n_miss);
+		return;
+	}
+
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+
+	if (NumIndexRaw == 0)
+	{
+		// no genotype, all missing
+		n_ref = 0; n_miss = CellCount;
+	} else if (NumIndexRaw <= 4)
+	{
+		// all bits set for missing, and a reference allele has no bit set
+		C_UInt8 *g = (C_UInt8*)GenoPtr.get();
+		C_UInt8 missing = _ReadGenoBytes(g, Index, NumIndexRaw);
+		vec_i8_count2((const char*)g, CellCount, 0, missing, &n_ref, &n_miss);
+	} else {
+		ReadGenoData(buf);
+		vec_i32_count2(buf, CellCount, 0, NA_INTEGER, &n_ref, &n_miss);
+	}
+}
+
 
 
 // =====================================================================
@@ -381,112 +428,111 @@ SEXP CApply_Variant_Dosage::NeedRData(int &nProtected)
 	return VarDosage;
 }
 
-void CApply_Variant_Dosage::ReadDosage(int *Base)
+void CApply_Variant_Dosage::_ReadDosageBytes(C_UInt8 *Base, C_Int64 Index,
+	C_UInt8 NumIndexRaw, bool alt)
 {
-	int *p = (int *)ExtPtr2.get();
-	int missing = _ReadGenoData(p);
+	C_UInt8 *p = (C_UInt8 *)GenoPtr.get();
+	C_UInt8 missing = _ReadGenoBytes(p, Index, NumIndexRaw);
 
-	// count the number of reference allele
+	// count the number of reference (or alternative) allele
 	if (Ploidy == 2) // diploid
 	{
-		vec_i32_cnt_dosage2(p, Base, SampNum, 0, missing, NA_INTEGER);
+		if (!alt)
+		{
+			vec_i8_cnt_dosage2((int8_t *)p, (int8_t *)Base, SampNum, 0,
+				missing, NA_RAW);
+		} else {
+			vec_i8_cnt_dosage_alt2((int8_t *)p, (int8_t *)Base, SampNum, 0,
+				missing, NA_RAW);
+		}
 	} else {
-		for (int n=SampNum; n > 0; n--)
+		for (ssize_t n=SampNum; n > 0; n--)
 		{
-			int cnt = 0;
+			C_UInt8 cnt = 0;
 			for (int m=Ploidy; m > 0; m--, p++)
 			{
-				if (*p == 0)
-				{
-					if (cnt != NA_INTEGER) cnt ++;
-				} else if (*p == missing)
-					cnt = NA_INTEGER;
+				if (*p == missing)
+					cnt = NA_RAW;
+				else if (((*p == 0) != alt) && (cnt != NA_RAW))
+					cnt ++;
 			}
 			*Base ++ = cnt;
 		}
 	}
 }
 
-void CApply_Variant_Dosage::ReadDosageAlt(int *Base)
+void CApply_Variant_Dosage::_ReadDosageInt(int *Base, bool alt)
 {
 	int *p = (int *)ExtPtr2.get();
 	int missing = _ReadGenoData(p);
 
-	// count the number of reference allele
+	// count the number of reference (or alternative) allele
 	if (Ploidy == 2) // diploid
 	{
-		vec_i32_cnt_dosage_alt2(p, Base, SampNum, 0, missing, NA_INTEGER);
+		if (!alt)
+			vec_i32_cnt_dosage2(p, Base, SampNum, 0, missing, NA_INTEGER);
+		else
+			vec_i32_cnt_dosage_alt2(p, Base, SampNum, 0, missing, NA_INTEGER);
 	} else {
-		for (int n=SampNum; n > 0; n--)
+		for (ssize_t n=SampNum; n > 0; n--)
 		{
 			int cnt = 0;
 			for (int m=Ploidy; m > 0; m--, p++)
 			{
-				if (*p != 0)
-				{
-					if (cnt != NA_INTEGER) cnt ++;
-				} else if (*p == missing)
+				if (*p == missing)
 					cnt = NA_INTEGER;
+				else if (((*p == 0) != alt) && (cnt != NA_INTEGER))
+					cnt ++;
 			}
 			*Base ++ = cnt;
 		}
 	}
 }
 
-void CApply_Variant_Dosage::ReadDosage(C_UInt8 *Base)
+void CApply_Variant_Dosage::_ReadDosage(int *Base, bool alt)
 {
-	C_UInt8 *p = (C_UInt8 *)ExtPtr2.get();
-	C_UInt8 missing = _ReadGenoData(p);
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
 
-	// count the number of reference allele
-	if (Ploidy == 2) // diploid
+	if ((NumIndexRaw <= 4) && (Ploidy < NA_RAW))
 	{
-		vec_i8_cnt_dosage2((int8_t *)p, (int8_t *)Base, SampNum, 0,
-			missing, NA_RAW);
-	} else {
-		C_UInt8 *p = (C_UInt8 *)ExtPtr.get();
-		for (int n=SampNum; n > 0; n--)
-		{
-			C_UInt8 cnt = 0;
-			for (int m=Ploidy; m > 0; m--, p++)
-			{
-				if (*p == 0)
-				{
-					if (cnt != NA_RAW) cnt ++;
-				} else if (*p == missing)
-					cnt = NA_RAW;
-			}
-			*Base ++ = cnt;
-		}
-	}
+		// count in bytes without the integer genotypes, and then widen
+		C_UInt8 *d = (C_UInt8 *)ExtPtr2.get();
+		_ReadDosageBytes(d, Index, NumIndexRaw, alt);
+		vec_i32_cvt_u8(Base, d, SampNum, NA_RAW, NA_INTEGER);
+	} else
+		_ReadDosageInt(Base, alt);
 }
 
-void CApply_Variant_Dosage::ReadDosageAlt(C_UInt8 *Base)
+void CApply_Variant_Dosage::_ReadDosage(C_UInt8 *Base, bool alt)
 {
-	C_UInt8 *p = (C_UInt8 *)ExtPtr2.get();
-	C_UInt8 missing = _ReadGenoData(p);
+	C_UInt8 NumIndexRaw;
+	C_Int64 Index;
+	GenoIndex->GetInfo(Position, Index, NumIndexRaw);
+	if (NumIndexRaw > 4)
+		warning("RAW type may not be sufficient to store genotypes.");
+	_ReadDosageBytes(Base, Index, NumIndexRaw, alt);
+}
 
-	// count the number of reference allele
-	if (Ploidy == 2) // diploid
-	{
-		vec_i8_cnt_dosage_alt2((int8_t *)p, (int8_t *)Base, SampNum, 0,
-			missing, NA_RAW);
-	} else {
-		C_UInt8 *p = (C_UInt8 *)ExtPtr.get();
-		for (int n=SampNum; n > 0; n--)
-		{
-			C_UInt8 cnt = 0;
-			for (int m=Ploidy; m > 0; m--, p++)
-			{
-				if (*p != 0)
-				{
-					if (cnt != NA_RAW) cnt ++;
-				} else if (*p == missing)
-					cnt = NA_RAW;
-			}
-			*Base ++ = cnt;
-		}
-	}
+void CApply_Variant_Dosage::ReadDosage(int *Base)
+{
+	_ReadDosage(Base, false);
+}
+
+void CApply_Variant_Dosage::ReadDosageAlt(int *Base)
+{
+	_ReadDosage(Base, true);
+}
+
+void CApply_Variant_Dosage::ReadDosage(C_UInt8 *Base)
+{
+	_ReadDosage(Base, false);
+}
+
+void CApply_Variant_Dosage::ReadDosageAlt(C_UInt8 *Base)
+{
+	_ReadDosage(Base, true);
 }
 
 
@@ -556,12 +602,17 @@ void CApply_Variant_Phase::Init(CFileInfo &File, bool use_raw)
 
 void CApply_Variant_Phase::ReadData(SEXP val)
 {
-	CdIterator it;
-	GDS_Iter_Position(Node, &it, ssize_t(Position)*SiteCount);
 	if (UseRaw)
-		GDS_Iter_RDataEx(&it, RAW(val), SiteCount, svInt8, &Selection[0]);
+		ReadData(RAW(val), svInt8);
 	else
-		GDS_Iter_RDataEx(&it, INTEGER(val), SiteCount, svInt32, &Selection[0]);
+		ReadData(INTEGER(val), svInt32);
+}
+
+void CApply_Variant_Phase::ReadData(void *Base, C_SVType sv)
+{
+	CdIterator it;
+	GDS_Iter_Position(Node, &it, ssize_t(Position)*SiteCount);
+	GDS_Iter_RDataEx(&it, Base, SiteCount, sv, &Selection[0]);
 }
 
 SEXP CApply_Variant_Phase::NeedRData(int &nProtected)
@@ -610,6 +661,32 @@ CApply_Variant_Info::CApply_Variant_Info(CFileInfo &File,
 }
 
 void CApply_Variant_Info::ReadData(SEXP val)
+{
+	if (GetNumIndex() <= 0) return;
+	if (COREARRAY_SV_INTEGER(SVType))
+	{
+		ReadData(INTEGER(val), svInt32);
+	} else if (COREARRAY_SV_FLOAT(SVType))
+	{
+		ReadData(REAL(val), svFloat64);
+	} else if (COREARRAY_SV_STRING(SVType))
+	{
+		vector<string> buffer(XLENGTH(val));
+		ReadData(&buffer[0], svStrUTF8);
+		for (size_t i=0; i < buffer.size(); i++)
+			SET_STRING_ELT(val, i, mkChar(buffer[i].c_str()));
+	}
+}
+
+int CApply_Variant_Info::GetNumIndex()
+{
+	C_Int64 IndexRaw;
+	int NumIndexRaw;
+	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw);
+	return (NumIndexRaw > 0) ? NumIndexRaw : 0;
+}
+
+void CApply_Variant_Info::ReadData(void *Base, C_SVType sv)
 {
 	C_Int64 IndexRaw;
 	int NumIndexRaw;
@@ -619,20 +696,7 @@ void CApply_Variant_Info::ReadData(SEXP val)
 	{
 		C_Int32 st[2]  = { (C_Int32)IndexRaw, 0 };
 		C_Int32 cnt[2] = { NumIndexRaw, BaseNum };
-
-		if (COREARRAY_SV_INTEGER(SVType))
-		{
-			GDS_Array_ReadData(Node, st, cnt, INTEGER(val), svInt32);
-		} else if (COREARRAY_SV_FLOAT(SVType))
-		{
-			GDS_Array_ReadData(Node, st, cnt, REAL(val), svFloat64);
-		} else if (COREARRAY_SV_STRING(SVType))
-		{
-			vector<string> buffer(XLENGTH(val));
-			GDS_Array_ReadData(Node, st, cnt, &buffer[0], svStrUTF8);
-			for (size_t i=0; i < buffer.size(); i++)
-				SET_STRING_ELT(val, i, mkChar(buffer[i].c_str()));
-		}
+		GDS_Array_ReadData(Node, st, cnt, Base, sv);
 	}
 }
 
@@ -707,6 +771,32 @@ void CApply_Variant_Format::Init(CFileInfo &File, const char *var_name)
 }
 
 void CApply_Variant_Format::ReadData(SEXP val)
+{
+	if (GetNumIndex() <= 0) return;
+	if (COREARRAY_SV_INTEGER(SVType))
+	{
+		ReadData(INTEGER(val), svInt32);
+	} else if (COREARRAY_SV_FLOAT(SVType))
+	{
+		ReadData(REAL(val), svFloat64);
+	} else if (COREARRAY_SV_STRING(SVType))
+	{
+		vector<string> buffer(XLENGTH(val));
+		ReadData(&buffer[0], svStrUTF8);
+		for (size_t i=0; i < buffer.size(); i++)
+			SET_STRING_ELT(val, i, mkChar(buffer[i].c_str()));
+	}
+}
+
+int CApply_Variant_Format::GetNumIndex()
+{
+	C_Int64 IndexRaw;
+	int NumIndexRaw;
+	VarIndex->GetInfo(Position, IndexRaw, NumIndexRaw);
+	return (NumIndexRaw > 0) ? NumIndexRaw : 0;
+}
+
+void CApply_Variant_Format::ReadData(void *Base, C_SVType sv)
 {
 	C_Int64 IndexRaw;
 	int NumIndexRaw;
@@ -717,20 +807,7 @@ void CApply_Variant_Format::ReadData(SEXP val)
 		C_Int32 st[2]  = { (C_Int32)IndexRaw, 0 };
 		C_Int32 cnt[2] = { NumIndexRaw, (C_Int32)_TotalSampNum };
 		SelPtr[0] = NeedTRUEs(NumIndexRaw);
-
-		if (COREARRAY_SV_INTEGER(SVType))
-		{
-			GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, INTEGER(val), svInt32);
-		} else if (COREARRAY_SV_FLOAT(SVType))
-		{
-			GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, REAL(val), svFloat64);
-		} else if (COREARRAY_SV_STRING(SVType))
-		{
-			vector<string> buffer(XLENGTH(val));
-			GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, &buffer[0], svStrUTF8);
-			for (size_t i=0; i < buffer.size(); i++)
-				SET_STRING_ELT(val, i, mkChar(buffer[i].c_str()));
-		}
+		GDS_Array_ReadDataEx(Node, st, cnt, SelPtr, Base, sv);
 	}
 }
 
@@ -801,6 +878,75 @@ int CApply_Variant_NumAllele::GetNumAllele()
 	return GetNumOfAllele(strbuf.c_str());
 }
 
+
+
+// =====================================================================
+// Native functions for seqApply()
+
+static vector<TNativeApply> NativeApplyList;
+
+COREARRAY_DLL_LOCAL void RegisterNativeApply(DL_FUNC call,
+	TNativeApplyFunc func, int out_type)
+{
+	if (!call || !func)
+		throw ErrSeqArray("Invalid native function.");
+	if ((out_type != INTSXP) && (out_type != REALSXP))
+		throw ErrSeqArray("The native function should return integer or double.");
+	for (size_t i=0; i < NativeApplyList.size(); i++)
+	{
+		TNativeApply &p = NativeApplyList[i];
+		if (p.Call == call)
+			{ p.Func = func; p.OutType = out_type; return; }
+	}
+	TNativeApply p = { call, func, out_type };
+	NativeApplyList.push_back(p);
+}
+
+/// get the C function in '.Call(fn, ...)', or NULL
+static DL_FUNC get_dotcall_fn(SEXP fn, SEXP env)
+{
+	if (TYPEOF(fn) == SYMSXP)
+		fn = findVar(fn, env);
+	if (TYPEOF(fn) == PROMSXP)
+		fn = eval(fn, env);
+	if (TYPEOF(fn) == VECSXP)  // NativeSymbolInfo
+		fn = RGetListElement(fn, "address");
+	return (TYPEOF(fn) == EXTPTRSXP) ? R_ExternalPtrAddrFn(fn) : NULL;
+}
+
+COREARRAY_DLL_LOCAL const TNativeApply *FindNativeApply(SEXP FUN, SEXP rho)
+{
+	if (NativeApplyList.empty() || TYPEOF(FUN) != CLOSXP)
+		return NULL;
+	// no additional argument
+	SEXP dots = findVar(R_DotsSymbol, rho);
+	if ((dots != R_UnboundValue) && (dots != R_MissingArg))
+		return NULL;
+	// function(x)
+	SEXP args = FORMALS(FUN);
+	if (Rf_length(args) != 1) return NULL;
+	// the expression of body, .Call(fn, x)
+	SEXP body = BODY(FUN);
+	if (TYPEOF(body) == BCODESXP)  // byte-compiled
+		body = VECTOR_ELT(CDR(body), 0);
+	if (TYPEOF(body) != LANGSXP || Rf_length(body) != 3)
+		return NULL;
+	SEXP f = CAR(body);
+	if (TYPEOF(f) == SYMSXP) f = findFun(f, CLOENV(FUN));
+	if (f != findFun(install(".Call"), R_BaseEnv))
+		return NULL;
+	if (CADDR(body) != TAG(args))
+		return NULL;
+	// find the native function
+	DL_FUNC fn = get_dotcall_fn(CADR(body), CLOENV(FUN));
+	if (fn)
+	{
+		for (size_t i=0; i < NativeApplyList.size(); i++)
+			if (NativeApplyList[i].Call == fn) return &NativeApplyList[i];
+	}
+	return NULL;
+}
+
 }
 
 
@@ -825,6 +971,27 @@ COREARRAY_DLL_LOCAL const char *Txt_Apply_VarIdx[] =
 
 
 
+/// register a native per-variant function, no C++ exception is passed to
+/// the caller which could be C code in another package
+COREARRAY_DLL_EXPORT void SEQ_RegisterNativeApply(DL_FUNC call,
+	void (*func)(SEXP, void*), int out_type)
+{
+	bool has_error = false;
+	try {
+		RegisterNativeApply(call, func, out_type);
+	}
+	catch (std::exception &E) {
+		GDS_SetError(E.what());
+		has_error = true;
+	}
+	catch (...) {
+		GDS_SetError("Fail to register the native function.");
+		has_error = true;
+	}
+	if (has_error) error("%s", GDS_GetError());
+}
+
+
 /// Apply functions over margins on a working space
 COREARRAY_DLL_EXPORT SEXP SEQ_Apply_Variant(SEXP gdsfile, SEXP var_name,
 	SEXP FUN, SEXP as_is, SEXP var_index, SEXP param, SEXP rho)
@@ -860,6 +1027,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_Apply_Variant(SEXP gdsfile, SEXP var_name,
 		// initialize the GDS Node list
 
 		CVarApplyList NodeList;
+		CGenoPrefetchPtr Prefetch;
 
 		// for-loop
 		for (int i=0; i < Rf_length(var_name); i++)
@@ -880,8 +1048,15 @@ COREARRAY_DLL_EXPORT SEXP SEQ_Apply_Variant(SEXP gdsfile, SEXP var_name,
 				NodeList.push_back(new CApply_Variant_Chrom(File));
 			} else if (s == "genotype")
 			{
-				NodeList.push_back(
-					new CApply_Variant_Geno(File, use_raw_flag));
+				CApply_Variant_Geno *p = new CApply_Variant_Geno(File, use_raw_flag);
+				NodeList.push_back(p);
+				// decode integer genotypes in a background thread
+				if ((use_raw_flag == FALSE) && !Prefetch.Ptr &&
+					(GetNumOfThread() > 1))
+				{
+					Prefetch.Ptr = CGenoPrefetch::New(File);
+					p->SetPrefetch(Prefetch.Ptr);
+				}
 			} else if (s == "phase")
 			{
 				NodeList.push_back(
@@ -1004,6 +1179,15 @@ COREARRAY_DLL_EXPORT SEXP SEQ_Apply_Variant(SEXP gdsfile, SEXP var_name,
 		map<SEXP, SEXP> R_fcall_map;
 		R_fcall_map[R_call_param] = R_fcall;
 
+		// the native function if FUN is a registered C function
+		const TNativeApply *Native = NULL;
+		if ((VarIdx == 0) && (DatType==2 || DatType==3))
+		{
+			Native = FindNativeApply(FUN, rho);
+			if (Native && (Native->OutType != (DatType==2 ? INTSXP : REALSXP)))
+				Native = NULL;
+		}
+
 
 		// ===========================================================
 		// for-loop calling
@@ -1052,62 +1236,69 @@ COREARRAY_DLL_EXPORT SEXP SEQ_Apply_Variant(SEXP gdsfile, SEXP var_name,
 				}
 			}
 
-			// call R function
-			SEXP val = eval(R_fcall, rho);
-
-			// store data
-			switch (DatType)
+			if (Native)
 			{
-			case 1:  // list
-				if (dup_flag) val = duplicate(val);
-				SET_ELEMENT(rv_ans, ans_index, val);
-				break;
-			case 2:  // integer
-				*((int*)R_rv_ptr) = Rf_asInteger(val);
-				R_rv_ptr += sizeof(int);
-				break;
-			case 3:  // double
-				*((double*)R_rv_ptr) = Rf_asReal(val);
-				R_rv_ptr += sizeof(double);
-				break;
-			case 4:  // character
-				SET_STRING_ELT(rv_ans, ans_index, Rf_asChar(val));
-				break;
-			case 5:  // logical
-				*((int*)R_rv_ptr) = Rf_asLogical(val);
-				R_rv_ptr += sizeof(int);
-				break;
-			case 6:  // raw
-				*R_rv_ptr = Rf_asInteger(val);
-				R_rv_ptr ++;
-				break;
-			case 7:  // connection
-				if (OutputConn->text)
+				// call the native function on the data without R evaluation
+				(*Native->Func)(R_call_param, R_rv_ptr);
+				R_rv_ptr += (DatType==2) ? sizeof(int) : sizeof(double);
+			} else {
+				// call R function
+				SEXP val = eval(R_fcall, rho);
+
+				// store data
+				switch (DatType)
 				{
-					if (Rf_isList(val))
-					{
-						throw ErrSeqArray("the user-defined function should return a character vector.");
-					} else if (!Rf_isString(val))
+				case 1:  // list
+					if (dup_flag) val = duplicate(val);
+					SET_ELEMENT(rv_ans, ans_index, val);
+					break;
+				case 2:  // integer
+					*((int*)R_rv_ptr) = Rf_asInteger(val);
+					R_rv_ptr += sizeof(int);
+					break;
+				case 3:  // double
+					*((double*)R_rv_ptr) = Rf_asReal(val);
+					R_rv_ptr += sizeof(double);
+					break;
+				case 4:  // character
+					SET_STRING_ELT(rv_ans, ans_index, Rf_asChar(val));
+					break;
+				case 5:  // logical
+					*((int*)R_rv_ptr) = Rf_asLogical(val);
+					R_rv_ptr += sizeof(int);
+					break;
+				case 6:  // raw
+					*R_rv_ptr = Rf_asInteger(val);
+					R_rv_ptr ++;
+					break;
+				case 7:  // connection
+					if (OutputConn->text)
 					{
-						val = AS_CHARACTER(val);
-					}
-					size_t n = XLENGTH(val);
-					for (size_t i=0; i < n; i++)
-					{
-						ConnPutText(OutputConn, "%s\n", CHAR(STRING_ELT(val, i)));
+						if (Rf_isList(val))
+						{
+							throw ErrSeqArray("the user-defined function should return a character vector.");
+						} else if (!Rf_isString(val))
+						{
+							val = AS_CHARACTER(val);
+						}
+						size_t n = XLENGTH(val);
+						for (size_t i=0; i < n; i++)
+						{
+							ConnPutText(OutputConn, "%s\n", CHAR(STRING_ELT(val, i)));
+						}
+					} else {
+						if (TYPEOF(val) != RAWSXP)
+							throw ErrSeqArray("the user-defined function should return a RAW vector.");
+						size_t n = XLENGTH(val);
+						size_t m = R_WriteConnection(OutputConn, RAW(val), n);
+						if (n != m)
+							throw ErrSeqArray("error in writing to a connection.");
 					}
-				} else {
-					if (TYPEOF(val) != RAWSXP)
-						throw ErrSeqArray("the user-defined function should return a RAW vector.");
-					size_t n = XLENGTH(val);
-					size_t m = R_WriteConnection(OutputConn, RAW(val), n);
-					if (n != m)
-						throw ErrSeqArray("error in writing to a connection.");
+					break;
+				case 8:  // gdsn.class
+					RAppendGDS(OutputGDS, val);
+					break;
 				}
-				break;
-			case 8:  // gdsn.class
-				RAppendGDS(OutputGDS, val);
-				break;
 			}
 			ans_index ++;
 
@@ -20,6 +20,8 @@
 // If not, see <http://www.gnu.org/licenses/>.
 
 #include "Index.h"
+#include <R_ext/Rdynload.h>
+#include <pthread.h>
 
 
 namespace SeqArray
@@ -41,6 +43,11 @@ public:
 	CApply_Variant_Basic(CFileInfo &File, const char *var_name);
 	virtual void ReadData(SEXP val);
 	virtual SEXP NeedRData(int &nProtected);
+
+	/// read the value at the current variant in the type 'sv'
+	void ReadData(void *Base, C_SVType sv);
+	/// data type of the GDS node
+	inline C_SVType GetSVType() const { return SVType; }
 };
 
 
@@ -74,6 +81,8 @@ public:
 
 // =====================================================================
 
+class CGenoPrefetch;
+
 /// Object for reading genotypes variant by variant
 class COREARRAY_DLL_LOCAL CApply_Variant_Geno: public CApply_Variant
 {
@@ -84,9 +93,14 @@ protected:
 	int UseRaw;  ///< whether use RAW type: FALSE, int; TRUE, raw; NA: auto
 	TSelection::TSampStruct *pSampSel;   ///< the structure for selected samples
 	VEC_AUTO_PTR ExtPtr;  ///< a pointer to the additional buffer
+	VEC_AUTO_PTR GenoPtr; ///< a buffer of genotypes in bytes before widening
 	SEXP VarIntGeno;    ///< genotype R integer object
 	SEXP VarRawGeno;    ///< genotype R RAW object
+	CGenoPrefetch *Prefetch;  ///< genotypes decoded in advance, or NULL
 
+	/// read at most 4 bit layers of genotypes in bytes, return the missing code
+	inline C_UInt8 _ReadGenoBytes(C_UInt8 *Base, C_Int64 Index,
+		C_UInt8 NumIndexRaw);
 	inline int _ReadGenoData(int *Base);
 	inline C_UInt8 _ReadGenoData(C_UInt8 *Base);
 
@@ -100,6 +114,13 @@ public:
 
 	void Init(CFileInfo &File, int use_raw);
 
+	/// read genotypes from another GDS node and indexing, e.g., the node
+	/// of a GDS file opened in a worker thread
+	inline void SetSource(PdAbstractArray node, CGenoIndex *idx)
+		{ Node = node; GenoIndex = idx; }
+	/// use the integer genotypes decoded by a background thread if possible
+	inline void SetPrefetch(CGenoPrefetch *p) { Prefetch = p; }
+
 	virtual void ReadData(SEXP val);
 	virtual SEXP NeedRData(int &nProtected);
 
@@ -107,6 +128,14 @@ public:
 	void ReadGenoData(int *Base);
 	/// read genotypes in unsigned 8-bit intetger
 	void ReadGenoData(C_UInt8 *Base);
+	/// return true if the genotypes at the current variant have more than
+	/// 4 bit layers and need 32-bit integers
+	bool NeedIntGeno();
+
+	/// count the reference and missing alleles at the current variant on the
+	/// 2-bit genotype codes in bytes, without widening and replacing missing
+	/// values ('buf' has CellCount integers for more than 4 bit layers)
+	void CountGeno(size_t &n_ref, size_t &n_miss, int *buf);
 };
 
 
@@ -119,6 +148,14 @@ protected:
 	SEXP VarDosage;        ///< dosage R object
 	VEC_AUTO_PTR ExtPtr2;  ///< a pointer to the additional buffer for dosages
 	bool IsAlt;            ///< if true, ReadData() returns the dosage of alternative alleles
+
+	/// count alleles in bytes from at most 4 bit layers
+	inline void _ReadDosageBytes(C_UInt8 *Base, C_Int64 Index,
+		C_UInt8 NumIndexRaw, bool alt);
+	/// count alleles from the integer genotypes (more than 4 bit layers)
+	inline void _ReadDosageInt(int *Base, bool alt);
+	inline void _ReadDosage(int *Base, bool alt);
+	inline void _ReadDosage(C_UInt8 *Base, bool alt);
 public:
 	/// constructor
 	CApply_Variant_Dosage(CFileInfo &File, int use_raw, bool alt);
@@ -161,6 +198,9 @@ public:
 
 	virtual void ReadData(SEXP val);
 	virtual SEXP NeedRData(int &nProtected);
+
+	/// read phasing information at the current variant in the type 'sv'
+	void ReadData(void *Base, C_SVType sv);
 };
 
 
@@ -181,6 +221,15 @@ public:
 
 	virtual void ReadData(SEXP val);
 	virtual SEXP NeedRData(int &nProtected);
+
+	/// the number of entries at the current variant (0 if no data)
+	int GetNumIndex();
+	/// read BaseNum*GetNumIndex() values at the current variant in the type 'sv'
+	void ReadData(void *Base, C_SVType sv);
+	/// data type of the GDS node
+	inline C_SVType GetSVType() const { return SVType; }
+	/// the number of values in an entry
+	inline C_Int32 GetBaseNum() const { return BaseNum; }
 };
 
 
@@ -208,6 +257,13 @@ public:
 
 	virtual void ReadData(SEXP val);
 	virtual SEXP NeedRData(int &nProtected);
+
+	/// the number of entries at the current variant (0 if no data)
+	int GetNumIndex();
+	/// read SampNum*GetNumIndex() values at the current variant in the type 'sv'
+	void ReadData(void *Base, C_SVType sv);
+	/// data type of the GDS node
+	inline C_SVType GetSVType() const { return SVType; }
 };
 
 
@@ -229,6 +285,106 @@ public:
 	int GetNumAllele();
 };
 
+
+// =====================================================================
+
+/// the prototype of a native per-variant function, 'x' is the object passed
+/// to the R function, and the result (int or double) is saved in 'out'
+typedef void (*TNativeApplyFunc)(SEXP x, void *out);
+
+/// the native function replacing an R-callable C function in seqApply()
+struct COREARRAY_DLL_LOCAL TNativeApply
+{
+	DL_FUNC Call;           ///< the R-callable C function, e.g., FC_AF_Ref
+	TNativeApplyFunc Func;  ///< the native function
+	int OutType;            ///< the type of output, INTSXP or REALSXP
+};
+
+/// register a native function for the R-callable C function 'call'
+COREARRAY_DLL_LOCAL void RegisterNativeApply(DL_FUNC call,
+	TNativeApplyFunc func, int out_type);
+
+/// get the native function if FUN is 'function(x) .Call(call, x)' with a
+/// registered 'call' and no additional argument in '...', otherwise NULL
+COREARRAY_DLL_LOCAL const TNativeApply *FindNativeApply(SEXP FUN, SEXP rho);
+
+
+// =====================================================================
+
+/// the kernels of the multithreaded scan over the selected variants
+enum TScanKernel
+{
+	tsGenotype = 0,  ///< genotypes in a ploidy x sample x variant int array
+	tsDosage,        ///< dosages of reference in a sample x variant int matrix
+	tsDosageAlt,     ///< dosages of alternative in a sample x variant int matrix
+	tsAF_Ref,        ///< reference allele frequencies (double)
+	tsAC_Ref,        ///< reference allele counts (int)
+	tsMissing        ///< missing rates per variant (double)
+};
+
+/// the number of threads given by the option 'seqarray.multithread'
+COREARRAY_DLL_LOCAL int GetNumOfThread();
+
+/// run the kernel over the selected variants using 'nThread' threads, each
+/// thread opens the GDS file itself with its own decompression cursor;
+/// return false without scanning if the file is not opened read-only
+COREARRAY_DLL_LOCAL bool ThreadScan(CFileInfo &File, TScanKernel kernel,
+	int nThread, bool minor, void *out);
+
+
+/// Read-ahead of integer genotypes: a background thread with its own GDS
+/// file handle decompresses and decodes the selected variants in order into
+/// a ring buffer, while the main thread runs the user-defined function
+class COREARRAY_DLL_LOCAL CGenoPrefetch
+{
+public:
+	/// return a new object for the current selection, or NULL if the file is
+	/// not read-only or there are too few selected variants
+	static CGenoPrefetch *New(CFileInfo &File);
+	/// stop the background thread, close the file handle
+	~CGenoPrefetch();
+
+	/// copy the genotypes at 'pos' to 'out', return false if the variant is
+	/// not prefetched (then the caller reads it by itself)
+	bool Pop(C_Int32 pos, int *out);
+
+private:
+	static const int NUM_SLOT = 4;  ///< the number of chunks in the ring
+
+	CFileInfo *Owner;        ///< the associated file information
+	PdGDSFile GDSFile;       ///< the GDS file handle used in the thread
+	CGenoIndex GenoIndex;    ///< the copy of genotype indexing
+	CApply_Variant_Geno *Reader;  ///< the genotype reader used in the thread
+	vector<C_Int32> VarIdx;  ///< the indices of selected variants
+	size_t CellCount;        ///< the number of genotypes per variant
+	size_t ChunkSize;        ///< the number of variants per chunk
+	VEC_AUTO_PTR Buffer;     ///< NUM_SLOT chunks of genotypes
+	size_t Cursor;           ///< the next index in VarIdx for Pop()
+	size_t NumProduced;      ///< the number of decoded chunks
+	size_t NumConsumed;      ///< the chunks before it can be overwritten
+	bool Stop;               ///< stop the thread
+	bool Failed;             ///< error in the thread
+	bool Started;            ///< the thread is running
+	pthread_t Thread;
+	pthread_mutex_t Mutex;
+	pthread_cond_t CondProduce, CondConsume;
+
+	CGenoPrefetch(CFileInfo &File);
+	void Run();
+	static void *thread_proc(void *ptr);
+
+	friend void DoneGenoPrefetch(CFileInfo &File);
+};
+
+/// the owner of a CGenoPrefetch object in a local scope
+class COREARRAY_DLL_LOCAL CGenoPrefetchPtr
+{
+public:
+	CGenoPrefetch *Ptr;
+	CGenoPrefetchPtr(CGenoPrefetch *p=NULL): Ptr(p) { }
+	~CGenoPrefetchPtr() { if (Ptr) delete Ptr; }
+};
+
 }
 
 
@@ -239,4 +395,10 @@ extern "C"
 COREARRAY_DLL_EXPORT SEXP SEQ_Apply_Variant(SEXP gdsfile, SEXP var_name,
 	SEXP FUN, SEXP as_is, SEXP var_index, SEXP param, SEXP rho);
 
+/// register a native per-variant function, callable from other packages
+/// via R_GetCCallable("SeqArray", "SEQ_RegisterNativeApply"); an invalid
+/// function raises an R error instead of a C++ exception
+COREARRAY_DLL_EXPORT void SEQ_RegisterNativeApply(DL_FUNC call,
+	void (*func)(SEXP, void*), int out_type);
+
 } // extern "C"
@@ -42,6 +42,10 @@ extern "C"
 
 static const char *INFO_SEL_NUM_SAMPLE  = "# of selected samples: %s\n";
 static const char *INFO_SEL_NUM_VARIANT = "# of selected variants: %s\n";
+static const char *WARN_POS_INDEX =
+	"@position_index is not correct, and the positions are sorted in memory; "
+	"please call 'seqOptimize(..., target=\"chromosome\")' to update the "
+	"position indexing.";
 
 
 using namespace SeqArray;
@@ -88,6 +92,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_FilterPushEmpty(SEXP gdsfile)
 			TSelection &s = f.Push_Selection(false, false);
 			memset(s.pSample, TRUE, f.SampleNum());
 			memset(s.pVariant, TRUE, f.VariantNum());
+			s.ClearStructVariant();
 		} else
 			throw ErrSeqArray("The GDS file is closed or invalid.");
 	COREARRAY_CATCH
@@ -139,7 +144,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceSample(SEXP gdsfile, SEXP samp_id,
 		TSelection &Sel = File.Selection();
 		Sel.ClearStructSample();
 
-		C_BOOL *pArray = Sel.pSample;
+		C_BOOL *pArray = Sel.Sample_W();
 		int Count = File.SampleNum();
 		PdAbstractArray varSamp = File.GetObj("sample.id", TRUE);
 		C_SVType sv = GDS_Array_GetSVType(varSamp);
@@ -243,7 +248,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceSample2(SEXP gdsfile, SEXP samp_sel,
 		TSelection &Sel = File.Selection();
 		Sel.ClearStructSample();
 
-		C_BOOL *pArray = Sel.pSample;
+		C_BOOL *pArray = Sel.Sample_W();
 		int Count = File.SampleNum();
 
 		if (Rf_isLogical(samp_sel) || IS_RAW(samp_sel))
@@ -367,7 +372,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceVariant(SEXP gdsfile, SEXP var_id,
 		TSelection &Sel = File.Selection();
 		Sel.ClearStructVariant();
 
-		C_BOOL *pArray = Sel.pVariant;
+		C_BOOL *pArray = Sel.Variant_W();
 		int Count = File.VariantNum();
 		PdAbstractArray varVariant = File.GetObj("variant.id", TRUE);
 		C_SVType sv = GDS_Array_GetSVType(varVariant);
@@ -471,7 +476,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceVariant2(SEXP gdsfile, SEXP var_sel,
 		CFileInfo &File = GetFileInfo(gdsfile);
 		TSelection &Sel = File.Selection();
 
-		C_BOOL *pArray = Sel.pVariant;
+		C_BOOL *pArray = Sel.Variant_W();
 		int Count = File.VariantNum();
 
 		if (Rf_isLogical(var_sel) || IS_RAW(var_sel))
@@ -652,6 +657,8 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceChrom(SEXP gdsfile, SEXP include,
 		}
 	}
 
+	bool warn_pos_index = false;
+
 	COREARRAY_TRY
 
 		CFileInfo &File = GetFileInfo(gdsfile);
@@ -659,7 +666,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceChrom(SEXP gdsfile, SEXP include,
 		Sel.ClearStructVariant();
 
 		const size_t array_size = File.VariantNum();
-		C_BOOL *sel_array = Sel.pVariant;
+		C_BOOL *sel_array = Sel.Variant_W();
 		vector<C_BOOL> tmp_array;
 		if (IsIntersect) tmp_array.resize(array_size);
 
@@ -736,45 +743,23 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceChrom(SEXP gdsfile, SEXP include,
 
 			if (varPos)
 			{
-				// Chromosome ==> CRangeSet
+				// Chromosome ==> CRangeSet, binary search on the position index
+				CPosIndex &PosIdx = File.PosIndex();
+				warn_pos_index = PosIdx.TakeInvalid();
+				const C_Int32 *pPos = &((*varPos)[0]);
+				const C_BOOL *mask = IsIntersect ? sel_array : NULL;
 				map<string, CRangeSet>::iterator it;
 				for (it=RngSets.begin(); it != RngSets.end(); it++)
 				{
 					CChromIndex::TRangeList &rng = Chrom.Map[it->first];
 					CRangeSet &RngSet = it->second;
+					vector<int> st(RngSet.Size()), ed(RngSet.Size());
+					RngSet.GetRanges(&st[0], &ed[0]);
 					vector<CChromIndex::TRange>::const_iterator p;
 					for (p=rng.begin(); p != rng.end(); p++)
 					{
-						size_t i=p->Start, n=p->Length;
-						C_Int32 *s = &((*varPos)[0]) + i;
-						if (RngSet.Size() == 1)
-						{
-							// there is only a range, optimized for this situation
-							int st, ed;
-							RngSet.GetRanges(&st, &ed);
-							if (!IsIntersect)
-							{
-								for (; n > 0; n--, i++, s++)
-									if (st<=*s && *s<=ed) array[i] = TRUE;
-							} else {
-								C_BOOL *b = &sel_array[i];
-								for (; n > 0; n--, i++, s++)
-									if (*b++ && st<=*s && *s<=ed) array[i] = TRUE;
-							}
-						} else {
-							if (!IsIntersect)
-							{
-								for (; n > 0; n--, i++)
-									if (RngSet.IsIncluded(*s++)) array[i] = TRUE;
-							} else {
-								C_BOOL *b = &sel_array[i];
-								for (; n > 0; n--, i++, s++)
-								{
-									if (*b++)
-										if (RngSet.IsIncluded(*s)) array[i] = TRUE;
-								}
-							}
-						}
+						for (size_t k=0; k < st.size(); k++)
+							PosIdx.SetRange(*p, pPos, st[k], ed[k], array, mask);
 					}
 				}
 			}
@@ -792,7 +777,105 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceChrom(SEXP gdsfile, SEXP include,
 
 		UNPROTECT(nProtected);
 
-	COREARRAY_CATCH
+	CORE_CATCH(has_error = true);
+	if (has_error) error("%s", GDS_GetError());
+	// raise the warning after leaving the C++ scope
+	if (warn_pos_index) warning("%s", WARN_POS_INDEX);
+	return rv_ans;
+}
+
+
+// ================================================================
+
+/// set a working space flag with selected chromosomes and positions
+COREARRAY_DLL_EXPORT SEXP SEQ_SetSpacePos(SEXP gdsfile, SEXP chr, SEXP pos,
+	SEXP intersect, SEXP multi_pos, SEXP verbose)
+{
+	int IsIntersect = Rf_asLogical(intersect);
+	if (IsIntersect == NA_INTEGER)
+		error("'intersect' should be either FALSE or TRUE.");
+	int IsMultiPos = Rf_asLogical(multi_pos);
+	if (IsMultiPos == NA_INTEGER)
+		error("'multi.pos' should be either FALSE or TRUE.");
+
+	const R_xlen_t n_pos = XLENGTH(pos);
+	const R_xlen_t n_chr = XLENGTH(chr);
+	if (n_chr != 1 && n_chr != n_pos)
+		error("'chr' should be of length one or the same length as 'pos'.");
+	chr = PROTECT(AS_CHARACTER(chr));
+	pos = PROTECT(AS_INTEGER(pos));
+
+	bool warn_pos_index = false;
+
+	COREARRAY_TRY
+
+		CFileInfo &File = GetFileInfo(gdsfile);
+		TSelection &Sel = File.Selection();
+		Sel.ClearStructVariant();
+
+		const size_t array_size = File.VariantNum();
+		C_BOOL *sel_array = Sel.Variant_W();
+		vector<C_BOOL> tmp_array(array_size, FALSE);
+		C_BOOL *array = &tmp_array[0];
+		const C_BOOL *mask = IsIntersect ? sel_array : NULL;
+
+		CChromIndex &Chrom = File.Chromosome();
+		const C_Int32 *pPos = array_size ? &File.Position()[0] : NULL;
+		CPosIndex &PosIdx = File.PosIndex();
+		warn_pos_index = PosIdx.TakeInvalid();
+		const int *pP = INTEGER(pos);
+
+		// binary search each (chr, pos) on the position index
+		for (R_xlen_t idx=0; idx < n_pos; idx++)
+		{
+			if (pP[idx] == NA_INTEGER) continue;
+			SEXP s = STRING_ELT(chr, (n_chr > 1) ? idx : 0);
+			if (s == NA_STRING) continue;
+			map<string, CChromIndex::TRangeList>::iterator it =
+				Chrom.Map.find(CHAR(s));
+			if (it == Chrom.Map.end()) continue;
+			CChromIndex::TRangeList &rng = it->second;
+			vector<CChromIndex::TRange>::const_iterator p;
+			for (p=rng.begin(); p != rng.end(); p++)
+				PosIdx.SetRange(*p, pPos, pP[idx], pP[idx], array, mask);
+		}
+
+		if (!IsMultiPos)
+		{
+			// only the first of consecutive duplicate positions is used,
+			//   according to "$chrom_pos"
+			for (size_t i=0; i < array_size; i++)
+			{
+				if (!array[i]) continue;
+				ssize_t j = (ssize_t)i - 1;
+				if (mask)
+					while (j >= 0 && !mask[j]) j--;
+				if (j >= 0 && pPos[j]==pPos[i])
+				{
+					const string &s = Chrom[j];  // sequential access in C_RLE
+					if (Chrom[i] == s) array[i] = FALSE;
+				}
+			}
+		}
+
+		if (IsIntersect)
+		{
+			C_BOOL *p = sel_array, *s = array;
+			for (size_t n=array_size; n > 0; n--)
+				(*p++) &= (*s++);
+		} else {
+			memcpy(sel_array, array, array_size);
+		}
+		if (Rf_asLogical(verbose) == TRUE)
+			Rprintf(INFO_SEL_NUM_VARIANT, PrettyInt(File.VariantSelNum()));
+
+		UNPROTECT(2);
+
+	CORE_CATCH(has_error = true);
+	if (has_error) error("%s", GDS_GetError());
+	// raise the warning after leaving the C++ scope
+	if (warn_pos_index) warning("%s", WARN_POS_INDEX);
+	return rv_ans;
 }
 
 
@@ -833,7 +916,7 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SetSpaceAnnotID(SEXP gdsfile, SEXP ID, SEXP Verbos
 		}
 
 		const int SIZE = 4096;
-		C_BOOL *p = Sel.pVariant;
+		C_BOOL *p = Sel.Variant_W();
 		vector<string> buffer(SIZE);
 		for (C_Int32 st=0; len > 0; )
 		{
@@ -951,12 +1034,12 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SplitSelection(SEXP gdsfile, SEXP split,
 		C_BOOL *sel;
 		if (strcmp(split_str, "by.variant") == 0)
 		{
-			sel = s.pVariant;
+			sel = s.Variant_W();
 			SelectCount = File.VariantSelNum();
 			s.ClearStructVariant();
 		} else if (strcmp(split_str, "by.sample") == 0)
 		{
-			sel = s.pSample;
+			sel = s.Sample_W();
 			SelectCount = File.SampleSelNum();
 			s.ClearStructSample();
 		} else {
@@ -1032,12 +1115,12 @@ COREARRAY_DLL_EXPORT SEXP SEQ_SplitSelectionX(SEXP gdsfile, SEXP index, SEXP spl
 		{
 			ntot = File.VariantNum();
 			base_sel = (C_BOOL*)RAW(sel_variant);
-			p_sel = s.pVariant;
+			p_sel = s.Variant_W();
 			s.ClearSelectVariant();
 		} else {
 			ntot = File.SampleNum();
 			base_sel = (C_BOOL*)RAW(sel_sample);
-			p_sel = s.pSample;
+			p_sel = s.Sample_W();
 			memset(p_sel, 0, ntot);
 		}
 
@@ -1257,8 +1340,8 @@ COREARRAY_DLL_EXPORT SEXP SEQ_System()
 	COREARRAY_TRY
 
 		int nProtect = 0;
-		rv_ans = PROTECT(NEW_LIST(3));
-		SEXP nm = PROTECT(NEW_CHARACTER(3));
+		rv_ans = PROTECT(NEW_LIST(5));
+		SEXP nm = PROTECT(NEW_CHARACTER(5));
 		nProtect += 2;
 		SET_NAMES(rv_ans, nm);
 
@@ -1340,6 +1423,26 @@ COREARRAY_DLL_EXPORT SEXP SEQ_System()
 		for (int i=0; i < (int)ss.size(); i++)
 			SET_STRING_ELT(SIMD, i, mkChar(ss[i].c_str()));
 
+		// CPU features detected at runtime
+		SET_ELEMENT(rv_ans, 3, mkString(vec_cpu_features()));
+		SET_STRING_ELT(nm, 3, mkChar("cpu.flag"));
+
+		// the implementations of vectorized kernels
+		const int nk = vec_kernel_num();
+		SEXP Impl = PROTECT(NEW_CHARACTER(nk));
+		SEXP ImplNm = PROTECT(NEW_CHARACTER(nk));
+		nProtect += 2;
+		SET_ELEMENT(rv_ans, 4, Impl);
+		SET_STRING_ELT(nm, 4, mkChar("vectorization"));
+		for (int i=0; i < nk; i++)
+		{
+			const char *impl = NULL;
+			const char *name = vec_kernel_info(i, &impl);
+			SET_STRING_ELT(ImplNm, i, mkChar(name));
+			SET_STRING_ELT(Impl, i, mkChar(impl));
+		}
+		SET_NAMES(Impl, ImplNm);
+
 		UNPROTECT(nProtect);
 
 	COREARRAY_CATCH
@@ -1481,6 +1584,7 @@ COREARRAY_DLL_EXPORT void R_init_SeqArray(DllInfo *info)
 	#define CALL(name, num)	   { #name, (DL_FUNC)&name, num }
 
 	extern void Register_SNPRelate_Functions();
+	extern void Register_Native_Functions();
 
 	extern SEXP SEQ_GetData(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 	extern SEXP SEQ_ConvBED2GDS(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
@@ -1493,8 +1597,10 @@ COREARRAY_DLL_EXPORT void R_init_SeqArray(DllInfo *info)
 
 	extern SEXP SEQ_BApply_Variant(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 	extern SEXP SEQ_Unit_SlidingWindows(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+	extern SEXP SEQ_ThreadScan(SEXP, SEXP, SEXP);
+	extern SEXP SEQ_GenoQC(SEXP, SEXP, SEXP, SEXP);
 
-	extern SEXP SEQ_bgzip_create(SEXP);
+	extern SEXP SEQ_bgzip_create(SEXP, SEXP, SEXP);
 
 	static R_CallMethodDef callMethods[] =
 	{
@@ -1514,6 +1620,7 @@ COREARRAY_DLL_EXPORT void R_init_SeqArray(DllInfo *info)
 		CALL(SEQ_SetSpaceSample, 4),        CALL(SEQ_SetSpaceSample2, 4),
 		CALL(SEQ_SetSpaceVariant, 4),       CALL(SEQ_SetSpaceVariant2, 4),
 		CALL(SEQ_SetSpaceChrom, 7),         CALL(SEQ_SetSpaceAnnotID, 3),
+		CALL(SEQ_SetSpacePos, 6),
 
 		CALL(SEQ_SplitSelection, 5),        CALL(SEQ_SplitSelectionX, 9),
 		CALL(SEQ_GetSpace, 2),
@@ -1523,6 +1630,7 @@ COREARRAY_DLL_EXPORT void R_init_SeqArray(DllInfo *info)
 		CALL(SEQ_GetData, 6),
 		CALL(SEQ_Apply_Sample, 7),          CALL(SEQ_Apply_Variant, 7),
 		CALL(SEQ_BApply_Variant, 7),        CALL(SEQ_Unit_SlidingWindows, 7),
+		CALL(SEQ_ThreadScan, 3),            CALL(SEQ_GenoQC, 4),
 
 		CALL(SEQ_ConvBED2GDS, 6),
 		CALL(SEQ_SelectFlag, 2),            CALL(SEQ_ResetChrom, 1),
@@ -1530,7 +1638,7 @@ COREARRAY_DLL_EXPORT void R_init_SeqArray(DllInfo *info)
 		CALL(SEQ_IntAssign, 2),             CALL(SEQ_AppendFill, 3),
 		CALL(SEQ_ClearVarMap, 1),
 
-		CALL(SEQ_bgzip_create, 1),
+		CALL(SEQ_bgzip_create, 3),
 
 		CALL(SEQ_Progress, 2),              CALL(SEQ_ProgressAdd, 2),
 
@@ -1539,7 +1647,10 @@ COREARRAY_DLL_EXPORT void R_init_SeqArray(DllInfo *info)
 
 	R_registerRoutines(info, NULL, callMethods, NULL, NULL);
 	Register_SNPRelate_Functions();
+	Register_Native_Functions();
 	Init_GDS_Routines();
+	// select the vectorized kernels according to the CPU
+	vec_init_dispatch();
 }
 
 } // extern "C"
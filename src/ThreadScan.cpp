@@ -0,0 +1,486 @@
+// ===========================================================
+//
+// ThreadScan.cpp: Multithreaded scan and read-ahead of selected variants
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "ReadByVariant.h"
+#include <algorithm>
+
+
+namespace SeqArray
+{
+
+using namespace Vectorization;
+
+/// the number of variants in a block assigned to a thread
+static const int SCAN_BLOCK_SIZE = 256;
+
+static const char *Txt_Scan_Kernel[] =
+{
+	"genotype", "dosage", "dosage_alt", "af_ref", "ac_ref", "missing", NULL
+};
+
+
+/// the number of threads given by the option 'seqarray.multithread'
+COREARRAY_DLL_LOCAL int GetNumOfThread()
+{
+	SEXP opt = GetOption1(install("seqarray.multithread"));
+	int n = 1;
+	if (Rf_isLogical(opt) && (Rf_length(opt) == 1))
+	{
+		if (LOGICAL(opt)[0] == TRUE)
+			n = GDS_Mach_GetNumOfCores();
+	} else if (Rf_isNumeric(opt) && (Rf_length(opt) == 1))
+	{
+		n = Rf_asInteger(opt);
+		if (n == NA_INTEGER) n = 1;
+	}
+	return (n >= 1) ? n : 1;
+}
+
+
+/// The engine scanning the selected variants with multiple threads, each
+/// thread has its own GDS file handle and decompression cursor
+class COREARRAY_DLL_LOCAL CThreadScan
+{
+public:
+	CThreadScan(CFileInfo &File, const char *fn, TScanKernel kernel,
+		int nThread, bool minor);
+	~CThreadScan();
+
+	/// run the kernel and save the results (one element per variant for
+	/// tsAF_Ref, tsAC_Ref and tsMissing, or one matrix per variant otherwise)
+	void Run(void *out);
+
+private:
+	/// the variables in a worker thread
+	struct TWorker
+	{
+		PdGDSFile File;        ///< the GDS file handle
+		CGenoIndex GenoIndex;  ///< the copy of genotype indexing
+		CApply_Variant_Dosage *Reader;  ///< genotype and dosage reader
+		VEC_AUTO_PTR Buffer;   ///< the buffer of genotypes
+		TWorker(): File(NULL), Reader(NULL) { }
+	};
+
+	TScanKernel Kernel;
+	bool Minor;
+	vector<TWorker> Workers;
+	vector<C_Int32> VarIdx;  ///< the indices of selected variants
+	void *Output;
+	size_t NextIdx;          ///< the next variant to be assigned
+	PdThreadMutex Mutex;     ///< serializing the assignment and error
+	string ErrMsg;
+
+	/// close the GDS files and free the readers
+	void Done();
+	/// get the next block, return false if no block left
+	bool NextBlock(size_t &st, size_t &ed);
+	/// run the kernel on the block in the worker
+	void RunBlock(TWorker &W, size_t st, size_t ed);
+	/// the thread procedure
+	static void thread_proc(PdThread, int Index, void *Param);
+};
+
+
+CThreadScan::CThreadScan(CFileInfo &File, const char *fn, TScanKernel kernel,
+	int nThread, bool minor)
+{
+	Kernel = kernel;
+	Minor = minor;
+	Output = NULL;
+	NextIdx = 0;
+	Mutex = NULL;
+
+	// the indices of selected variants
+	TSelection &Sel = File.Selection();
+	size_t nVariant = File.VariantSelNum();
+	VarIdx.reserve(nVariant);
+	C_BOOL *p = Sel.pVariant;
+	for (C_Int32 i=Sel.varStart; i < (C_Int32)Sel.varEnd; i++)
+		if (p[i]) VarIdx.push_back(i);
+
+	// the number of threads
+	size_t nBlock = (VarIdx.size() + SCAN_BLOCK_SIZE - 1) / SCAN_BLOCK_SIZE;
+	if ((size_t)nThread > nBlock) nThread = nBlock;
+	if (nThread < 1) nThread = 1;
+
+	// open the GDS file for each thread, in the main thread
+	CGenoIndex &GenoIndex = File.GenoIndex();
+	Workers.resize(nThread);
+	try {
+		for (int i=0; i < nThread; i++)
+		{
+			TWorker &W = Workers[i];
+			W.File = GDS_File_Open(fn, TRUE, FALSE, FALSE);
+			W.GenoIndex = GenoIndex;
+			W.Reader = new CApply_Variant_Dosage(File, FALSE,
+				kernel == tsDosageAlt);
+			W.Reader->SetSource(GDS_Node_Path(GDS_File_Root(W.File),
+				"genotype/data", TRUE), &W.GenoIndex);
+			W.Buffer.reset(sizeof(int)*W.Reader->SampNum*W.Reader->Ploidy);
+		}
+		Mutex = GDS_Parallel_InitMutex();
+	} catch (...) {
+		Done();
+		throw;
+	}
+}
+
+CThreadScan::~CThreadScan()
+{
+	Done();
+}
+
+void CThreadScan::Done()
+{
+	for (size_t i=0; i < Workers.size(); i++)
+	{
+		TWorker &W = Workers[i];
+		if (W.Reader) { delete W.Reader; W.Reader = NULL; }
+		if (W.File) { GDS_File_Close(W.File); W.File = NULL; }
+	}
+	if (Mutex) { GDS_Parallel_DoneMutex(Mutex); Mutex = NULL; }
+}
+
+void CThreadScan::Run(void *out)
+{
+	Output = out;
+	NextIdx = 0;
+	ErrMsg.clear();
+	if (Workers.size() > 1)
+		GDS_Parallel_RunThreads(thread_proc, this, Workers.size());
+	else if (!Workers.empty())
+		thread_proc(NULL, 0, this);
+	if (!ErrMsg.empty())
+		throw ErrSeqArray("%s", ErrMsg.c_str());
+}
+
+bool CThreadScan::NextBlock(size_t &st, size_t &ed)
+{
+	GDS_Parallel_LockMutex(Mutex);
+	bool rv = ErrMsg.empty() && (NextIdx < VarIdx.size());
+	if (rv)
+	{
+		st = NextIdx;
+		ed = st + SCAN_BLOCK_SIZE;
+		if (ed > VarIdx.size()) ed = VarIdx.size();
+		NextIdx = ed;
+	}
+	GDS_Parallel_UnlockMutex(Mutex);
+	return rv;
+}
+
+void CThreadScan::RunBlock(TWorker &W, size_t st, size_t ed)
+{
+	CApply_Variant_Dosage &R = *W.Reader;
+	const size_t nSamp = R.SampNum;
+	const size_t N = nSamp * R.Ploidy;
+	int *G = (int*)W.Buffer.get();
+
+	for (size_t i=st; i < ed; i++)
+	{
+		R.Position = VarIdx[i];
+		switch (Kernel)
+		{
+		case tsGenotype:
+			R.ReadGenoData((int*)Output + N*i); break;
+		case tsDosage:
+			R.ReadDosage((int*)Output + nSamp*i); break;
+		case tsDosageAlt:
+			R.ReadDosageAlt((int*)Output + nSamp*i); break;
+		case tsAF_Ref:
+			{
+				size_t n, m;
+				R.CountGeno(m, n, G);
+				n = N - n;
+				double p = R_NaN;
+				if (n > 0)
+				{
+					p = double(m) / n;
+					if (Minor && p>0.5) p = 1 - p;
+				}
+				((double*)Output)[i] = p;
+				break;
+			}
+		case tsAC_Ref:
+			{
+				size_t n, m;
+				R.CountGeno(m, n, G);
+				if (Minor)
+				{
+					n = N - n - m;  // allele count for alternative
+					if (n < m) m = n;
+				}
+				((int*)Output)[i] = m;
+				break;
+			}
+		case tsMissing:
+			{
+				size_t n, m;
+				R.CountGeno(n, m, G);
+				((double*)Output)[i] = (N > 0) ? (double(m) / N) : R_NaN;
+				break;
+			}
+		}
+	}
+}
+
+void CThreadScan::thread_proc(PdThread, int Index, void *Param)
+{
+	CThreadScan *Obj = (CThreadScan*)Param;
+	TWorker &W = Obj->Workers[Index];
+	try {
+		size_t st, ed;
+		while (Obj->NextBlock(st, ed))
+			Obj->RunBlock(W, st, ed);
+	} catch (std::exception &E) {
+		GDS_Parallel_LockMutex(Obj->Mutex);
+		if (Obj->ErrMsg.empty()) Obj->ErrMsg = E.what();
+		GDS_Parallel_UnlockMutex(Obj->Mutex);
+	} catch (...) {
+		GDS_Parallel_LockMutex(Obj->Mutex);
+		if (Obj->ErrMsg.empty()) Obj->ErrMsg = "unknown error in a thread";
+		GDS_Parallel_UnlockMutex(Obj->Mutex);
+	}
+}
+
+
+COREARRAY_DLL_LOCAL bool ThreadScan(CFileInfo &File, TScanKernel kernel,
+	int nThread, bool minor, void *out)
+{
+	// unsaved data might exist if the file is writable
+	if (!File.ReadOnly() || File.FileName().empty())
+		return false;
+	// not worth opening the file again for a single block
+	if (File.VariantSelNum() <= SCAN_BLOCK_SIZE)
+		return false;
+	CThreadScan Scan(File, File.FileName().c_str(), kernel, nThread, minor);
+	Scan.Run(out);
+	return true;
+}
+
+
+
+
+// =====================================================================
+// Read-ahead of genotypes
+
+/// the minimum number of selected variants for read-ahead
+static const size_t PREFETCH_MIN_VARIANT = 64;
+/// the maximum number of bytes in a chunk of the ring buffer
+static const size_t PREFETCH_CHUNK_BYTES = 4*1024*1024;
+
+/// the objects which have not been deleted, used in DoneGenoPrefetch()
+static vector<CGenoPrefetch*> GenoPrefetchList;
+
+CGenoPrefetch *CGenoPrefetch::New(CFileInfo &File)
+{
+	// unsaved data might exist if the file is writable
+	if (!File.ReadOnly() || File.FileName().empty())
+		return NULL;
+	if ((size_t)File.VariantSelNum() < PREFETCH_MIN_VARIANT)
+		return NULL;
+	if (File.SampleSelNum() <= 0)
+		return NULL;
+	return new CGenoPrefetch(File);
+}
+
+CGenoPrefetch::CGenoPrefetch(CFileInfo &File)
+{
+	Owner = &File;
+	GDSFile = NULL;
+	Reader = NULL;
+	Cursor = NumProduced = NumConsumed = 0;
+	Stop = Failed = Started = false;
+
+	// the indices of selected variants
+	TSelection &Sel = File.Selection();
+	VarIdx.reserve(File.VariantSelNum());
+	C_BOOL *p = Sel.pVariant;
+	for (C_Int32 i=Sel.varStart; i < (C_Int32)Sel.varEnd; i++)
+		if (p[i]) VarIdx.push_back(i);
+
+	// open the GDS file in the main thread
+	CGenoIndex &Idx = File.GenoIndex();
+	try {
+		GDSFile = GDS_File_Open(File.FileName().c_str(), TRUE, FALSE, FALSE);
+		GenoIndex = Idx;
+		Reader = new CApply_Variant_Geno(File, FALSE);
+		Reader->SetSource(GDS_Node_Path(GDS_File_Root(GDSFile),
+			"genotype/data", TRUE), &GenoIndex);
+	} catch (...) {
+		if (Reader) delete Reader;
+		if (GDSFile) GDS_File_Close(GDSFile);
+		throw;
+	}
+
+	// the ring buffer
+	CellCount = Reader->SampNum * Reader->Ploidy;
+	ChunkSize = PREFETCH_CHUNK_BYTES / (sizeof(int)*CellCount);
+	if (ChunkSize < 1) ChunkSize = 1;
+	if (ChunkSize > 256) ChunkSize = 256;
+	Buffer.reset(sizeof(int) * CellCount * ChunkSize * NUM_SLOT);
+
+	// start the thread
+	pthread_mutex_init(&Mutex, NULL);
+	pthread_cond_init(&CondProduce, NULL);
+	pthread_cond_init(&CondConsume, NULL);
+	Started = (pthread_create(&Thread, NULL, thread_proc, this) == 0);
+	if (!Started) Failed = true;
+	GenoPrefetchList.push_back(this);
+}
+
+CGenoPrefetch::~CGenoPrefetch()
+{
+	if (Started)
+	{
+		pthread_mutex_lock(&Mutex);
+		Stop = true;
+		pthread_cond_broadcast(&CondProduce);
+		pthread_mutex_unlock(&Mutex);
+		pthread_join(Thread, NULL);
+	}
+	pthread_cond_destroy(&CondConsume);
+	pthread_cond_destroy(&CondProduce);
+	pthread_mutex_destroy(&Mutex);
+	delete Reader;
+	GDS_File_Close(GDSFile);
+	vector<CGenoPrefetch*>::iterator it =
+		find(GenoPrefetchList.begin(), GenoPrefetchList.end(), this);
+	if (it != GenoPrefetchList.end()) GenoPrefetchList.erase(it);
+}
+
+bool CGenoPrefetch::Pop(C_Int32 pos, int *out)
+{
+	// skip the variants not requested
+	size_t i = Cursor;
+	while ((i < VarIdx.size()) && (VarIdx[i] < pos)) i++;
+	Cursor = i;
+	if ((i >= VarIdx.size()) || (VarIdx[i] != pos))
+		return false;
+
+	// wait for the chunk, and release the chunks before it
+	const size_t k = i / ChunkSize;
+	pthread_mutex_lock(&Mutex);
+	if (NumConsumed < k)
+	{
+		NumConsumed = k;
+		pthread_cond_signal(&CondProduce);
+	}
+	while ((NumProduced <= k) && !Failed)
+		pthread_cond_wait(&CondConsume, &Mutex);
+	bool ok = (NumProduced > k);
+	pthread_mutex_unlock(&Mutex);
+	if (!ok) return false;
+
+	// the chunk is not overwritten until NumConsumed > k
+	const int *p = (const int*)Buffer.get() +
+		((k % NUM_SLOT)*ChunkSize + (i % ChunkSize)) * CellCount;
+	memcpy(out, p, sizeof(int)*CellCount);
+	Cursor = i + 1;
+	return true;
+}
+
+void CGenoPrefetch::Run()
+{
+	const size_t nChunk = (VarIdx.size() + ChunkSize - 1) / ChunkSize;
+	try {
+		for (size_t k=0; k < nChunk; k++)
+		{
+			// wait for a free slot
+			pthread_mutex_lock(&Mutex);
+			while (!Stop && (k >= NumConsumed + NUM_SLOT))
+				pthread_cond_wait(&CondProduce, &Mutex);
+			bool stop = Stop;
+			pthread_mutex_unlock(&Mutex);
+			if (stop) return;
+
+			// decompress and decode
+			int *p = (int*)Buffer.get() + (k % NUM_SLOT)*ChunkSize*CellCount;
+			size_t st = k*ChunkSize, ed = st + ChunkSize;
+			if (ed > VarIdx.size()) ed = VarIdx.size();
+			for (size_t i=st; i < ed; i++, p+=CellCount)
+			{
+				Reader->Position = VarIdx[i];
+				Reader->ReadGenoData(p);
+			}
+
+			pthread_mutex_lock(&Mutex);
+			NumProduced = k + 1;
+			pthread_cond_signal(&CondConsume);
+			pthread_mutex_unlock(&Mutex);
+		}
+	} catch (...) {
+		pthread_mutex_lock(&Mutex);
+		Failed = true;
+		pthread_cond_signal(&CondConsume);
+		pthread_mutex_unlock(&Mutex);
+	}
+}
+
+void *CGenoPrefetch::thread_proc(void *ptr)
+{
+	((CGenoPrefetch*)ptr)->Run();
+	return NULL;
+}
+
+COREARRAY_DLL_LOCAL void DoneGenoPrefetch(CFileInfo &File)
+{
+	for (size_t i=GenoPrefetchList.size(); i > 0; i--)
+	{
+		CGenoPrefetch *p = GenoPrefetchList[i-1];
+		if (p->Owner == &File) delete p;
+	}
+}
+
+}
+
+
+extern "C"
+{
+using namespace SeqArray;
+
+/// scan the selected variants with the threads given by the option
+/// 'seqarray.multithread', return NULL if the option is not set
+COREARRAY_DLL_EXPORT SEXP SEQ_ThreadScan(SEXP gdsfile, SEXP kernel, SEXP minor)
+{
+	int nThread = GetNumOfThread();
+	if (nThread <= 1) return R_NilValue;
+	int k = MatchText(CHAR(STRING_ELT(kernel, 0)), Txt_Scan_Kernel);
+	if ((k != tsAF_Ref) && (k != tsAC_Ref) && (k != tsMissing))
+		error("Invalid 'kernel'.");
+	int mi = Rf_asLogical(minor);
+
+	COREARRAY_TRY
+		CFileInfo &File = GetFileInfo(gdsfile);
+		int nVariant = File.VariantSelNum();
+		if (nVariant <= 0)
+			throw ErrSeqArray("There is no selected variant.");
+		File.GetObj("genotype/data", TRUE);
+		rv_ans = PROTECT((k == tsAC_Ref) ?
+			NEW_INTEGER(nVariant) : NEW_NUMERIC(nVariant));
+		if (!ThreadScan(File, (TScanKernel)k, nThread, mi==TRUE,
+				(k == tsAC_Ref) ? (void*)INTEGER(rv_ans) : (void*)REAL(rv_ans)))
+			rv_ans = R_NilValue;
+		UNPROTECT(1);
+	COREARRAY_CATCH
+}
+
+} // extern "C"
@@ -0,0 +1,240 @@
+// ===========================================================
+//
+// VariantQC.cpp: Genotype quality control in a single pass
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "ReadByVariant.h"
+
+
+namespace SeqArray
+{
+
+using namespace Vectorization;
+
+/// Exact test of Hardy-Weinberg equilibrium (Wigginton et al., 2005),
+/// 'prob' is a working buffer
+static double HWE_Exact(int n_het, int n_hom1, int n_hom2, vector<double> &prob)
+{
+	const int n_homr = (n_hom1 < n_hom2) ? n_hom1 : n_hom2;
+	const int n_homc = (n_hom1 < n_hom2) ? n_hom2 : n_hom1;
+	const int n_geno = n_het + n_homr + n_homc;
+	if (n_geno <= 0) return R_NaN;
+	const int rare = 2*n_homr + n_het;
+
+	prob.assign(rare + 1, 0);
+	// the most likely number of heterozygotes
+	int mid = (int)((double)rare * (2*n_geno - rare) / (2*n_geno));
+	if ((rare & 1) ^ (mid & 1)) mid ++;
+	prob[mid] = 1;
+	double sum = 1;
+
+	int homr = (rare - mid) / 2, homc = n_geno - mid - homr;
+	for (int h=mid; h > 1; h -= 2)
+	{
+		prob[h-2] = prob[h] * h * (h - 1.0) / (4.0 * (homr + 1.0) * (homc + 1.0));
+		sum += prob[h-2];
+		homr ++; homc ++;
+	}
+	homr = (rare - mid) / 2; homc = n_geno - mid - homr;
+	for (int h=mid; h <= rare-2; h += 2)
+	{
+		prob[h+2] = prob[h] * 4.0 * homr * homc / ((h + 2.0) * (h + 1.0));
+		sum += prob[h+2];
+		homr --; homc --;
+	}
+
+	// the p-value
+	const double p_obs = prob[n_het];
+	double p = 0;
+	for (int i=0; i <= rare; i++)
+		if (prob[i] <= p_obs) p += prob[i];
+	p /= sum;
+	return (p > 1) ? 1 : p;
+}
+
+}
+
+
+extern "C"
+{
+using namespace SeqArray;
+
+static const char *QC_Var_Names[] =
+{
+	"missing", "ac.ref", "mac", "maf", "n.het", "hwe", NULL
+};
+
+/// Get per-variant missing rates, allele counts, MAC, MAF, the numbers of
+/// heterozygotes and HWE p-values, and per-sample counts of missing alleles,
+/// heterozygotes and called genotypes, decoding genotypes only once
+COREARRAY_DLL_EXPORT SEXP SEQ_GenoQC(SEXP gdsfile, SEXP PerSample,
+	SEXP AlleleCount, SEXP Verbose)
+{
+	const int per_samp = Rf_asLogical(PerSample);
+	const int ac_flag = Rf_asLogical(AlleleCount);
+	const int verbose = Rf_asLogical(Verbose);
+
+	COREARRAY_TRY
+
+		CFileInfo &File = GetFileInfo(gdsfile);
+		const int nVariant = File.VariantSelNum();
+		if (nVariant <= 0)
+			throw ErrSeqArray("There is no selected variant.");
+
+		// the genotype reader, decoding genotypes ahead if multithreaded
+		CApply_Variant_Geno Reader(File, FALSE);
+		CGenoPrefetchPtr Prefetch;
+		if (GetNumOfThread() > 1)
+		{
+			Prefetch.Ptr = CGenoPrefetch::New(File);
+			Reader.SetPrefetch(Prefetch.Ptr);
+		}
+		const int nSamp = Reader.SampNum;
+		const int Ploidy = Reader.Ploidy;
+		const size_t N = (size_t)nSamp * Ploidy;
+		vector<int> Geno(N > 0 ? N : 1);
+
+		// output variables
+		int nProtected = 0;
+		const int nVarOut = ac_flag==TRUE ? 7 : 6;
+		SEXP rv_var = PROTECT(NEW_LIST(nVarOut));
+		SEXP nm_var = PROTECT(NEW_CHARACTER(nVarOut));
+		nProtected += 2;
+		for (int i=0; i < 6; i++)
+			SET_STRING_ELT(nm_var, i, mkChar(QC_Var_Names[i]));
+		double *pMiss = REAL(SET_ELEMENT(rv_var, 0, NEW_NUMERIC(nVariant)));
+		int *pRef = INTEGER(SET_ELEMENT(rv_var, 1, NEW_INTEGER(nVariant)));
+		int *pMAC = INTEGER(SET_ELEMENT(rv_var, 2, NEW_INTEGER(nVariant)));
+		double *pMAF = REAL(SET_ELEMENT(rv_var, 3, NEW_NUMERIC(nVariant)));
+		int *pHet = INTEGER(SET_ELEMENT(rv_var, 4, NEW_INTEGER(nVariant)));
+		double *pHWE = REAL(SET_ELEMENT(rv_var, 5, NEW_NUMERIC(nVariant)));
+		SEXP rv_ac = R_NilValue;
+		if (ac_flag == TRUE)
+		{
+			SET_STRING_ELT(nm_var, 6, mkChar("allele.count"));
+			rv_ac = SET_ELEMENT(rv_var, 6, NEW_LIST(nVariant));
+		}
+		SET_NAMES(rv_var, nm_var);
+
+		int *sMiss=NULL, *sHet=NULL, *sCall=NULL;
+		SEXP rv_samp = R_NilValue;
+		if (per_samp == TRUE)
+		{
+			rv_samp = PROTECT(NEW_LIST(3)); nProtected ++;
+			SEXP nm = PROTECT(NEW_CHARACTER(3)); nProtected ++;
+			SET_STRING_ELT(nm, 0, mkChar("n.miss"));
+			SET_STRING_ELT(nm, 1, mkChar("n.het"));
+			SET_STRING_ELT(nm, 2, mkChar("n.call"));
+			SET_NAMES(rv_samp, nm);
+			sMiss = INTEGER(SET_ELEMENT(rv_samp, 0, NEW_INTEGER(nSamp)));
+			sHet  = INTEGER(SET_ELEMENT(rv_samp, 1, NEW_INTEGER(nSamp)));
+			sCall = INTEGER(SET_ELEMENT(rv_samp, 2, NEW_INTEGER(nSamp)));
+			memset(sMiss, 0, sizeof(int)*nSamp);
+			memset(sHet, 0, sizeof(int)*nSamp);
+			memset(sCall, 0, sizeof(int)*nSamp);
+		}
+
+		vector<double> hwe_buf;
+		vector<size_t> ac_buf;
+		// the numbers of alleles, the same as seqAlleleCount()
+		CApply_Variant_NumAllele NumAllele(File);
+		CProgressStdOut progress(nVariant, 1, verbose==TRUE);
+
+		// for each variant
+		for (int v=0; v < nVariant; v++)
+		{
+			const int *g = &Geno[0];
+			Reader.ReadGenoData(&Geno[0]);
+
+			// allele counts
+			size_t n0, nmiss;
+			vec_i32_count2(g, N, 0, NA_INTEGER, &n0, &nmiss);
+			const size_t nn = N - nmiss;
+			pMiss[v] = (N > 0) ? double(nmiss) / N : R_NaN;
+			pRef[v] = n0;
+			const size_t mac = (n0 < nn - n0) ? n0 : (nn - n0);
+			pMAC[v] = mac;
+			pMAF[v] = (nn > 0) ? double(mac) / nn : R_NaN;
+
+			// genotypes per sample
+			int n_het=0, n_AA=0, n_AB=0, n_BB=0;
+			for (int i=0; i < nSamp; i++, g+=Ploidy)
+			{
+				bool miss=false, het=false;
+				int nref = 0, nm = 0;
+				for (int k=0; k < Ploidy; k++)
+				{
+					if (g[k] == NA_INTEGER)
+						{ miss = true; nm ++; }
+					else {
+						if (g[k] == 0) nref ++;
+						if (g[k] != g[0]) het = true;
+					}
+				}
+				if (!miss)
+				{
+					if (het) n_het ++;
+					if (Ploidy == 2)
+					{
+						if (nref == 2) n_AA ++;
+						else if (nref == 1) n_AB ++;
+						else n_BB ++;
+					}
+				}
+				if (sMiss)
+				{
+					sMiss[i] += nm;
+					if (!miss)
+						{ sCall[i] ++; if (het) sHet[i] ++; }
+				}
+			}
+			pHet[v] = n_het;
+			pHWE[v] = (Ploidy == 2) ? HWE_Exact(n_AB, n_AA, n_BB, hwe_buf) : R_NaN;
+
+			// counts for each allele
+			if (ac_flag == TRUE)
+			{
+				const int nAllele = NumAllele.GetNumAllele();
+				ac_buf.assign(nAllele > 0 ? nAllele : 1, 0);
+				vec_i32_histogram(&Geno[0], N, &ac_buf[0], nAllele, NA_INTEGER);
+				SEXP val = NEW_INTEGER(nAllele);
+				int *pV = INTEGER(val);
+				for (int i=0; i < nAllele; i++) pV[i] = ac_buf[i];
+				SET_ELEMENT(rv_ac, v, val);
+				NumAllele.Next();
+			}
+
+			Reader.Next();
+			progress.Forward();
+		}
+
+		// output
+		rv_ans = PROTECT(NEW_LIST(2)); nProtected ++;
+		SET_ELEMENT(rv_ans, 0, rv_var);
+		SET_ELEMENT(rv_ans, 1, rv_samp);
+		SEXP nm = PROTECT(NEW_CHARACTER(2)); nProtected ++;
+		SET_STRING_ELT(nm, 0, mkChar("variant"));
+		SET_STRING_ELT(nm, 1, mkChar("sample"));
+		SET_NAMES(rv_ans, nm);
+		UNPROTECT(nProtected);
+
+	COREARRAY_CATCH
+}
+
+} // extern "C"
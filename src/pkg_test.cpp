@@ -21,6 +21,8 @@
 
 #include <R_GDS_CPP.h>
 #include "Index.h"
+#include "ReadByVariant.h"
+#include "FloatConv.h"
 #include "vectorization.h"
 #include <R.h>
 #include <Rdefines.h>
@@ -193,6 +195,82 @@ SEXP test_int32_replace(SEXP val, SEXP start, SEXP find, SEXP substitute)
 }
 
 
+SEXP test_histogram(SEXP val, SEXP start, SEXP nval)
+{
+	int st = Rf_asInteger(start) - 1;
+	int nv = Rf_asInteger(nval);
+	int n = XLENGTH(val);
+
+	std::vector<size_t> cnt(nv + 1, 0);
+	size_t nmiss;
+	if (TYPEOF(val) == RAWSXP)
+		nmiss = vec_u8_histogram(RAW(val) + st, n - st, &cnt[0], nv, NA_RAW);
+	else
+		nmiss = vec_i32_histogram(INTEGER(val) + st, n - st, &cnt[0], nv, NA_INTEGER);
+
+	// counts of 0, 1, ..., nval-1 and missing
+	SEXP rv_ans = NEW_INTEGER(nv + 1);
+	for (int i=0; i < nv; i++) INTEGER(rv_ans)[i] = cnt[i];
+	INTEGER(rv_ans)[nv] = nmiss;
+	return rv_ans;
+}
+
+SEXP test_geno_cvt(SEXP val, SEXP start, SEXP find, SEXP substitute)
+{
+	int st = Rf_asInteger(start) - 1;
+	int n = XLENGTH(val);
+	SEXP rv_ans = NEW_INTEGER(n - st);
+	vec_i32_cvt_u8(INTEGER(rv_ans), (const uint8_t *)RAW(val) + st, n - st,
+		Rf_asInteger(find), Rf_asInteger(substitute));
+	return rv_ans;
+}
+
+
+SEXP test_geno_or_shl(SEXP x, SEXP y, SEXP start, SEXP shift)
+{
+	int st = Rf_asInteger(start) - 1;
+	int sh = Rf_asInteger(shift);
+	int n = XLENGTH(x);
+	const uint8_t *s = (const uint8_t *)RAW(y) + st;
+	if (sh < 8)
+	{
+		SEXP rv_ans = duplicate(x);
+		vec_u8_or_shl((uint8_t *)RAW(rv_ans) + st, s, n - st, sh);
+		return rv_ans;
+	} else {
+		SEXP rv_ans = PROTECT(NEW_INTEGER(n));
+		int *p = INTEGER(rv_ans);
+		for (int i=0; i < n; i++) p[i] = RAW(x)[i];
+		vec_i32_or_u8_shl(p + st, s, n - st, sh);
+		UNPROTECT(1);
+		return rv_ans;
+	}
+}
+
+
+SEXP test_geno_diploid(SEXP text, SEXP num_allele)
+{
+	const char *p = CHAR(STRING_ELT(text, 0));
+	size_t n = strlen(p) / 4;
+	std::vector<int16_t> geno(2*n + 1);
+	std::vector<int8_t> phase(n + 1);
+	size_t m = vec_char_geno_diploid(p, n, Rf_asInteger(num_allele),
+		&geno[0], &phase[0]);
+
+	// genotypes and phases of the parsed samples
+	SEXP rv_ans = PROTECT(NEW_LIST(2));
+	SEXP g = NEW_INTEGER(2*m);
+	SET_ELEMENT(rv_ans, 0, g);
+	for (size_t i=0; i < 2*m; i++)
+		INTEGER(g)[i] = (geno[i] >= 0) ? geno[i] : NA_INTEGER;
+	SEXP ph = NEW_INTEGER(m);
+	SET_ELEMENT(rv_ans, 1, ph);
+	for (size_t i=0; i < m; i++) INTEGER(ph)[i] = phase[i];
+	UNPROTECT(1);
+	return rv_ans;
+}
+
+
 SEXP test_position_index(SEXP node, SEXP position)
 {
 	COREARRAY_TRY
@@ -220,4 +298,121 @@ SEXP test_position_index(SEXP node, SEXP position)
 	COREARRAY_CATCH
 }
 
+
+/// the accumulated sums of CIndex::GetInfo() in the sequential order and
+/// in the order of 'position'
+SEXP test_position_index_order(SEXP node, SEXP position)
+{
+	COREARRAY_TRY
+
+		SeqArray::CIndex Idx;
+		Idx.Init(GDS_R_SEXP2Obj(node, TRUE), NULL);
+		const int n = XLENGTH(position);
+		const int *pPos = INTEGER(position);
+
+		rv_ans = PROTECT(NEW_NUMERIC(2));
+		double *p = REAL(rv_ans);
+		C_Int64 cnt;
+		int val;
+
+		// sequential access
+		double sum = 0;
+		for (int i=0; i < n; i++)
+		{
+			Idx.GetInfo(i, cnt, val);
+			sum += cnt;
+		}
+		p[0] = sum;
+
+		// random access
+		sum = 0;
+		for (int i=0; i < n; i++)
+		{
+			Idx.GetInfo(pPos[i]-1, cnt, val);
+			sum += cnt;
+		}
+		p[1] = sum;
+
+		UNPROTECT(1);
+
+	COREARRAY_CATCH
+}
+
+
+/// the numbers of reference and missing alleles of the selected variants
+/// (a 2-by-variant matrix) from CApply_Variant_Geno::CountGeno(), with the
+/// read-ahead genotypes if 'prefetch' is TRUE
+SEXP test_count_geno(SEXP gdsfile, SEXP prefetch)
+{
+	COREARRAY_TRY
+
+		SeqArray::CFileInfo &File = SeqArray::GetFileInfo(gdsfile);
+		const int nVar = File.VariantSelNum();
+		SeqArray::CApply_Variant_Geno Geno(File, FALSE);
+		SeqArray::CGenoPrefetchPtr Prefetch;
+		if (Rf_asLogical(prefetch) == TRUE)
+		{
+			Prefetch.Ptr = SeqArray::CGenoPrefetch::New(File);
+			if (!Prefetch.Ptr)
+				throw SeqArray::ErrSeqArray("No read-ahead of genotypes.");
+			Geno.SetPrefetch(Prefetch.Ptr);
+		}
+		std::vector<int> buf(File.SampleSelNum()*File.Ploidy() + 1);
+
+		rv_ans = PROTECT(allocMatrix(INTSXP, 2, nVar));
+		int *p = INTEGER(rv_ans);
+		for (int i=0; i < nVar; i++)
+		{
+			size_t n_ref, n_miss;
+			Geno.CountGeno(n_ref, n_miss, &buf[0]);
+			p[2*i] = n_ref; p[2*i+1] = n_miss;
+			Geno.Next();
+		}
+		UNPROTECT(1);
+
+	COREARRAY_CATCH
+}
+
+
+
+/// TRUE if fast_strtod() gives the same value (bit by bit) and the same end
+/// of parsing as strtod() for each string
+SEXP test_fast_strtod(SEXP text)
+{
+	const R_xlen_t n = XLENGTH(text);
+	SEXP rv_ans = PROTECT(NEW_LOGICAL(n));
+	int *p = LOGICAL(rv_ans);
+	for (R_xlen_t i=0; i < n; i++)
+	{
+		const char *s = CHAR(STRING_ELT(text, i));
+		char *e1, *e2;
+		double v1 = SeqArray::fast_strtod(s, &e1);
+		double v2 = strtod(s, &e2);
+		p[i] = (e1 == e2) && ((memcmp(&v1, &v2, sizeof(double)) == 0) ||
+			(ISNAN(v1) && ISNAN(v2)));
+	}
+	UNPROTECT(1);
+	return rv_ans;
+}
+
+
+/// TRUE if fast_gtoa() gives the same text as sprintf("%g") for each finite
+/// number
+SEXP test_fast_gtoa(SEXP val)
+{
+	const R_xlen_t n = XLENGTH(val);
+	const double *v = REAL(val);
+	SEXP rv_ans = PROTECT(NEW_LOGICAL(n));
+	int *p = LOGICAL(rv_ans);
+	char s1[64], s2[64];
+	for (R_xlen_t i=0; i < n; i++)
+	{
+		*SeqArray::fast_gtoa(s1, v[i]) = 0;
+		snprintf(s2, sizeof(s2), "%g", v[i]);
+		p[i] = (strcmp(s1, s2) == 0);
+	}
+	UNPROTECT(1);
+	return rv_ans;
+}
+
 }
@@ -32,6 +32,46 @@
 #   define COREARRAY_COMPILER_OPTIMIZE_FLAG  3
 #endif
 
+#include "vectorization_dispatch.h"
+
+// rename the kernels when compiled for runtime CPU dispatch, e.g.,
+// vec_i8_count_def, vec_i8_count_avx2 and vec_i8_count_avx512bw
+#ifdef COREARRAY_CPU_DISPATCH
+#   ifndef VEC_SUFFIX
+#       define VEC_SUFFIX    def
+#   endif
+#   define VEC_NAME_2(name, suffix)    name ## _ ## suffix
+#   define VEC_NAME_1(name, suffix)    VEC_NAME_2(name, suffix)
+#   define VEC_NAME(name)              VEC_NAME_1(name, VEC_SUFFIX)
+#   define vec_i8_cnt_nonzero       VEC_NAME(vec_i8_cnt_nonzero)
+#   define vec_i8_cnt_nonzero_ptr   VEC_NAME(vec_i8_cnt_nonzero_ptr)
+#   define vec_i8_count             VEC_NAME(vec_i8_count)
+#   define vec_i8_count2            VEC_NAME(vec_i8_count2)
+#   define vec_i8_count3            VEC_NAME(vec_i8_count3)
+#   define vec_u8_histogram         VEC_NAME(vec_u8_histogram)
+#   define vec_i8_replace           VEC_NAME(vec_i8_replace)
+#   define vec_i8_cnt_dosage2       VEC_NAME(vec_i8_cnt_dosage2)
+#   define vec_i8_cnt_dosage_alt2   VEC_NAME(vec_i8_cnt_dosage_alt2)
+#   define vec_u8_shr_b2            VEC_NAME(vec_u8_shr_b2)
+#   define vec_i16_shr_b2           VEC_NAME(vec_i16_shr_b2)
+#   define vec_i32_count            VEC_NAME(vec_i32_count)
+#   define vec_i32_count2           VEC_NAME(vec_i32_count2)
+#   define vec_i32_count3           VEC_NAME(vec_i32_count3)
+#   define vec_i32_histogram        VEC_NAME(vec_i32_histogram)
+#   define vec_int32_set            VEC_NAME(vec_int32_set)
+#   define vec_i32_replace          VEC_NAME(vec_i32_replace)
+#   define vec_i32_cnt_dosage2      VEC_NAME(vec_i32_cnt_dosage2)
+#   define vec_i32_cnt_dosage_alt2  VEC_NAME(vec_i32_cnt_dosage_alt2)
+#   define vec_i32_shr_b2           VEC_NAME(vec_i32_shr_b2)
+#   define vec_i32_bound_check      VEC_NAME(vec_i32_bound_check)
+#   define vec_char_find_CRLF       VEC_NAME(vec_char_find_CRLF)
+#   define vec_char_geno_diploid    VEC_NAME(vec_char_geno_diploid)
+#   define vec_bool_find_true       VEC_NAME(vec_bool_find_true)
+#   define vec_u8_or_shl            VEC_NAME(vec_u8_or_shl)
+#   define vec_i32_cvt_u8           VEC_NAME(vec_i32_cvt_u8)
+#   define vec_i32_or_u8_shl        VEC_NAME(vec_i32_or_u8_shl)
+#endif
+
 #include "vectorization.h"
 
 
@@ -51,6 +91,15 @@ size_t vec_i8_cnt_nonzero(const int8_t *p, size_t n)
 	for (; (n > 0) && (h > 0); n--, h--)
 		ans += (*p++) ? 1 : 0;
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	for (; n >= 64; n -= 64, p += 64)
+	{
+		__m512i v = _mm512_loadu_si512((void const*)p);
+		ans += POPCNT_U64(_mm512_test_epi8_mask(v, v));
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 
 	// header 2, 32-byte aligned
@@ -240,6 +289,18 @@ size_t vec_i8_count(const char *p, size_t n, char val)
 	for (; (n > 0) && (h > 0); n--, h--)
 		if (*p++ == val) num++;
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	{
+		const __m512i mask = _mm512_set1_epi8(val);
+		for (; n >= 64; n-=64, p+=64)
+		{
+			__m512i v = _mm512_loadu_si512((void const*)p);
+			num += POPCNT_U64(_mm512_cmpeq_epi8_mask(v, mask));
+		}
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 	// body, AVX2
 	const __m128i zeros = _mm_setzero_si128();
@@ -293,8 +354,7 @@ size_t vec_i8_count(const char *p, size_t n, char val)
 		n -= 16; p += 16;
 	}
 
-	if (offset > 0)
-		num += vec_avx_sum_u8(sum);
+	num += vec_avx_sum_u8(sum);
 
 #   else
 	// body, SSE2
@@ -361,6 +421,20 @@ void vec_i8_count2(const char *p, size_t n, char val1, char val2,
 		if (v == val2) n2++;
 	}
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	{
+		const __m512i mask1 = _mm512_set1_epi8(val1);
+		const __m512i mask2 = _mm512_set1_epi8(val2);
+		for (; n >= 64; n-=64, p+=64)
+		{
+			__m512i v = _mm512_loadu_si512((void const*)p);
+			n1 += POPCNT_U64(_mm512_cmpeq_epi8_mask(v, mask1));
+			n2 += POPCNT_U64(_mm512_cmpeq_epi8_mask(v, mask2));
+		}
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 	// body, AVX2
 	const __m128i zeros = _mm_setzero_si128();
@@ -405,11 +479,8 @@ void vec_i8_count2(const char *p, size_t n, char val1, char val2,
 		n -= 16; p += 16;
 	}
 
-	if (offset > 0)
-	{
-		n1 += vec_avx_sum_u8(sum1);
-		n2 += vec_avx_sum_u8(sum2);
-	}
+	n1 += vec_avx_sum_u8(sum1);
+	n2 += vec_avx_sum_u8(sum2);
 
 #   else
 	// body, SSE2
@@ -472,6 +543,22 @@ void vec_i8_count3(const char *p, size_t n, char val1, char val2, char val3,
 		if (v == val3) n3++;
 	}
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	{
+		const __m512i mask1 = _mm512_set1_epi8(val1);
+		const __m512i mask2 = _mm512_set1_epi8(val2);
+		const __m512i mask3 = _mm512_set1_epi8(val3);
+		for (; n >= 64; n-=64, p+=64)
+		{
+			__m512i v = _mm512_loadu_si512((void const*)p);
+			n1 += POPCNT_U64(_mm512_cmpeq_epi8_mask(v, mask1));
+			n2 += POPCNT_U64(_mm512_cmpeq_epi8_mask(v, mask2));
+			n3 += POPCNT_U64(_mm512_cmpeq_epi8_mask(v, mask3));
+		}
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 	// body, AVX2
 	const __m128i zeros = _mm_setzero_si128();
@@ -523,12 +610,9 @@ void vec_i8_count3(const char *p, size_t n, char val1, char val2, char val3,
 		n -= 16; p += 16;
 	}
 
-	if (offset > 0)
-	{
-		n1 += vec_avx_sum_u8(sum1);
-		n2 += vec_avx_sum_u8(sum2);
-		n3 += vec_avx_sum_u8(sum3);
-	}
+	n1 += vec_avx_sum_u8(sum1);
+	n2 += vec_avx_sum_u8(sum2);
+	n3 += vec_avx_sum_u8(sum3);
 
 #   else
 	// body, SSE2
@@ -580,6 +664,87 @@ void vec_i8_count3(const char *p, size_t n, char val1, char val2, char val3,
 }
 
 
+/// count each value in [0, n_val) and 'missing', out[v] += the count of v,
+/// returning the count of 'missing' ('missing' should not be in [0, n_val))
+size_t vec_u8_histogram(const uint8_t *p, size_t n, size_t *out, int n_val,
+	uint8_t missing)
+{
+	size_t nmiss = 0;
+	if (n_val > 256) n_val = 256;
+
+#ifdef COREARRAY_SIMD_SSE2
+	if (n_val <= 16)
+	{
+		// blocks of at most 255 vectors (in L1 cache), compare once for each
+		// value, the byte counters do not overflow
+#   ifdef COREARRAY_SIMD_AVX2
+		while (n >= 32)
+		{
+			size_t m = n >> 5;
+			if (m > 255) m = 255;
+			for (int v=0; v <= n_val; v++)
+			{
+				const __m256i mask = _mm256_set1_epi8(v < n_val ? v : missing);
+				__m256i sum = _mm256_setzero_si256();
+				const uint8_t *s = p;
+				for (size_t i=0; i < m; i++, s+=32)
+					sum = _mm256_sub_epi8(sum, _mm256_cmpeq_epi8(MM_LOADU_256(s), mask));
+				size_t c = vec_avx_sum_u8(sum);
+				if (v < n_val) out[v] += c; else nmiss += c;
+			}
+			p += m << 5; n -= m << 5;
+		}
+#   endif
+		while (n >= 16)
+		{
+			size_t m = n >> 4;
+			if (m > 255) m = 255;
+			for (int v=0; v <= n_val; v++)
+			{
+				const __m128i mask = _mm_set1_epi8(v < n_val ? v : missing);
+				__m128i sum = _mm_setzero_si128();
+				const uint8_t *s = p;
+				for (size_t i=0; i < m; i++, s+=16)
+					sum = _mm_sub_epi8(sum, _mm_cmpeq_epi8(MM_LOADU_128(s), mask));
+				size_t c = vec_sum_u8(sum);
+				if (v < n_val) out[v] += c; else nmiss += c;
+			}
+			p += m << 4; n -= m << 4;
+		}
+	}
+#endif
+
+	if (n >= 256)
+	{
+		// four sub-histograms to avoid the dependency of successive increments
+		size_t h[4][257];
+		memset(h, 0, sizeof(h));
+		for (; n >= 4; n-=4, p+=4)
+		{
+			h[0][(p[0]==missing) ? 256 : p[0]] ++;
+			h[1][(p[1]==missing) ? 256 : p[1]] ++;
+			h[2][(p[2]==missing) ? 256 : p[2]] ++;
+			h[3][(p[3]==missing) ? 256 : p[3]] ++;
+		}
+		for (int v=0; v < n_val; v++)
+			out[v] += h[0][v] + h[1][v] + h[2][v] + h[3][v];
+		nmiss += h[0][256] + h[1][256] + h[2][256] + h[3][256];
+	}
+
+	// tail
+	for (; n > 0; n--)
+	{
+		uint8_t g = *p++;
+		if (g == missing)
+			nmiss ++;
+		else if (g < n_val)
+			out[g] ++;
+	}
+
+	return nmiss;
+}
+
+
 void vec_i8_replace(int8_t *p, size_t n, int8_t val, int8_t substitute)
 {
 #ifdef COREARRAY_SIMD_SSE2
@@ -610,8 +775,6 @@ void vec_i8_replace(int8_t *p, size_t n, int8_t val, int8_t substitute)
 
 	const __m256i mask2 = _mm256_set1_epi8(val);
 	const __m256i sub32 = _mm256_set1_epi8(substitute);
-	const __m256i zero = _mm256_setzero_si256();
-	const __m256i ones = _mm256_cmpeq_epi64(zero, zero);
 
 	for (; n >= 32; n-=32, p+=32)
 	{
@@ -619,7 +782,6 @@ void vec_i8_replace(int8_t *p, size_t n, int8_t val, int8_t substitute)
 		__m256i c = _mm256_cmpeq_epi8(v, mask2);
 		if (_mm256_movemask_epi8(c))
 		{
-			// TODO
 			_mm256_store_si256((__m256i *)p,
 				_mm256_or_si256(_mm256_and_si256(c, sub32),
 				_mm256_andnot_si256(c, v)));
@@ -950,6 +1112,18 @@ size_t vec_i32_count(const int32_t *p, size_t n, int32_t val)
 	for (; (n > 0) && (h > 0); n--, h--)
 		if (*p++ == val) ans++;
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	{
+		const __m512i mask = _mm512_set1_epi32(val);
+		for (; n >= 16; n-=16, p+=16)
+		{
+			__m512i v = _mm512_loadu_si512((void const*)p);
+			ans += POPCNT_U32(_mm512_cmpeq_epi32_mask(v, mask));
+		}
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 
 	// body, AVX2
@@ -1036,6 +1210,20 @@ void vec_i32_count2(const int32_t *p, size_t n, int32_t val1, int32_t val2,
 		if (v == val2) n2++;
 	}
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	{
+		const __m512i mask1 = _mm512_set1_epi32(val1);
+		const __m512i mask2 = _mm512_set1_epi32(val2);
+		for (; n >= 16; n-=16, p+=16)
+		{
+			__m512i v = _mm512_loadu_si512((void const*)p);
+			n1 += POPCNT_U32(_mm512_cmpeq_epi32_mask(v, mask1));
+			n2 += POPCNT_U32(_mm512_cmpeq_epi32_mask(v, mask2));
+		}
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 
 	// body, AVX2
@@ -1147,6 +1335,22 @@ void vec_i32_count3(const int32_t *p, size_t n, int32_t val1, int32_t val2,
 		if (v == val3) n3++;
 	}
 
+#   ifdef COREARRAY_SIMD_AVX512BW
+	// body, AVX512BW
+	{
+		const __m512i mask1 = _mm512_set1_epi32(val1);
+		const __m512i mask2 = _mm512_set1_epi32(val2);
+		const __m512i mask3 = _mm512_set1_epi32(val3);
+		for (; n >= 16; n-=16, p+=16)
+		{
+			__m512i v = _mm512_loadu_si512((void const*)p);
+			n1 += POPCNT_U32(_mm512_cmpeq_epi32_mask(v, mask1));
+			n2 += POPCNT_U32(_mm512_cmpeq_epi32_mask(v, mask2));
+			n3 += POPCNT_U32(_mm512_cmpeq_epi32_mask(v, mask3));
+		}
+	}
+#   endif
+
 #   ifdef COREARRAY_SIMD_AVX2
 
 	// body, AVX2
@@ -1235,6 +1439,88 @@ void vec_i32_count3(const int32_t *p, size_t n, int32_t val1, int32_t val2,
 }
 
 
+/// count each value in [0, n_val) and 'missing', out[v] += the count of v,
+/// returning the count of 'missing' ('missing' should not be in [0, n_val))
+size_t vec_i32_histogram(const int32_t *p, size_t n, size_t *out, int n_val,
+	int32_t missing)
+{
+	size_t nmiss = 0;
+	if (n_val < 0) n_val = 0;
+
+#ifdef COREARRAY_SIMD_SSE2
+	if (n_val <= 16)
+	{
+		// blocks of at most 1024 integers (in L1 cache), compare once for
+		// each value
+#   ifdef COREARRAY_SIMD_AVX2
+		while (n >= 8)
+		{
+			size_t m = n >> 3;
+			if (m > 128) m = 128;
+			for (int v=0; v <= n_val; v++)
+			{
+				const __m256i mask = _mm256_set1_epi32(v < n_val ? v : missing);
+				__m256i sum = _mm256_setzero_si256();
+				const int32_t *s = p;
+				for (size_t i=0; i < m; i++, s+=8)
+					sum = _mm256_sub_epi32(sum, _mm256_cmpeq_epi32(MM_LOADU_256(s), mask));
+				size_t c = vec_avx_sum_i32(sum);
+				if (v < n_val) out[v] += c; else nmiss += c;
+			}
+			p += m << 3; n -= m << 3;
+		}
+#   endif
+		while (n >= 4)
+		{
+			size_t m = n >> 2;
+			if (m > 256) m = 256;
+			for (int v=0; v <= n_val; v++)
+			{
+				const __m128i mask = _mm_set1_epi32(v < n_val ? v : missing);
+				__m128i sum = _mm_setzero_si128();
+				const int32_t *s = p;
+				for (size_t i=0; i < m; i++, s+=4)
+					sum = _mm_sub_epi32(sum, _mm_cmpeq_epi32(MM_LOADU_128(s), mask));
+				size_t c = vec_sum_i32(sum);
+				if (v < n_val) out[v] += c; else nmiss += c;
+			}
+			p += m << 2; n -= m << 2;
+		}
+	}
+#endif
+
+	if ((n >= 256) && (n_val <= 256))
+	{
+		// four sub-histograms to avoid the dependency of successive increments
+		size_t h[4][256];
+		memset(h, 0, sizeof(h));
+		const uint32_t nv = n_val;
+		for (; n >= 4; n-=4, p+=4)
+		{
+			uint32_t g0=p[0], g1=p[1], g2=p[2], g3=p[3];
+			if (g0 < nv) h[0][g0] ++; else if (p[0] == missing) nmiss ++;
+			if (g1 < nv) h[1][g1] ++; else if (p[1] == missing) nmiss ++;
+			if (g2 < nv) h[2][g2] ++; else if (p[2] == missing) nmiss ++;
+			if (g3 < nv) h[3][g3] ++; else if (p[3] == missing) nmiss ++;
+		}
+		for (int v=0; v < n_val; v++)
+			out[v] += h[0][v] + h[1][v] + h[2][v] + h[3][v];
+	}
+
+	// tail
+	for (; n > 0; n--)
+	{
+		int32_t g = *p++;
+		if (g == missing)
+			nmiss ++;
+		else if ((uint32_t)g < (uint32_t)n_val)
+			out[g] ++;
+	}
+
+	return nmiss;
+}
+
+
 void vec_int32_set(int32_t *p, size_t n, int32_t val)
 {
 	for (; n > 0; n--) *p++ = val;
@@ -1691,6 +1977,140 @@ tail:
 }
 
 
+/// parse one diploid genotype 'a|b' or 'a/b' followed by a tab
+static int geno_diploid_1(const char *p, int max_digit, int16_t *geno,
+	int8_t *phase)
+{
+	int a = (unsigned char)p[0], b = (unsigned char)p[2];
+	if ((p[1] != '|' && p[1] != '/') || (p[3] != '\t'))
+		return 0;
+	if (a == '.') a = -1;
+	else if ((unsigned)(a -= '0') > (unsigned)max_digit) return 0;
+	if (b == '.') b = -1;
+	else if ((unsigned)(b -= '0') > (unsigned)max_digit) return 0;
+	geno[0] = a; geno[1] = b;
+	*phase = (p[1] == '|') ? 1 : 0;
+	return 1;
+}
+
+/// parse the diploid genotypes of GT-only samples, each of which is exactly
+/// 4 bytes '[0-9.][|/][0-9.]\t' with alleles less than 'num_allele', and
+/// return the number of samples parsed before the first irregular one
+size_t vec_char_geno_diploid(const char *p, size_t n, int num_allele,
+	int16_t *geno, int8_t *phase)
+{
+	if (num_allele <= 0) return 0;
+	const int max_digit = (num_allele < 10) ? (num_allele - 1) : 9;
+	const size_t n0 = n;
+
+#ifdef COREARRAY_SIMD_SSE2
+
+	// bytes of a sample: allele, separator, allele, tab
+	const __m128i c0 = _mm_set1_epi8('0');
+	const __m128i cmax = _mm_set1_epi8(max_digit);
+	const __m128i cdot = _mm_set1_epi8('.');
+	const __m128i cpipe = _mm_set1_epi8('|');
+	const __m128i cslash = _mm_set1_epi8('/');
+	const __m128i ctab = _mm_set1_epi8('\t');
+	const __m128i m_al  = _mm_set1_epi32(0x00FF00FF);
+	const __m128i m_sep = _mm_set1_epi32(0x0000FF00);
+	const __m128i m_tab = _mm_set1_epi32(0xFF000000);
+
+#   ifdef COREARRAY_SIMD_AVX2
+
+	// body, AVX2, 8 samples per vector and 32 samples per loop
+	const __m256i c0_2 = _mm256_set1_epi8('0');
+	const __m256i cmax2 = _mm256_set1_epi8(max_digit);
+	const __m256i cdot2 = _mm256_set1_epi8('.');
+	const __m256i cpipe2 = _mm256_set1_epi8('|');
+	const __m256i cslash2 = _mm256_set1_epi8('/');
+	const __m256i ctab2 = _mm256_set1_epi8('\t');
+	const __m256i m_al2  = _mm256_set1_epi32(0x00FF00FF);
+	const __m256i m_sep2 = _mm256_set1_epi32(0x0000FF00);
+	const __m256i m_tab2 = _mm256_set1_epi32(0xFF000000);
+
+	for (; n >= 32; n-=32, p+=128, geno+=64, phase+=32)
+	{
+		__m256i g[4];
+		uint32_t pipe_mask[4];
+		int ok = 1;
+		for (int k=0; k < 4; k++)
+		{
+			__m256i v = _mm256_loadu_si256((__m256i const*)(p + 32*k));
+			__m256i d = _mm256_sub_epi8(v, c0_2);
+			__m256i dig = _mm256_cmpeq_epi8(_mm256_min_epu8(d, cmax2), d);
+			__m256i dot = _mm256_cmpeq_epi8(v, cdot2);
+			__m256i pipe = _mm256_cmpeq_epi8(v, cpipe2);
+			__m256i sep = _mm256_or_si256(pipe, _mm256_cmpeq_epi8(v, cslash2));
+			__m256i tab = _mm256_cmpeq_epi8(v, ctab2);
+			__m256i c = _mm256_or_si256(
+				_mm256_and_si256(_mm256_or_si256(dig, dot), m_al2),
+				_mm256_or_si256(_mm256_and_si256(sep, m_sep2),
+				_mm256_and_si256(tab, m_tab2)));
+			ok &= (_mm256_movemask_epi8(c) == -1);
+			// '.' => -1, sign-extending the alleles in bytes 0 and 2
+			__m256i g8 = _mm256_or_si256(_mm256_andnot_si256(dot, d), dot);
+			g[k] = _mm256_srai_epi16(_mm256_slli_epi16(g8, 8), 8);
+			pipe_mask[k] = _mm256_movemask_epi8(pipe);
+		}
+		if (!ok) break;
+		for (int k=0; k < 4; k++)
+		{
+			_mm256_storeu_si256((__m256i*)(geno + 16*k), g[k]);
+			for (int j=0; j < 8; j++)
+				phase[8*k + j] = (pipe_mask[k] >> (4*j + 1)) & 0x01;
+		}
+	}
+
+#   endif
+
+	// body, SSE2, 4 samples per vector and 16 samples per loop
+	for (; n >= 16; n-=16, p+=64, geno+=32, phase+=16)
+	{
+		__m128i g[4];
+		int pipe_mask[4];
+		int ok = 1;
+		for (int k=0; k < 4; k++)
+		{
+			__m128i v = _mm_loadu_si128((__m128i const*)(p + 16*k));
+			__m128i d = _mm_sub_epi8(v, c0);
+			__m128i dig = _mm_cmpeq_epi8(_mm_min_epu8(d, cmax), d);
+			__m128i dot = _mm_cmpeq_epi8(v, cdot);
+			__m128i pipe = _mm_cmpeq_epi8(v, cpipe);
+			__m128i sep = _mm_or_si128(pipe, _mm_cmpeq_epi8(v, cslash));
+			__m128i tab = _mm_cmpeq_epi8(v, ctab);
+			__m128i c = _mm_or_si128(
+				_mm_and_si128(_mm_or_si128(dig, dot), m_al),
+				_mm_or_si128(_mm_and_si128(sep, m_sep),
+				_mm_and_si128(tab, m_tab)));
+			ok &= (_mm_movemask_epi8(c) == 0xFFFF);
+			// '.' => -1, sign-extending the alleles in bytes 0 and 2
+			__m128i g8 = _mm_or_si128(_mm_andnot_si128(dot, d), dot);
+			g[k] = _mm_srai_epi16(_mm_slli_epi16(g8, 8), 8);
+			pipe_mask[k] = _mm_movemask_epi8(pipe);
+		}
+		if (!ok) break;
+		for (int k=0; k < 4; k++)
+		{
+			_mm_storeu_si128((__m128i*)(geno + 8*k), g[k]);
+			for (int j=0; j < 4; j++)
+				phase[4*k + j] = (pipe_mask[k] >> (4*j + 1)) & 0x01;
+		}
+	}
+
+#endif
+
+	// tail, or the block with an irregular sample
+	for (; n > 0; n--, p+=4, geno+=2, phase++)
+	{
+		if (!geno_diploid_1(p, max_digit, geno, phase))
+			break;
+	}
+
+	return n0 - n;
+}
+
+
 /// find non-zero
 COREARRAY_DLL_DEFAULT const int8_t *vec_bool_find_true(const int8_t *p,
 	const int8_t *end)
@@ -1719,3 +2139,100 @@ COREARRAY_DLL_DEFAULT const int8_t *vec_bool_find_true(const int8_t *p,
 	for (; p < end; p++) if (*p) break;
 	return p;
 }
+
+
+
+// ===========================================================
+// functions for genotype decoding
+// ===========================================================
+
+/// p[i] |= s[i] << shift, assuming shift < 8
+COREARRAY_DLL_DEFAULT void vec_u8_or_shl(uint8_t *p, const uint8_t *s, size_t n,
+	int shift)
+{
+#ifdef COREARRAY_SIMD_AVX2
+	const __m256i mask2 = _mm256_set1_epi8((0xFF << shift) & 0xFF);
+	for (; n >= 32; n-=32, p+=32, s+=32)
+	{
+		__m256i v = _mm256_slli_epi16(MM_LOADU_256(s), shift);
+		v = _mm256_or_si256(MM_LOADU_256(p), _mm256_and_si256(v, mask2));
+		_mm256_storeu_si256((__m256i*)p, v);
+	}
+#endif
+#ifdef COREARRAY_SIMD_SSE2
+	const __m128i mask = _mm_set1_epi8((0xFF << shift) & 0xFF);
+	for (; n >= 16; n-=16, p+=16, s+=16)
+	{
+		__m128i v = _mm_slli_epi16(MM_LOADU_128(s), shift);
+		v = _mm_or_si128(MM_LOADU_128(p), _mm_and_si128(v, mask));
+		_mm_storeu_si128((__m128i*)p, v);
+	}
+#endif
+	for (; n > 0; n--) *p++ |= (*s++) << shift;
+}
+
+
+/// p[i] = (s[i]==val) ? substitute : s[i], widening uint8 to int32
+COREARRAY_DLL_DEFAULT void vec_i32_cvt_u8(int32_t *p, const uint8_t *s,
+	size_t n, uint8_t val, int32_t substitute)
+{
+#ifdef COREARRAY_SIMD_AVX2
+	const __m256i val8 = _mm256_set1_epi32(val);
+	const __m256i sub8 = _mm256_set1_epi32(substitute);
+	for (; n >= 8; n-=8, p+=8, s+=8)
+	{
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)s));
+		__m256i c = _mm256_cmpeq_epi32(v, val8);
+		_mm256_storeu_si256((__m256i*)p, _mm256_blendv_epi8(v, sub8, c));
+	}
+#endif
+#ifdef COREARRAY_SIMD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i val4 = _mm_set1_epi32(val);
+	const __m128i sub4 = _mm_set1_epi32(substitute);
+	for (; n >= 16; n-=16, p+=16, s+=16)
+	{
+		__m128i v = MM_LOADU_128(s);
+		__m128i w1 = _mm_unpacklo_epi8(v, zero), w2 = _mm_unpackhi_epi8(v, zero);
+		__m128i v1 = _mm_unpacklo_epi16(w1, zero), v2 = _mm_unpackhi_epi16(w1, zero);
+		__m128i v3 = _mm_unpacklo_epi16(w2, zero), v4 = _mm_unpackhi_epi16(w2, zero);
+		_mm_storeu_si128((__m128i*)p,
+			MM_BLEND_128(sub4, v1, _mm_cmpeq_epi32(v1, val4)));
+		_mm_storeu_si128((__m128i*)(p+4),
+			MM_BLEND_128(sub4, v2, _mm_cmpeq_epi32(v2, val4)));
+		_mm_storeu_si128((__m128i*)(p+8),
+			MM_BLEND_128(sub4, v3, _mm_cmpeq_epi32(v3, val4)));
+		_mm_storeu_si128((__m128i*)(p+12),
+			MM_BLEND_128(sub4, v4, _mm_cmpeq_epi32(v4, val4)));
+	}
+#endif
+	for (; n > 0; n--, s++)
+		*p++ = (*s == val) ? substitute : *s;
+}
+
+
+/// p[i] |= s[i] << shift, widening uint8 to int32
+COREARRAY_DLL_DEFAULT void vec_i32_or_u8_shl(int32_t *p, const uint8_t *s,
+	size_t n, int shift)
+{
+#ifdef COREARRAY_SIMD_AVX2
+	for (; n >= 8; n-=8, p+=8, s+=8)
+	{
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)s));
+		v = _mm256_or_si256(MM_LOADU_256(p), _mm256_slli_epi32(v, shift));
+		_mm256_storeu_si256((__m256i*)p, v);
+	}
+#endif
+#ifdef COREARRAY_SIMD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; n >= 8; n-=8, p+=8, s+=8)
+	{
+		__m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i const*)s), zero);
+		__m128i v1 = _mm_slli_epi32(_mm_unpacklo_epi16(w, zero), shift);
+		__m128i v2 = _mm_slli_epi32(_mm_unpackhi_epi16(w, zero), shift);
+		_mm_storeu_si128((__m128i*)p, _mm_or_si128(MM_LOADU_128(p), v1));
+		_mm_storeu_si128((__m128i*)(p+4), _mm_or_si128(MM_LOADU_128(p+4), v2));
+	}
+#endif
+	for (; n > 0; n--) *p++ |= ((int32_t)(*s++)) << shift;
+}
@@ -33,6 +33,7 @@
 #define _HEADER_COREARRAY_VECTORIZATION_
 
 #include <CoreDEF.h>
+#include "vectorization_dispatch.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -309,6 +310,11 @@ COREARRAY_DLL_DEFAULT void vec_i8_count3(const char *p, size_t n,
 	char val1, char val2, char val3, size_t *out_n1, size_t *out_n2,
 	size_t *out_n3);
 
+/// count each value in [0, n_val) and 'missing', out[v] += the count of v,
+/// returning the count of 'missing' ('missing' should not be in [0, n_val))
+COREARRAY_DLL_DEFAULT size_t vec_u8_histogram(const uint8_t *p, size_t n,
+	size_t *out, int n_val, uint8_t missing);
+
 /// replace 'val' in the array of 'p' by 'substitute'
 COREARRAY_DLL_DEFAULT void vec_i8_replace(int8_t *p, size_t n, int8_t val,
 	int8_t substitute);
@@ -357,6 +363,11 @@ COREARRAY_DLL_DEFAULT void vec_i32_count3(const int32_t *p, size_t n,
 	int32_t val1, int32_t val2, int32_t val3, size_t *out_n1, size_t *out_n2,
 	size_t *out_n3);
 
+/// count each value in [0, n_val) and 'missing', out[v] += the count of v,
+/// returning the count of 'missing' ('missing' should not be in [0, n_val))
+COREARRAY_DLL_DEFAULT size_t vec_i32_histogram(const int32_t *p, size_t n,
+	size_t *out, int n_val, int32_t missing);
+
 ///
 COREARRAY_DLL_DEFAULT void vec_int32_set(int32_t *p, size_t n, int32_t val);
 
@@ -396,11 +407,54 @@ COREARRAY_DLL_DEFAULT int vec_i32_bound_check(const int32_t *p, size_t n, int bo
 /// find CRLF character
 COREARRAY_DLL_DEFAULT const char *vec_char_find_CRLF(const char *p, size_t n);
 
+/// parse the diploid genotypes '[0-9.][|/][0-9.]\t' of 'n' samples, and
+/// return the number of samples parsed before the first irregular one
+COREARRAY_DLL_DEFAULT size_t vec_char_geno_diploid(const char *p, size_t n,
+	int num_allele, int16_t *geno, int8_t *phase);
+
 /// find non-zero
 COREARRAY_DLL_DEFAULT const int8_t *vec_bool_find_true(const int8_t *p,
 	const int8_t *end);
 
 
+
+// ===========================================================
+// functions for genotype decoding
+// ===========================================================
+
+/// p[i] |= s[i] << shift, assuming shift < 8
+COREARRAY_DLL_DEFAULT void vec_u8_or_shl(uint8_t *p, const uint8_t *s, size_t n,
+	int shift);
+
+/// p[i] = (s[i]==val) ? substitute : s[i], widening uint8 to int32
+/// (no replacement if val == substitute)
+COREARRAY_DLL_DEFAULT void vec_i32_cvt_u8(int32_t *p, const uint8_t *s,
+	size_t n, uint8_t val, int32_t substitute);
+
+/// p[i] |= s[i] << shift, widening uint8 to int32
+COREARRAY_DLL_DEFAULT void vec_i32_or_u8_shl(int32_t *p, const uint8_t *s,
+	size_t n, int shift);
+
+
+
+// ===========================================================
+// runtime CPU dispatch
+// ===========================================================
+
+/// select the implementations of kernels according to the CPU features,
+/// called once when the package is loaded
+COREARRAY_DLL_DEFAULT void vec_init_dispatch();
+
+/// the number of kernels
+COREARRAY_DLL_DEFAULT int vec_kernel_num();
+
+/// return the name of the i-th kernel, and its implementation in 'impl'
+COREARRAY_DLL_DEFAULT const char *vec_kernel_info(int i, const char **impl);
+
+/// the CPU features detected at runtime, or "" if no runtime detection
+COREARRAY_DLL_DEFAULT const char *vec_cpu_features();
+
+
 #ifdef __cplusplus
 }
 #endif
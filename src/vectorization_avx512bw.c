@@ -0,0 +1,41 @@
+// ===========================================================
+//
+// vectorization_avx512bw.c: the AVX-512BW variant of vectorized kernels
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     vectorization_avx512bw.c
+ *	\author   Xiuwen Zheng [zhengx@u.washington.edu]
+ *	\version  1.0
+ *	\date     2020
+ *	\brief    the AVX-512BW variant of vectorized kernels
+ *	\details  It is compiled only for runtime CPU dispatch, see
+ *	          vectorization_dispatch.h
+**/
+
+#include "vectorization_dispatch.h"
+
+#ifdef COREARRAY_CPU_DISPATCH
+
+// the target must be set before any header defining COREARRAY_SIMD_*
+#   pragma GCC target("popcnt,avx,avx2,avx512f,avx512bw")
+#   define VEC_SUFFIX    avx512bw
+#   include "vectorization.c"
+
+#endif
@@ -0,0 +1,315 @@
+// ===========================================================
+//
+// vectorization_dispatch.c: runtime CPU dispatch of vectorized kernels
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     vectorization_dispatch.c
+ *	\author   Xiuwen Zheng [zhengx@u.washington.edu]
+ *	\version  1.0
+ *	\date     2020
+ *	\brief    runtime CPU dispatch of vectorized kernels
+ *	\details
+**/
+
+#include "vectorization.h"
+
+
+/// the number of kernels
+#define VEC_NUM_KERNEL    31
+
+/// the names of kernels and the selected implementations
+static const char *vec_kernel_name[VEC_NUM_KERNEL];
+static const char *vec_kernel_impl[VEC_NUM_KERNEL];
+static int vec_kernel_cnt = 0;
+/// the CPU features detected at runtime
+static const char *vec_cpu_feature = "";
+
+
+#ifdef COREARRAY_CPU_DISPATCH
+
+// ===========================================================
+// the public functions calling the selected variants
+// ===========================================================
+
+#define VEC_FUNC_PTR(name)    \
+	extern __typeof__(vec_##name) vec_##name##_def, vec_##name##_avx2, \
+		vec_##name##_avx512bw; \
+	static __typeof__(vec_##name) *fc_##name = &vec_##name##_def
+
+VEC_FUNC_PTR(i8_cnt_nonzero);
+size_t vec_i8_cnt_nonzero(const int8_t *p, size_t n)
+	{ return (*fc_i8_cnt_nonzero)(p, n); }
+
+VEC_FUNC_PTR(i8_cnt_nonzero_ptr);
+const int8_t *vec_i8_cnt_nonzero_ptr(const int8_t *p,
+	size_t n, size_t *out_n)
+	{ return (*fc_i8_cnt_nonzero_ptr)(p, n, out_n); }
+
+VEC_FUNC_PTR(i8_count);
+size_t vec_i8_count(const char *p, size_t n, char val)
+	{ return (*fc_i8_count)(p, n, val); }
+
+VEC_FUNC_PTR(i8_count2);
+void vec_i8_count2(const char *p, size_t n,
+	char val1, char val2, size_t *out_n1, size_t *out_n2)
+	{ (*fc_i8_count2)(p, n, val1, val2, out_n1, out_n2); }
+
+VEC_FUNC_PTR(i8_count3);
+void vec_i8_count3(const char *p, size_t n,
+	char val1, char val2, char val3, size_t *out_n1, size_t *out_n2,
+	size_t *out_n3)
+	{ (*fc_i8_count3)(p, n, val1, val2, val3, out_n1, out_n2, out_n3); }
+
+VEC_FUNC_PTR(u8_histogram);
+size_t vec_u8_histogram(const uint8_t *p, size_t n,
+	size_t *out, int n_val, uint8_t missing)
+	{ return (*fc_u8_histogram)(p, n, out, n_val, missing); }
+
+VEC_FUNC_PTR(i8_replace);
+void vec_i8_replace(int8_t *p, size_t n, int8_t val,
+	int8_t substitute)
+	{ (*fc_i8_replace)(p, n, val, substitute); }
+
+VEC_FUNC_PTR(i8_cnt_dosage2);
+void vec_i8_cnt_dosage2(const int8_t *p,
+	int8_t *out, size_t n, int8_t val, int8_t missing, int8_t missing_substitute)
+	{ (*fc_i8_cnt_dosage2)(p, out, n, val, missing, missing_substitute); }
+
+VEC_FUNC_PTR(i8_cnt_dosage_alt2);
+void vec_i8_cnt_dosage_alt2(const int8_t *p,
+	int8_t *out, size_t n, int8_t val, int8_t missing, int8_t missing_substitute)
+	{ (*fc_i8_cnt_dosage_alt2)(p, out, n, val, missing, missing_substitute); }
+
+VEC_FUNC_PTR(u8_shr_b2);
+void vec_u8_shr_b2(uint8_t *p, size_t n)
+	{ (*fc_u8_shr_b2)(p, n); }
+
+VEC_FUNC_PTR(i16_shr_b2);
+void vec_i16_shr_b2(int16_t *p, size_t n)
+	{ (*fc_i16_shr_b2)(p, n); }
+
+VEC_FUNC_PTR(i32_count);
+size_t vec_i32_count(const int32_t *p, size_t n, int32_t val)
+	{ return (*fc_i32_count)(p, n, val); }
+
+VEC_FUNC_PTR(i32_count2);
+void vec_i32_count2(const int32_t *p, size_t n,
+	int32_t val1, int32_t val2, size_t *out_n1, size_t *out_n2)
+	{ (*fc_i32_count2)(p, n, val1, val2, out_n1, out_n2); }
+
+VEC_FUNC_PTR(i32_count3);
+void vec_i32_count3(const int32_t *p, size_t n,
+	int32_t val1, int32_t val2, int32_t val3, size_t *out_n1, size_t *out_n2,
+	size_t *out_n3)
+	{ (*fc_i32_count3)(p, n, val1, val2, val3, out_n1, out_n2, out_n3); }
+
+VEC_FUNC_PTR(i32_histogram);
+size_t vec_i32_histogram(const int32_t *p, size_t n,
+	size_t *out, int n_val, int32_t missing)
+	{ return (*fc_i32_histogram)(p, n, out, n_val, missing); }
+
+VEC_FUNC_PTR(int32_set);
+void vec_int32_set(int32_t *p, size_t n, int32_t val)
+	{ (*fc_int32_set)(p, n, val); }
+
+VEC_FUNC_PTR(i32_replace);
+void vec_i32_replace(int32_t *p, size_t n, int32_t val,
+	int32_t substitute)
+	{ (*fc_i32_replace)(p, n, val, substitute); }
+
+VEC_FUNC_PTR(i32_cnt_dosage2);
+void vec_i32_cnt_dosage2(const int32_t *p,
+	int32_t *out, size_t n, int32_t val, int32_t missing, int32_t missing_substitute)
+	{ (*fc_i32_cnt_dosage2)(p, out, n, val, missing, missing_substitute); }
+
+VEC_FUNC_PTR(i32_cnt_dosage_alt2);
+void vec_i32_cnt_dosage_alt2(const int32_t *p,
+	int32_t *out, size_t n, int32_t val, int32_t missing, int32_t missing_substitute)
+	{ (*fc_i32_cnt_dosage_alt2)(p, out, n, val, missing, missing_substitute); }
+
+VEC_FUNC_PTR(i32_shr_b2);
+void vec_i32_shr_b2(int32_t *p, size_t n)
+	{ (*fc_i32_shr_b2)(p, n); }
+
+VEC_FUNC_PTR(i32_bound_check);
+int vec_i32_bound_check(const int32_t *p, size_t n, int bound)
+	{ return (*fc_i32_bound_check)(p, n, bound); }
+
+VEC_FUNC_PTR(char_find_CRLF);
+const char *vec_char_find_CRLF(const char *p, size_t n)
+	{ return (*fc_char_find_CRLF)(p, n); }
+
+VEC_FUNC_PTR(char_geno_diploid);
+size_t vec_char_geno_diploid(const char *p, size_t n,
+	int num_allele, int16_t *geno, int8_t *phase)
+	{ return (*fc_char_geno_diploid)(p, n, num_allele, geno, phase); }
+
+VEC_FUNC_PTR(bool_find_true);
+const int8_t *vec_bool_find_true(const int8_t *p,
+	const int8_t *end)
+	{ return (*fc_bool_find_true)(p, end); }
+
+VEC_FUNC_PTR(u8_or_shl);
+void vec_u8_or_shl(uint8_t *p, const uint8_t *s, size_t n,
+	int shift)
+	{ (*fc_u8_or_shl)(p, s, n, shift); }
+
+VEC_FUNC_PTR(i32_cvt_u8);
+void vec_i32_cvt_u8(int32_t *p, const uint8_t *s,
+	size_t n, uint8_t val, int32_t substitute)
+	{ (*fc_i32_cvt_u8)(p, s, n, val, substitute); }
+
+VEC_FUNC_PTR(i32_or_u8_shl);
+void vec_i32_or_u8_shl(int32_t *p, const uint8_t *s,
+	size_t n, int shift)
+	{ (*fc_i32_or_u8_shl)(p, s, n, shift); }
+
+
+// ===========================================================
+// select the variants according to CPUID
+// ===========================================================
+
+/// use the AVX-512BW variant only if the kernel has AVX-512BW code,
+/// otherwise the AVX2 variant to avoid the frequency penalty
+#define VEC_SELECT(name, has_avx512bw)    \
+	if ((has_avx512bw) && cpu_avx512bw) \
+		{ fc_##name = &vec_##name##_avx512bw; impl = "AVX512BW"; } \
+	else if (cpu_avx2) \
+		{ fc_##name = &vec_##name##_avx2; impl = "AVX2"; } \
+	else \
+		{ fc_##name = &vec_##name##_def; impl = "SSE2"; } \
+	vec_kernel_name[vec_kernel_cnt] = "vec_" #name; \
+	vec_kernel_impl[vec_kernel_cnt++] = impl
+
+void vec_init_dispatch()
+{
+	__builtin_cpu_init();
+	const int cpu_avx2 = __builtin_cpu_supports("avx2") &&
+		__builtin_cpu_supports("popcnt");
+	const int cpu_avx512bw = cpu_avx2 && __builtin_cpu_supports("avx512f") &&
+		__builtin_cpu_supports("avx512bw");
+	vec_cpu_feature = cpu_avx512bw ? "AVX2, AVX512BW" : (cpu_avx2 ? "AVX2" : "");
+
+	const char *impl;
+	vec_kernel_cnt = 0;
+	VEC_SELECT(i8_cnt_nonzero, 1);
+	VEC_SELECT(i8_cnt_nonzero_ptr, 0);
+	VEC_SELECT(i8_count, 1);
+	VEC_SELECT(i8_count2, 1);
+	VEC_SELECT(i8_count3, 1);
+	VEC_SELECT(u8_histogram, 0);
+	VEC_SELECT(i8_replace, 0);
+	VEC_SELECT(i8_cnt_dosage2, 0);
+	VEC_SELECT(i8_cnt_dosage_alt2, 0);
+	VEC_SELECT(u8_shr_b2, 0);
+	VEC_SELECT(i16_shr_b2, 0);
+	VEC_SELECT(i32_count, 1);
+	VEC_SELECT(i32_count2, 1);
+	VEC_SELECT(i32_count3, 1);
+	VEC_SELECT(i32_histogram, 0);
+	VEC_SELECT(int32_set, 0);
+	VEC_SELECT(i32_replace, 0);
+	VEC_SELECT(i32_cnt_dosage2, 0);
+	VEC_SELECT(i32_cnt_dosage_alt2, 0);
+	VEC_SELECT(i32_shr_b2, 0);
+	VEC_SELECT(i32_bound_check, 0);
+	VEC_SELECT(char_find_CRLF, 0);
+	VEC_SELECT(char_geno_diploid, 0);
+	VEC_SELECT(bool_find_true, 0);
+	VEC_SELECT(u8_or_shl, 0);
+	VEC_SELECT(i32_cvt_u8, 0);
+	VEC_SELECT(i32_or_u8_shl, 0);
+}
+
+#else
+
+// ===========================================================
+// no runtime dispatch, the implementations fixed at compile time
+// ===========================================================
+
+#if defined(COREARRAY_SIMD_AVX2)
+#   define VEC_IMPL_DEF    "AVX2"
+#elif defined(COREARRAY_SIMD_SSE2)
+#   define VEC_IMPL_DEF    "SSE2"
+#else
+#   define VEC_IMPL_DEF    "generic"
+#endif
+
+#ifdef COREARRAY_SIMD_AVX512BW
+#   define VEC_SELECT(name, has_avx512bw)    \
+		vec_kernel_name[vec_kernel_cnt] = "vec_" #name; \
+		vec_kernel_impl[vec_kernel_cnt++] = (has_avx512bw) ? "AVX512BW" : VEC_IMPL_DEF
+#else
+#   define VEC_SELECT(name, has_avx512bw)    \
+		vec_kernel_name[vec_kernel_cnt] = "vec_" #name; \
+		vec_kernel_impl[vec_kernel_cnt++] = VEC_IMPL_DEF
+#endif
+
+void vec_init_dispatch()
+{
+	vec_kernel_cnt = 0;
+	VEC_SELECT(i8_cnt_nonzero, 1);
+	VEC_SELECT(i8_cnt_nonzero_ptr, 0);
+	VEC_SELECT(i8_count, 1);
+	VEC_SELECT(i8_count2, 1);
+	VEC_SELECT(i8_count3, 1);
+	VEC_SELECT(u8_histogram, 0);
+	VEC_SELECT(i8_replace, 0);
+	VEC_SELECT(i8_cnt_dosage2, 0);
+	VEC_SELECT(i8_cnt_dosage_alt2, 0);
+	VEC_SELECT(u8_shr_b2, 0);
+	VEC_SELECT(i16_shr_b2, 0);
+	VEC_SELECT(i32_count, 1);
+	VEC_SELECT(i32_count2, 1);
+	VEC_SELECT(i32_count3, 1);
+	VEC_SELECT(i32_histogram, 0);
+	VEC_SELECT(int32_set, 0);
+	VEC_SELECT(i32_replace, 0);
+	VEC_SELECT(i32_cnt_dosage2, 0);
+	VEC_SELECT(i32_cnt_dosage_alt2, 0);
+	VEC_SELECT(i32_shr_b2, 0);
+	VEC_SELECT(i32_bound_check, 0);
+	VEC_SELECT(char_find_CRLF, 0);
+	VEC_SELECT(char_geno_diploid, 0);
+	VEC_SELECT(bool_find_true, 0);
+	VEC_SELECT(u8_or_shl, 0);
+	VEC_SELECT(i32_cvt_u8, 0);
+	VEC_SELECT(i32_or_u8_shl, 0);
+}
+
+#endif
+
+
+int vec_kernel_num()
+{
+	return vec_kernel_cnt;
+}
+
+const char *vec_kernel_info(int i, const char **impl)
+{
+	if ((i < 0) || (i >= vec_kernel_cnt)) return NULL;
+	if (impl) *impl = vec_kernel_impl[i];
+	return vec_kernel_name[i];
+}
+
+const char *vec_cpu_features()
+{
+	return vec_cpu_feature;
+}
@@ -0,0 +1,51 @@
+// ===========================================================
+//
+// vectorization_dispatch.h: runtime CPU dispatch of vectorized kernels
+//
+// Copyright (C) 2020    Xiuwen Zheng
+//
+// This file is part of SeqArray.
+//
+// SeqArray is free software: you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 3 as
+// published by the Free Software Foundation.
+//
+// SeqArray is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with SeqArray.
+// If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ *	\file     vectorization_dispatch.h
+ *	\author   Xiuwen Zheng [zhengx@u.washington.edu]
+ *	\version  1.0
+ *	\date     2020
+ *	\brief    runtime CPU dispatch of vectorized kernels
+ *	\details  When the package is not compiled for AVX2 (the usual case of
+ *	          binary packages), vectorization.c is compiled three times
+ *	          (the default target, AVX2 and AVX-512BW) with the suffixes
+ *	          '_def', '_avx2' and '_avx512bw', and the public functions
+ *	          call the variant selected according to CPUID at package load.
+ *	          This header does not include any other header, since it is
+ *	          included before '#pragma GCC target' in the target-specific
+ *	          units.
+**/
+
+
+#ifndef _HEADER_COREARRAY_VECTORIZATION_DISPATCH_
+#define _HEADER_COREARRAY_VECTORIZATION_DISPATCH_
+
+// GCC (not clang, which does not define __AVX2__ with '#pragma GCC target')
+// on x86, and the default target is at least SSE2 but without AVX2
+#if !defined(COREARRAY_NO_CPU_DISPATCH) && defined(__GNUC__) && \
+	!defined(__clang__) && (__GNUC__ >= 6) && \
+	(defined(__x86_64__) || defined(__i386__)) && \
+	defined(__SSE2__) && !defined(__AVX2__)
+#   define COREARRAY_CPU_DISPATCH
+#endif
+
+#endif /* _HEADER_COREARRAY_VECTORIZATION_DISPATCH_ */